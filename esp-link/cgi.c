@@ -43,80 +43,139 @@ void ICACHE_FLASH_ATTR errorResponse(HttpdConnData *connData, int code, const ch
   DBG("HTTP %d error response: \"%s\"\n", code, message);
 }
 
+// interval of checking idle event streams for new text (ms)
+#define STREAM_POLL_MS 50
+
+static ETSTimer streamTimer;
+static bool streamTimerArmed;
+
+// the stream cgis are only called after a sent callback, so idle streams are checked for new
+// text by a timer, which runs while streams are open
+static void ICACHE_FLASH_ATTR streamTimerCb(void *arg) {
+  if (httpdStreamPoll(NULL) == 0) {
+    os_timer_disarm(&streamTimer);
+    streamTimerArmed = false;
+  }
+}
+
+int ICACHE_FLASH_ATTR cgiTextStream(HttpdConnData *connData,
+    int (*readFn)(int *pos, char *buff, int len)) {
+  int *pos = connData->cgiData;
+  if (connData->conn == NULL) { // Connection aborted. Clean up.
+    if (pos != NULL) os_free(pos);
+    connData->cgiData = NULL;
+    return HTTPD_CGI_DONE;
+  }
+
+  if (pos == NULL) {
+    pos = os_zalloc(sizeof(int));
+    if (pos == NULL) {
+      errorResponse(connData, 500, "Out of memory");
+      return HTTPD_CGI_DONE;
+    }
+    // a reconnecting browser continues after the last event it got
+    char *arg = httpdGetHeaderValue(connData, HTTPD_HEADER_LAST_EVENT_ID);
+    if (arg == NULL) arg = httpdGetArg(connData, "start", NULL);
+    if (arg != NULL) *pos = atoi(arg);
+    if (!httpdStreamStart(connData)) {
+      os_free(pos);
+      errorResponse(connData, 503, "Too many streams open");
+      return HTTPD_CGI_DONE;
+    }
+    connData->cgiData = pos;
+    if (!streamTimerArmed) {
+      os_timer_disarm(&streamTimer);
+      os_timer_setfn(&streamTimer, streamTimerCb, NULL);
+      os_timer_arm(&streamTimer, STREAM_POLL_MS, 1);
+      streamTimerArmed = true;
+    }
+  }
+
+  // text dropped from the ring buffer is skipped by readFn, so the start of the text is only
+  // known after reading it
+  char buff[256];
+  int len;
+  while ((len = readFn(pos, buff, sizeof(buff))) > 0) {
+    int start = *pos - len;
+    int used = httpdSendEvent(connData, start, buff, len);
+    *pos = start + used;
+    if (used < len) break;
+  }
+  return HTTPD_CGI_MORE;
+}
+
 // look for the HTTP arg 'name' and store it at 'config' with max length 'max_len' (incl
 // terminating zero), returns -1 on error, 0 if not found, 1 if found and OK
 int8_t ICACHE_FLASH_ATTR getStringArg(HttpdConnData *connData, char *name, char *config, int max_len) {
-  char buff[128];
-  int len = httpdFindArg(connData->getArgs, name, buff, sizeof(buff));
-  if (len < 0) return 0; // not found, skip
+  char buff[96];
+  int len;
+  char *val = httpdGetArg(connData, name, &len);
+  if (val == NULL) return 0; // not found, skip
   if (len >= max_len) {
     os_sprintf(buff, "Value for %s too long (%d > %d allowed)", name, len, max_len-1);
     errorResponse(connData, 400, buff);
     return -1;
   }
-  os_strcpy(config, buff);
+  os_strcpy(config, val);
   return 1;
 }
 
-// look for the HTTP arg 'name' and store it at 'config' as an 8-bit integer
+// look for the HTTP arg 'name' and parse it as an integer in the range min..max,
 // returns -1 on error, 0 if not found, 1 if found and OK
-int8_t ICACHE_FLASH_ATTR getInt8Arg(HttpdConnData *connData, char *name, int8_t *config) {
-  char buff[16];
-  int len = httpdFindArg(connData->getArgs, name, buff, sizeof(buff));
-  if (len < 0) return 0; // not found, skip
-  int m = atoi(buff);
-  if (len > 5 || m < -127 || m > 127) {
+static int8_t ICACHE_FLASH_ATTR getIntArg(HttpdConnData *connData, char *name, int maxLen,
+    int min, int max, int *value) {
+  char buff[64];
+  int len;
+  char *val = httpdGetArg(connData, name, &len);
+  if (val == NULL) return 0; // not found, skip
+  int m = atoi(val);
+  if (len > maxLen || m < min || m > max) {
     os_sprintf(buff, "Value for %s out of range", name);
     errorResponse(connData, 400, buff);
     return -1;
   }
-  *config = m;
+  *value = m;
   return 1;
 }
 
+// look for the HTTP arg 'name' and store it at 'config' as an 8-bit integer
+// returns -1 on error, 0 if not found, 1 if found and OK
+int8_t ICACHE_FLASH_ATTR getInt8Arg(HttpdConnData *connData, char *name, int8_t *config) {
+  int m;
+  int8_t r = getIntArg(connData, name, 5, -127, 127, &m);
+  if (r > 0) *config = m;
+  return r;
+}
+
 // look for the HTTP arg 'name' and store it at 'config' as an unsigned 8-bit integer
 // returns -1 on error, 0 if not found, 1 if found and OK
 int8_t ICACHE_FLASH_ATTR getUInt8Arg(HttpdConnData *connData, char *name, uint8_t *config) {
-  char buff[16];
-  int len = httpdFindArg(connData->getArgs, name, buff, sizeof(buff));
-  if (len < 0) return 0; // not found, skip
-  int m = atoi(buff);
-  if (len > 4 || m < 0 || m > 255) {
-    os_sprintf(buff, "Value for %s out of range", name);
-    errorResponse(connData, 400, buff);
-    return -1;
-  }
-  *config = m;
-  return 1;
+  int m;
+  int8_t r = getIntArg(connData, name, 4, 0, 255, &m);
+  if (r > 0) *config = m;
+  return r;
 }
 
 // look for the HTTP arg 'name' and store it at 'config' as an unsigned 16-bit integer
 // returns -1 on error, 0 if not found, 1 if found and OK
 int8_t ICACHE_FLASH_ATTR getUInt16Arg(HttpdConnData *connData, char *name, uint16_t *config) {
-  char buff[16];
-  int len = httpdFindArg(connData->getArgs, name, buff, sizeof(buff));
-  if (len < 0) return 0; // not found, skip
-  int m = atoi(buff);
-  if (len > 6 || m < 0 || m > 65535) {
-    os_sprintf(buff, "Value for %s out of range", name);
-    errorResponse(connData, 400, buff);
-    return -1;
-  }
-  *config = m;
-  return 1;
+  int m;
+  int8_t r = getIntArg(connData, name, 6, 0, 65535, &m);
+  if (r > 0) *config = m;
+  return r;
 }
 
 int8_t ICACHE_FLASH_ATTR getBoolArg(HttpdConnData *connData, char *name, bool *config) {
-  char buff[16];
-  int len = httpdFindArg(connData->getArgs, name, buff, sizeof(buff));
-  if (len < 0) return 0; // not found, skip
+  char buff[64];
+  char *val = httpdGetArg(connData, name, NULL);
+  if (val == NULL) return 0; // not found, skip
 
-  if (os_strcmp(buff, "1") == 0 || os_strcmp(buff, "true") == 0) {
+  if (os_strcmp(val, "1") == 0 || os_strcmp(val, "true") == 0) {
     *config = true;
     return 1;
   }
 
-  if (os_strcmp(buff, "0") == 0 || os_strcmp(buff, "false") == 0) {
+  if (os_strcmp(val, "0") == 0 || os_strcmp(val, "false") == 0) {
     *config = false;
     return 1;
   }
@@ -3,11 +3,18 @@
 
 #include <esp8266.h>
 #include "httpd.h"
+#include "jsonwriter.h"
 
 void noCacheHeaders(HttpdConnData *connData, int code);
 void jsonHeader(HttpdConnData *connData, int code);
 void errorResponse(HttpdConnData *connData, int code, const char* const message);
 
+// Server-Sent Events stream of the text in a ring buffer read by readFn (logRead or
+// consoleRead), starting at the "start" param or the Last-Event-ID of a reconnecting browser,
+// the id of each event is the position after its text. Never returns HTTPD_CGI_DONE unless
+// the stream can't be started.
+int cgiTextStream(HttpdConnData *connData, int (*readFn)(int *pos, char *buff, int len));
+
 // Get the HTTP query-string param 'name' and store it at 'config' with max length
 // 'max_len' (incl terminating zero), returns -1 on error, 0 if not found, 1 if found
 int8_t getStringArg(HttpdConnData *connData, char *name, char *config, int max_len);
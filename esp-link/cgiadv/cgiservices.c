@@ -5,6 +5,7 @@
 #include "sntp.h"
 #include "cgimqtt.h"
 #include "stringdefs.h"
+#include "stack.h"
 
 #ifdef SYSLOG
 #include "syslog.h"
@@ -66,6 +67,7 @@ int ICACHE_FLASH_ATTR cgiSystemInfo(HttpdConnData *connData) {
       "\"slip\": \"%s\", "
       "\"mqtt\": \"%s/%s\", "
       "\"baud\": \"%ld\", "
+      "\"max stack\": \"%ld\", "
       "\"description\": \"%s\""
     " }",
     flashConfig.hostname,
@@ -78,6 +80,7 @@ int ICACHE_FLASH_ATTR cgiSystemInfo(HttpdConnData *connData) {
     flashConfig.mqtt_enable ? "enabled" : "disabled",
     mqttState(),
     flashConfig.baud_rate,
+    (unsigned long)stackHighWater(),
     flashConfig.sys_descr
     );
 
@@ -98,36 +101,25 @@ void ICACHE_FLASH_ATTR cgiServicesSNTPInit() {
 }
 
 int ICACHE_FLASH_ATTR cgiServicesInfo(HttpdConnData *connData) {
-  char buff[1024];
+  JsonWriter w;
 
   if (connData->conn == NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
-
-  os_sprintf(buff, 
-    "{ "
-      "\"syslog_host\": \"%s\", "
-      "\"syslog_minheap\": %d, "
-      "\"syslog_filter\": %d, "
-      "\"syslog_showtick\": \"%s\", "
-      "\"syslog_showdate\": \"%s\", "
-      "\"timezone_offset\": %d, "
-      "\"sntp_server\": \"%s\", "
-      "\"mdns_enable\": \"%s\", "
-      "\"mdns_servername\": \"%s\""
-    " }",    
-    flashConfig.syslog_host,
-    flashConfig.syslog_minheap,
-    flashConfig.syslog_filter,
-    flashConfig.syslog_showtick ? "enabled" : "disabled",
-    flashConfig.syslog_showdate ? "enabled" : "disabled",
-    flashConfig.timezone_offset,
-    flashConfig.sntp_server,
-    flashConfig.mdns_enable ? "enabled" : "disabled",
-    flashConfig.mdns_servername
-    );
-
-  jsonHeader(connData, 200);
-  httpdSend(connData, buff, -1);
-  return HTTPD_CGI_DONE;
+  if (connData->cgiData == NULL) jsonHeader(connData, 200);
+
+  jsonStart(&w, connData, (int)connData->cgiData);
+  jsonObjectOpen(&w, NULL);
+  jsonString(&w, "syslog_host", flashConfig.syslog_host);
+  jsonInt(&w, "syslog_minheap", flashConfig.syslog_minheap);
+  jsonInt(&w, "syslog_filter", flashConfig.syslog_filter);
+  jsonString(&w, "syslog_showtick", flashConfig.syslog_showtick ? "enabled" : "disabled");
+  jsonString(&w, "syslog_showdate", flashConfig.syslog_showdate ? "enabled" : "disabled");
+  jsonInt(&w, "timezone_offset", flashConfig.timezone_offset);
+  jsonString(&w, "sntp_server", flashConfig.sntp_server);
+  jsonString(&w, "mdns_enable", flashConfig.mdns_enable ? "enabled" : "disabled");
+  jsonString(&w, "mdns_servername", flashConfig.mdns_servername);
+  jsonObjectClose(&w);
+  connData->cgiData = (void *)jsonEnd(&w);
+  return connData->cgiData ? HTTPD_CGI_MORE : HTTPD_CGI_DONE;
 }
 
 int ICACHE_FLASH_ATTR cgiServicesSet(HttpdConnData *connData) {
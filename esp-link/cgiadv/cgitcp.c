@@ -8,17 +8,19 @@
 
 // Cgi to return TCP client settings
 int ICACHE_FLASH_ATTR cgiTcpGet(HttpdConnData *connData) {
-	char buff[1024];
-  int len;
+	JsonWriter w;
 
 	if (connData->conn==NULL) return HTTPD_CGI_DONE;
+	if (connData->cgiData == NULL) jsonHeader(connData, 200);
 
-  len = os_sprintf(buff, "{ \"tcp_enable\":%d, \"rssi_enable\": %d, \"api_key\":\"%s\" }",
-			flashConfig.tcp_enable, flashConfig.rssi_enable, flashConfig.api_key);
-
-	jsonHeader(connData, 200);
-	httpdSend(connData, buff, len);
-	return HTTPD_CGI_DONE;
+	jsonStart(&w, connData, (int)connData->cgiData);
+	jsonObjectOpen(&w, NULL);
+	jsonInt(&w, "tcp_enable", flashConfig.tcp_enable);
+	jsonInt(&w, "rssi_enable", flashConfig.rssi_enable);
+	jsonString(&w, "api_key", flashConfig.api_key);
+	jsonObjectClose(&w);
+	connData->cgiData = (void *)jsonEnd(&w);
+	return connData->cgiData ? HTTPD_CGI_MORE : HTTPD_CGI_DONE;
 }
 
 // Cgi to change choice of pin assignments
@@ -26,30 +28,29 @@ int ICACHE_FLASH_ATTR cgiTcpSet(HttpdConnData *connData) {
 	if (connData->conn==NULL) return HTTPD_CGI_DONE;
 
 	// Handle tcp_enable flag
-	char buff[128];
-	int len = httpdFindArg(connData->getArgs, "tcp_enable", buff, sizeof(buff));
-	if (len <= 0) {
+	char *arg = httpdGetArg(connData, "tcp_enable", NULL);
+	if (arg == NULL || *arg == 0) {
 	  jsonHeader(connData, 400);
     return HTTPD_CGI_DONE;
   }
-	flashConfig.tcp_enable = os_strcmp(buff, "true") == 0;
+	flashConfig.tcp_enable = os_strcmp(arg, "true") == 0;
 
 	// Handle rssi_enable flag
-	len = httpdFindArg(connData->getArgs, "rssi_enable", buff, sizeof(buff));
-	if (len <= 0) {
+	arg = httpdGetArg(connData, "rssi_enable", NULL);
+	if (arg == NULL || *arg == 0) {
 	  jsonHeader(connData, 400);
     return HTTPD_CGI_DONE;
   }
-	flashConfig.rssi_enable = os_strcmp(buff, "true") == 0;
+	flashConfig.rssi_enable = os_strcmp(arg, "true") == 0;
 
 	// Handle api_key flag
-	len = httpdFindArg(connData->getArgs, "api_key", buff, sizeof(buff));
-	if (len < 0) {
+	arg = httpdGetArg(connData, "api_key", NULL);
+	if (arg == NULL) {
 	  jsonHeader(connData, 400);
     return HTTPD_CGI_DONE;
   }
-	buff[sizeof(flashConfig.api_key)-1] = 0; // ensure we don't get an overrun
-	os_strcpy(flashConfig.api_key, buff);
+	os_strncpy(flashConfig.api_key, arg, sizeof(flashConfig.api_key)-1);
+	flashConfig.api_key[sizeof(flashConfig.api_key)-1] = 0; // ensure we don't get an overrun
 
   if (configSave()) {
     httpdStartResponse(connData, 200);
@@ -20,6 +20,9 @@ Some flash handling cgi routines. Used for reading the existing flash and updati
 #include "cgiflash.h"
 #include "espfs.h"
 #include "safeupgrade.h"
+#include "crc16.h"
+#include "heatshrink.h"
+#include "espfsformat.h"
 
 #define SPI_FLASH_MEM_EMU_START_ADDR    0x40200000
 #define USER1_BIN_SPI_FLASH_ADDR        4*1024                                      // either start after 4KB boot partition
@@ -79,6 +82,13 @@ static uint32 ICACHE_FLASH_ATTR getNextSPIFlashAddr(void) {
     return address;
 }
 
+static uint32 ICACHE_FLASH_ATTR getRunningSPIFlashAddr(void) {
+    const uint8 id = system_upgrade_enhance_userbin_check();
+    const uint32 address = ( (id == 1) ? USER2_BIN_SPI_FLASH_ADDR : USER1_BIN_SPI_FLASH_ADDR );
+
+    return address;
+}
+
 const char* const ICACHE_FLASH_ATTR checkUpgradedFirmware()
 {
     // sanity-check that the 'next' partition actually contains something that looks like
@@ -130,9 +140,239 @@ int ICACHE_FLASH_ATTR cgiGetFirmwareNext(HttpdConnData *connData) {
 static ETSTimer flash_reboot_timer = { NULL, 0, 0, NULL, NULL };
 
 
+//Bytes of a compressed image, which are decompressed before they are written
+#define OTA_OUT_LEN 1024
+
+// State of the upload in progress, there can only be one at a time
+static struct {
+  HttpdConnData *conn; // connection of the upload
+  uint32 start;     // flash address of the image
+  uint32 end;       // flash address of the end of the image
+  uint32 pos;       // flash address to write next
+  uint32 erased;    // the sectors up to this address have been erased
+  uint32 eraseTo;   // the erase-ahead timer erases the sectors up to this address
+  uint32 ahead;     // bytes to erase ahead of pos
+  uint32 startTime; // system_get_time of the first chunk
+  uint16 crc;       // running crc16 of the image
+  uint16 imageCrc;  // crc16 of a compressed image announced by its header
+  HeatshrinkDecoder *dec; // decoder of a compressed image, NULL for a plain one
+  uint8 *out;       // decompressed data, which hasn't been written yet
+  int outLen;
+  bool delta;       // the decompressed data is a delta to the running image
+  uint32 base;      // flash address of the running image
+  int32 baseLen;
+  int32 basePos;    // offset in the running image of the next byte a delta adds to
+  int32 ctrl[3];    // control record of a delta: bytes to add, extra bytes, seek
+  int ctrlLen;      // bytes of the control record received
+} upload;
+
+static ETSTimer erase_ahead_timer;
+
+// Erase the sector of the next chunk, while it is being received. It runs after the receive
+// callback has returned, so the TCP window is opened again before the erase stalls the CPU.
+static void ICACHE_FLASH_ATTR eraseAheadTimerCb(void *arg) {
+  if (upload.erased >= upload.eraseTo) return;
+  DBG("Erasing ahead 0x%05x\n", (unsigned)upload.erased);
+  spi_flash_erase_sector(upload.erased/SPI_FLASH_SEC_SIZE);
+  upload.erased += SPI_FLASH_SEC_SIZE;
+  if (upload.erased < upload.eraseTo) os_timer_arm(&erase_ahead_timer, 0, 0);
+}
+
+// Erase the sectors up to the address, which the erase-ahead timer hasn't erased yet
+static void ICACHE_FLASH_ATTR eraseUpTo(uint32 address) {
+  while (upload.erased < address) {
+    spi_flash_erase_sector(upload.erased/SPI_FLASH_SEC_SIZE);
+    upload.erased += SPI_FLASH_SEC_SIZE;
+  }
+}
+
+// crc16 of the flash from start to end
+static uint16 ICACHE_FLASH_ATTR flashCrc(uint32 start, uint32 end) {
+  uint32 buf[64];
+  uint16 crc = 0;
+  for (uint32 addr = start; addr < end; addr += sizeof(buf)) {
+    uint32 len = end - addr < sizeof(buf) ? end - addr : sizeof(buf);
+    spi_flash_read(addr, buf, (len + 3) & ~3);
+    crc = crc16_data((unsigned char *)buf, len, crc);
+  }
+  return crc;
+}
+
+// Compare the crc16 of the written image with the one of the received data
+static bool ICACHE_FLASH_ATTR verifyUpload(void) {
+  return flashCrc(upload.start, upload.end) == upload.crc;
+}
+
+static uint32 ICACHE_FLASH_ATTR parseHex(const char *s) {
+  uint32 v = 0;
+  for (; *s != 0; s++) {
+    char c = *s | 0x20; // lower case
+    if (c >= '0' && c <= '9') v = (v << 4) | (c - '0');
+    else if (c >= 'a' && c <= 'f') v = (v << 4) | (c - 'a' + 10);
+    else break;
+  }
+  return v;
+}
+
+static void ICACHE_FLASH_ATTR uploadFree(void) {
+  if (upload.dec != NULL) heatshrinkDecoderFree(upload.dec);
+  if (upload.out != NULL) os_free(upload.out);
+  upload.dec = NULL;
+  upload.out = NULL;
+  upload.conn = NULL;
+}
+
+// Stop the upload without leaving a partial image behind, which cgiRebootFirmware would accept
+static void ICACHE_FLASH_ATTR uploadAbort(void) {
+  os_timer_disarm(&erase_ahead_timer);
+  if (upload.pos > upload.start) spi_flash_erase_sector(upload.start/SPI_FLASH_SEC_SIZE);
+  uploadFree();
+}
+
+// Write the next len bytes of the image, the buffer has to be padded to a multiple of 4 bytes
+static char* ICACHE_FLASH_ATTR uploadWrite(uint8 *data, uint32 len) {
+  if (upload.pos + len > upload.end) return "Image larger than its header says";
+  // check that data starts with an appropriate header
+  if (upload.pos == upload.start) {
+    char *err = check_header(data);
+    /* update anyway, if it is an ESP FS image */
+    if (err != NULL && !espFsIsImage(data)) return err;
+  }
+  // erase what the erase-ahead timer hasn't managed to yet and write the data
+  eraseUpTo(upload.pos + len);
+  //DBG("Writing %d bytes at 0x%05x\n", len, upload.pos);
+  spi_flash_write(upload.pos, (uint32 *)data, (len + 3) & ~3);
+  upload.crc = crc16_data(data, len, upload.crc);
+  upload.pos += len;
+  return NULL;
+}
+
+// Add decompressed data to the output buffer, which is written whenever it is full
+static char* ICACHE_FLASH_ATTR uploadOut(uint8 *data, int len) {
+  while (len > 0) {
+    int n = OTA_OUT_LEN - upload.outLen < len ? OTA_OUT_LEN - upload.outLen : len;
+    os_memcpy(upload.out + upload.outLen, data, n);
+    upload.outLen += n;
+    data += n;
+    len -= n;
+    if (upload.outLen == OTA_OUT_LEN) {
+      upload.outLen = 0;
+      char *err = uploadWrite(upload.out, OTA_OUT_LEN);
+      if (err != NULL) return err;
+    }
+  }
+  return NULL;
+}
+
+// Apply the decompressed data of a delta to the running image (see OtaDeltaHeader). The running
+// image is read as needed, so only the control record is kept between calls.
+static char* ICACHE_FLASH_ATTR deltaApply(uint8 *data, int len) {
+  char *err = NULL;
+  while (len > 0) {
+    int n;
+    if (upload.ctrlLen < sizeof(upload.ctrl)) {
+      n = sizeof(upload.ctrl) - upload.ctrlLen < len ? sizeof(upload.ctrl) - upload.ctrlLen : len;
+      os_memcpy((uint8 *)upload.ctrl + upload.ctrlLen, data, n);
+      upload.ctrlLen += n;
+      if (upload.ctrlLen == sizeof(upload.ctrl) && (upload.ctrl[0] < 0 || upload.ctrl[1] < 0))
+        return "Delta corrupt";
+    } else if (upload.ctrl[0] > 0) {
+      // bytes to add to those of the running image, read in aligned words
+      uint32 buf[17];
+      n = upload.ctrl[0] < len ? upload.ctrl[0] : len;
+      if (n > 64) n = 64;
+      if (upload.basePos < 0 || upload.basePos + n > upload.baseLen) return "Delta corrupt";
+      uint32 addr = upload.base + upload.basePos;
+      spi_flash_read(addr & ~3, buf, ((addr + n + 3) & ~3) - (addr & ~3));
+      uint8 *old = (uint8 *)buf + (addr & 3);
+      for (int i = 0; i < n; i++) old[i] += data[i];
+      err = uploadOut(old, n);
+      upload.basePos += n;
+      upload.ctrl[0] -= n;
+    } else {
+      // extra bytes, which are copied
+      n = upload.ctrl[1] < len ? upload.ctrl[1] : len;
+      err = uploadOut(data, n);
+      upload.ctrl[1] -= n;
+    }
+    if (err != NULL) return err;
+    data += n;
+    len -= n;
+    if (upload.ctrlLen == sizeof(upload.ctrl) && upload.ctrl[0] == 0 && upload.ctrl[1] == 0) {
+      upload.basePos += upload.ctrl[2];
+      upload.ctrlLen = 0;
+    }
+  }
+  return NULL;
+}
+
+// Decompress the data of a compressed image and pass it on. At the end of the image the rest
+// of the decoder's output is written too.
+static char* ICACHE_FLASH_ATTR uploadDecompress(uint8 *in, int inLen, bool last) {
+  uint8 buf[128];
+  for (;;) {
+    int used;
+    int n = heatshrinkDecode(upload.dec, in, inLen, &used, buf, sizeof(buf));
+    in += used;
+    inLen -= used;
+    char *err = upload.delta ? deltaApply(buf, n) : uploadOut(buf, n);
+    if (err != NULL) return err;
+    // the decoder stops early only if it has used up the input
+    if (n == 0 && inLen == 0) break;
+  }
+  if (last && upload.outLen > 0) {
+    int n = upload.outLen;
+    upload.outLen = 0;
+    return uploadWrite(upload.out, n);
+  }
+  return NULL;
+}
+
+// Start a compressed upload, returns the size of its headers or 0 for a plain image
+static int ICACHE_FLASH_ATTR uploadStartCompressed(uint8 *data, int len, char **err, int *code) {
+  OtaHeader *h = (OtaHeader *)data;
+  OtaDeltaHeader *dh = (OtaDeltaHeader *)(h + 1);
+  if (len < sizeof(OtaHeader) + sizeof(OtaDeltaHeader)) return 0;
+  if (h->magic != OTA_MAGIC && h->magic != OTA_DELTA_MAGIC) return 0;
+  if (h->compression != COMPRESS_HEATSHRINK || h->size > FIRMWARE_SIZE) {
+    *err = "Unsupported compressed image";
+    return 0;
+  }
+  upload.delta = h->magic == OTA_DELTA_MAGIC;
+  if (upload.delta) {
+    // the delta only fits the image, which it has been made for
+    upload.base = getRunningSPIFlashAddr();
+    upload.baseLen = dh->baseSize;
+    upload.basePos = 0;
+    upload.ctrlLen = 0;
+    if (dh->baseSize > FIRMWARE_SIZE ||
+        flashCrc(upload.base, upload.base + dh->baseSize) != dh->baseCrc) {
+      *err = "Delta base mismatch";
+      *code = 409;
+      return 0;
+    }
+  }
+  upload.dec = heatshrinkDecoderAlloc(h->params >> 4, h->params & 0xf);
+  upload.out = os_malloc(OTA_OUT_LEN);
+  if (upload.dec == NULL || upload.out == NULL) {
+    *err = "Cannot decompress image";
+    return 0;
+  }
+  upload.end = upload.start + h->size;
+  upload.imageCrc = h->crc;
+  return sizeof(OtaHeader) + (upload.delta ? sizeof(OtaDeltaHeader) : 0);
+}
+
 //===== Cgi that allows the firmware to be replaced via http POST
+// The data is written as it streams in. An image compressed by mkespfsimage -z is decompressed
+// on the fly. The response reports the crc16 (CRC-16/KERMIT) of the image and the throughput,
+// an expected crc can be passed as crc=<hex> argument.
 int ICACHE_FLASH_ATTR cgiUploadFirmware(HttpdConnData *connData) {
-  if (connData->conn==NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
+  if (connData->conn==NULL) {
+    // Connection aborted. Clean up.
+    if (upload.conn == connData) uploadAbort();
+    return HTTPD_CGI_DONE;
+  }
 
   /* do not start flashing, if an reboot request was enqueued */
   if (flash_reboot_timer.timer_func != NULL) {
@@ -156,27 +396,90 @@ int ICACHE_FLASH_ATTR cgiUploadFirmware(HttpdConnData *connData) {
   // assume no error yet...
   char *err = NULL;
   int code = 400;
+  uint8 *data = (uint8 *)connData->post->buff;
+  int len = connData->post->buffLen;
+  bool last = connData->post->received == connData->post->len;
 
   // check overall size
   //os_printf("FW: %d (max %d)\n", connData->post->len, FIRMWARE_SIZE);
   if (connData->post->len > FIRMWARE_SIZE) err = "Firmware image too large";
+  // a delta can be a lot smaller than any image
   if (connData->post->buff == NULL || connData->requestType != HTTPD_METHOD_POST ||
-      connData->post->len < 1024) err = "Invalid request";
+      connData->post->len < sizeof(OtaHeader) + sizeof(OtaDeltaHeader)) err = "Invalid request";
+
+  // the flash can only be written in words
+  if (err == NULL && offset % 4 != 0) {
+    err = "Buffering problem";
+    code = 500;
+  }
+
+  // the upload state is shared, so only one connection can upload at a time
+  if (err == NULL && upload.conn != NULL && upload.conn != connData) {
+    err = "Another upload is in progress";
+    code = 409;
+  } else if (err == NULL && offset > 0 && upload.conn != connData) {
+    err = "Upload state lost";
+    code = 500;
+  }
 
-  // check that data starts with an appropriate header
   if (err == NULL && offset == 0) {
-      err = check_header(connData->post->buff);
+    // let's see which partition we need to flash and what flash address that puts us at
+    uploadFree();
+    upload.conn = connData;
+    upload.start = upload.pos = upload.erased = upload.eraseTo = getNextSPIFlashAddr();
+    upload.end = upload.start + connData->post->len;
+    upload.ahead = connData->post->buffSize;
+    upload.startTime = system_get_time();
+    upload.crc = 0;
+    upload.outLen = 0;
+    upload.delta = false;
+#ifdef CGIFLASH_DBG
+    const uint8 id = system_upgrade_enhance_userbin_check();
+    DBG("Flashing 0x%05x (id=%d)\n", (unsigned)upload.start, 2 - id);
+#endif
+    os_timer_disarm(&erase_ahead_timer);
+    os_timer_setfn(&erase_ahead_timer, eraseAheadTimerCb, NULL);
+    int skip = uploadStartCompressed(data, len, &err, &code);
+    if (skip > 0) {
+      // about half the size or a lot less for a delta, so more sectors per chunk
+      upload.ahead = (upload.delta ? 8 : 2)*connData->post->buffSize;
+      data += skip;
+      len -= skip;
+    }
+  }
 
-      /* update anyway, if it is an ESP FS image */
-      if (err != NULL && espFsIsImage(connData->post->buff)) {
-          err = NULL;
-      }
+  if (err == NULL) {
+    if (upload.dec != NULL) err = uploadDecompress(data, len, last);
+    else err = uploadWrite(data, len);
   }
 
-  // make sure we're buffering in 1024 byte chunks
-  if (err == NULL && offset % 1024 != 0) {
-    err = "Buffering problem";
-    code = 500;
+  if (err == NULL && !last) {
+    // erase the sectors of the next chunk while it is being received
+    upload.eraseTo = upload.pos + upload.ahead;
+    if (upload.eraseTo > upload.end) upload.eraseTo = upload.end;
+    os_timer_arm(&erase_ahead_timer, 0, 0);
+    return HTTPD_CGI_MORE;
+  }
+
+  if (err == NULL) {
+    // the whole image has been received, check what ended up in the flash
+    char *crcArg = httpdGetArg(connData, "crc", NULL);
+    if (upload.pos != upload.end) {
+      err = "Image smaller than its header says";
+    } else if (upload.dec != NULL && upload.crc != upload.imageCrc) {
+      err = "Decompressed image corrupt";
+    } else if (!verifyUpload()) {
+      err = "Flash verification failed";
+      code = 500;
+    } else if (crcArg != NULL && parseHex(crcArg) != upload.crc) {
+      err = "Checksum mismatch";
+    }
+  }
+
+  // the upload of another connection is left alone
+  if (upload.conn == connData) {
+    if (err != NULL) uploadAbort();
+    else uploadFree();
   }
 
   // return an error if there is one
@@ -192,31 +495,15 @@ int ICACHE_FLASH_ATTR cgiUploadFirmware(HttpdConnData *connData) {
     return HTTPD_CGI_DONE;
   }
 
-  // let's see which partition we need to flash and what flash address that puts us at
-  uint32 address = getNextSPIFlashAddr();
-  address += offset;
-
-  // erase next flash block if necessary
-  if (address % SPI_FLASH_SEC_SIZE == 0){
-#ifdef CGIFLASH_DBG
-    const uint8 id = system_upgrade_enhance_userbin_check();
-    DBG("Flashing 0x%05x (id=%d)\n", address, 2 - id);
-#endif
-    spi_flash_erase_sector(address/SPI_FLASH_SEC_SIZE);
-  }
-
-  // Write the data
-  //DBG("Writing %d bytes at 0x%05x (%d of %d)\n", connData->post->buffSize, address,
-  //		connData->post->received, connData->post->len);
-  spi_flash_write(address, (uint32 *)connData->post->buff, connData->post->buffLen);
-
-  if (connData->post->received == connData->post->len){
-    httpdStartResponse(connData, 200);
-    httpdEndHeaders(connData);
-    return HTTPD_CGI_DONE;
-  } else {
-    return HTTPD_CGI_MORE;
-  }
+  uint32 ms = (system_get_time() - upload.startTime) / 1000;
+  char buff[128];
+  os_sprintf(buff, "{\"size\":%d, \"received\":%d, \"crc\":\"%04x\", \"ms\":%d, \"kbps\":%d}",
+      (int)(upload.end - upload.start), connData->post->len, upload.crc, (int)ms,
+      ms > 0 ? (int)(connData->post->len * 8 / ms) : 0);
+  DBG("Flashed %s\n", buff);
+  jsonHeader(connData, 200);
+  httpdSend(connData, buff, -1);
+  return HTTPD_CGI_DONE;
 }
 
 
@@ -62,9 +62,9 @@ static char *wifiPhy[]  = { 0, "11b", "11g", "11n" };
 
 void (*wifiStatusCb)(uint8_t); // callback when wifi status changes
 
-static char* ICACHE_FLASH_ATTR wifiGetReason(void) {
-  if (wifiReason <= 24) return wifiReasons[wifiReason];
-  if (wifiReason >= 200 && wifiReason <= 201) return wifiReasons[wifiReason-200+24];
+static char* ICACHE_FLASH_ATTR wifiGetReason(uint8_t reason) {
+  if (reason <= 24) return wifiReasons[reason];
+  if (reason >= 200 && reason <= 201) return wifiReasons[reason-200+24];
   return wifiReasons[1];
 }
 
@@ -84,7 +84,7 @@ static void ICACHE_FLASH_ATTR wifiHandleEventCb(System_Event_t *evt) {
     wifiState = wifiIsDisconnected;
     wifiReason = evt->event_info.disconnected.reason;
     DBG("Wifi disconnected from ssid %s, reason %s (%d)\n",
-      evt->event_info.disconnected.ssid, wifiGetReason(), evt->event_info.disconnected.reason);
+      evt->event_info.disconnected.ssid, wifiGetReason(wifiReason), evt->event_info.disconnected.reason);
 #ifdef CGI_ADVANCED
     statusWifiUpdate(wifiState);
 #endif
@@ -373,15 +373,12 @@ int ICACHE_FLASH_ATTR cgiWiFiConnect(HttpdConnData *connData) {
         httpdSend(connData, "Can't associate to an AP en SoftAP mode", -1);
         return HTTPD_CGI_DONE;
     }
-  char essid[128];
-  char passwd[128];
-
   if (connData->conn==NULL) return HTTPD_CGI_DONE;
 
-  int el = httpdFindArg(connData->getArgs, "essid", essid, sizeof(essid));
-  int pl = httpdFindArg(connData->getArgs, "passwd", passwd, sizeof(passwd));
+  char *essid = httpdGetArg(connData, "essid", NULL);
+  char *passwd = httpdGetArg(connData, "passwd", NULL);
 
-  if (el > 0 && pl >= 0) {
+  if (essid != NULL && *essid != 0 && passwd != NULL) {
     //Set to 0 if you want to disable the actual reconnecting bit
     os_strncpy((char*)stconf.ssid, essid, 32);
     os_strncpy((char*)stconf.password, passwd, 64);
@@ -464,20 +461,15 @@ void ICACHE_FLASH_ATTR configWifiIP() {
 
 // Change special settings
 int ICACHE_FLASH_ATTR cgiWiFiSpecial(HttpdConnData *connData) {
-  char dhcp[8];
-  char staticip[20];
-  char netmask[20];
-  char gateway[20];
-
   if (connData->conn==NULL) return HTTPD_CGI_DONE;
 
-  // get args and their string lengths
-  int dl = httpdFindArg(connData->getArgs, "dhcp", dhcp, sizeof(dhcp));
-  int sl = httpdFindArg(connData->getArgs, "staticip", staticip, sizeof(staticip));
-  int nl = httpdFindArg(connData->getArgs, "netmask", netmask, sizeof(netmask));
-  int gl = httpdFindArg(connData->getArgs, "gateway", gateway, sizeof(gateway));
+  // get args, they are decoded in place in the request, parse_ip may modify them
+  char *dhcp = httpdGetArg(connData, "dhcp", NULL);
+  char *staticip = httpdGetArg(connData, "staticip", NULL);
+  char *netmask = httpdGetArg(connData, "netmask", NULL);
+  char *gateway = httpdGetArg(connData, "gateway", NULL);
 
-  if (!(dl > 0 && sl >= 0 && nl >= 0 && gl >= 0)) {
+  if (dhcp == NULL || *dhcp == 0 || staticip == NULL || netmask == NULL || gateway == NULL) {
     jsonHeader(connData, 400);
     httpdSend(connData, "Request is missing fields", -1);
     return HTTPD_CGI_DONE;
@@ -488,9 +480,9 @@ int ICACHE_FLASH_ATTR cgiWiFiSpecial(HttpdConnData *connData) {
     // parse static IP params
     struct ip_info ipi;
     bool ok = parse_ip(staticip, &ipi.ip);
-    if (nl > 0) ok = ok && parse_ip(netmask, &ipi.netmask);
+    if (*netmask != 0) ok = ok && parse_ip(netmask, &ipi.netmask);
     else IP4_ADDR(&ipi.netmask, 255, 255, 255, 0);
-    if (gl > 0) ok = ok && parse_ip(gateway, &ipi.gw);
+    if (*gateway != 0) ok = ok && parse_ip(gateway, &ipi.gw);
     else ipi.gw.addr = 0;
     if (!ok) {
       jsonHeader(connData, 400);
@@ -536,20 +528,20 @@ int ICACHE_FLASH_ATTR cgiApSettingsChange(HttpdConnData *connData) {
         return HTTPD_CGI_DONE;
     }
 
-    char buff[96];
+    char *buff;
     int len;
 
     // Check extra security measure, this must be 1
-    len=httpdFindArg(connData->getArgs, "100", buff, sizeof(buff));
-    if(len>0){
+    buff=httpdGetArg(connData, "100", &len);
+    if(buff!=NULL && len>0){
         if(atoi(buff)!=1){
             jsonHeader(connData, 400);
             return HTTPD_CGI_DONE;
         }
     }
     // Set new SSID
-    len=httpdFindArg(connData->getArgs, "ap_ssid", buff, sizeof(buff));
-    if(checkString(buff) && len>7 && len<32){
+    buff=httpdGetArg(connData, "ap_ssid", &len);
+    if(buff!=NULL && checkString(buff) && len>7 && len<32){
         // STRING PREPROCESSING DONE IN CLIENT SIDE
         os_memset(apconf.ssid, 0, 32);
         os_memcpy(apconf.ssid, buff, len);
@@ -560,8 +552,9 @@ int ICACHE_FLASH_ATTR cgiApSettingsChange(HttpdConnData *connData) {
         return HTTPD_CGI_DONE;
     }
     // Set new PASSWORD
-    len=httpdFindArg(connData->getArgs, "ap_password", buff, sizeof(buff));
-    if(checkString(buff) && len>7 && len<64){
+    buff=httpdGetArg(connData, "ap_password", &len);
+    if(buff==NULL) len=-1;
+    if(buff!=NULL && checkString(buff) && len>7 && len<64){
         // String preprocessing done in client side, wifiap.js line 31
         os_memset(apconf.password, 0, 64);
         os_memcpy(apconf.password, buff, len);
@@ -575,8 +568,8 @@ int ICACHE_FLASH_ATTR cgiApSettingsChange(HttpdConnData *connData) {
     // Set auth mode
     if(len != 0){
         // Set authentication mode, before password to check open settings
-        len=httpdFindArg(connData->getArgs, "ap_authmode", buff, sizeof(buff));
-        if(len>0){
+        buff=httpdGetArg(connData, "ap_authmode", &len);
+        if(buff!=NULL && len>0){
             int value = atoi(buff);
             if(value >= 0  && value <= 4){
                 apconf.authmode = value;
@@ -592,8 +585,8 @@ int ICACHE_FLASH_ATTR cgiApSettingsChange(HttpdConnData *connData) {
         apconf.authmode = 0;
     }
     // Set max connection number
-    len=httpdFindArg(connData->getArgs, "ap_maxconn", buff, sizeof(buff));
-    if(len>0){
+    buff=httpdGetArg(connData, "ap_maxconn", &len);
+    if(buff!=NULL && len>0){
 
         int value = atoi(buff);
         if(value > 0 && value <= 4){
@@ -604,8 +597,8 @@ int ICACHE_FLASH_ATTR cgiApSettingsChange(HttpdConnData *connData) {
         }
     }
     // Set beacon interval value
-    len=httpdFindArg(connData->getArgs, "ap_beacon", buff, sizeof(buff));
-    if(len>0){
+    buff=httpdGetArg(connData, "ap_beacon", &len);
+    if(buff!=NULL && len>0){
         int value = atoi(buff);
         if(value >= 100 && value <= 60000){
             apconf.beacon_interval = value;
@@ -615,8 +608,8 @@ int ICACHE_FLASH_ATTR cgiApSettingsChange(HttpdConnData *connData) {
         }
     }
     // Set ssid to be hidden or not
-    len=httpdFindArg(connData->getArgs, "ap_hidden", buff, sizeof(buff));
-    if(len>0){
+    buff=httpdGetArg(connData, "ap_hidden", &len);
+    if(buff!=NULL && len>0){
         int value = atoi(buff);
         if(value == 0  || value == 1){
             apconf.ssid_hidden = value;
@@ -661,15 +654,13 @@ int ICACHE_FLASH_ATTR cgiApSettingsInfo(HttpdConnData *connData) {
 
 //This cgi changes the operating mode: STA / AP / STA+AP
 int ICACHE_FLASH_ATTR cgiWiFiSetMode(HttpdConnData *connData) {
-  int len;
-  char buff[1024];
   int previous_mode = wifi_get_opmode();
   if (connData->conn==NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
 
-  len=httpdFindArg(connData->getArgs, "mode", buff, sizeof(buff));
-    int next_mode = atoi(buff);
+  char *buff=httpdGetArg(connData, "mode", NULL);
+    int next_mode = buff != NULL ? atoi(buff) : 0;
 
-    if (len!=0) {
+    if (buff!=NULL && *buff!=0) {
         if (next_mode == 2){
             // moving to AP mode, so disconnect before leave STA mode
             wifi_station_disconnect();
@@ -702,10 +693,10 @@ static char *connStatuses[] = { "idle", "connecting", "wrong password", "AP not
                          "failed", "got IP address" };
 
 static char *wifiWarn[] = { 0,
-    "Switch to <a href=\\\"#\\\" onclick=\\\"changeWifiMode(3)\\\">STA+AP mode</a>",
-    "Switch to <a href=\\\"#\\\" onclick=\\\"changeWifiMode(3)\\\">STA+AP mode</a>",
-    "Switch to <a href=\\\"#\\\" onclick=\\\"changeWifiMode(1)\\\">STA mode</a>",
-    "Switch to <a href=\\\"#\\\" onclick=\\\"changeWifiMode(2)\\\">AP mode</a>",
+    "Switch to <a href=\"#\" onclick=\"changeWifiMode(3)\">STA+AP mode</a>",
+    "Switch to <a href=\"#\" onclick=\"changeWifiMode(3)\">STA+AP mode</a>",
+    "Switch to <a href=\"#\" onclick=\"changeWifiMode(1)\">STA mode</a>",
+    "Switch to <a href=\"#\" onclick=\"changeWifiMode(2)\">AP mode</a>",
 };
 
 static char *apAuthMode[] = { "OPEN",
@@ -721,9 +712,9 @@ static char *apAuthMode[] = { "OPEN",
 #define MODECHANGE "no"
 #endif
 
-// print various Wifi information into json buffer
-int ICACHE_FLASH_ATTR printWifiInfo(char *buff) {
-  int len;
+// write various Wifi information as members of the json object
+static void ICACHE_FLASH_ATTR printWifiInfo(JsonWriter *w) {
+    char buff[32];
     //struct station_config stconf;
     wifi_station_get_config(&stconf);
     //struct softap_config apconf;
@@ -748,41 +739,68 @@ int ICACHE_FLASH_ATTR printWifiInfo(char *buff) {
     wifi_get_macaddr(1, apmac_addr);
     uint8_t chan = wifi_get_channel();
 
-    len = os_sprintf(buff,
-                     "\"mode\": \"%s\", \"modechange\": \"%s\", \"ssid\": \"%s\", \"status\": \"%s\", \"phy\": \"%s\", "
-                     "\"rssi\": \"%ddB\", \"warn\": \"%s\",  \"apwarn\": \"%s\",\"mac\":\"%02x:%02x:%02x:%02x:%02x:%02x\", \"chan\":\"%d\", \"apssid\": \"%s\", "
-                     "\"appass\": \"%s\", \"apchan\": \"%d\", \"apmaxc\": \"%d\", \"aphidd\": \"%s\", \"apbeac\": \"%d\", \"apauth\": \"%s\",\"apmac\":\"%02x:%02x:%02x:%02x:%02x:%02x\"",
-                     mode, MODECHANGE, (char*)stconf.ssid, status, phy, rssi, warn, apwarn,
-                     mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5], chan, (char*)apconf.ssid,(char*)apconf.password,apconf.channel,apconf.max_connection,apconf.ssid_hidden?"enabled":"disabled",apconf.beacon_interval, apauth,apmac_addr[0], apmac_addr[1], apmac_addr[2], apmac_addr[3], apmac_addr[4], apmac_addr[5]);
+    jsonString(w, "mode", mode);
+    jsonString(w, "modechange", MODECHANGE);
+    jsonString(w, "ssid", (char*)stconf.ssid);
+    jsonString(w, "status", status);
+    jsonString(w, "phy", phy);
+    os_sprintf(buff, "%ddB", rssi);
+    jsonString(w, "rssi", buff);
+    jsonString(w, "warn", warn ? warn : "");
+    jsonString(w, "apwarn", apwarn ? apwarn : "");
+    os_sprintf(buff, MACSTR, MAC2STR(mac_addr));
+    jsonString(w, "mac", buff);
+    os_sprintf(buff, "%d", chan);
+    jsonString(w, "chan", buff);
+    jsonString(w, "apssid", (char*)apconf.ssid);
+    jsonString(w, "appass", (char*)apconf.password);
+    os_sprintf(buff, "%d", apconf.channel);
+    jsonString(w, "apchan", buff);
+    os_sprintf(buff, "%d", apconf.max_connection);
+    jsonString(w, "apmaxc", buff);
+    jsonString(w, "aphidd", apconf.ssid_hidden ? "enabled" : "disabled");
+    os_sprintf(buff, "%d", apconf.beacon_interval);
+    jsonString(w, "apbeac", buff);
+    jsonString(w, "apauth", apauth);
+    os_sprintf(buff, MACSTR, MAC2STR(apmac_addr));
+    jsonString(w, "apmac", buff);
 
     struct ip_info info;
     if (wifi_get_ip_info(0, &info)) {
-        len += os_sprintf(buff+len, ", \"ip\": \"%d.%d.%d.%d\"", IP2STR(&info.ip.addr));
-        len += os_sprintf(buff+len, ", \"netmask\": \"%d.%d.%d.%d\"", IP2STR(&info.netmask.addr));
-        len += os_sprintf(buff+len, ", \"gateway\": \"%d.%d.%d.%d\"", IP2STR(&info.gw.addr));
-        len += os_sprintf(buff+len, ", \"hostname\": \"%s\"", flashConfig.hostname);
+        os_sprintf(buff, IPSTR, IP2STR(&info.ip.addr));
+        jsonString(w, "ip", buff);
+        os_sprintf(buff, IPSTR, IP2STR(&info.netmask.addr));
+        jsonString(w, "netmask", buff);
+        os_sprintf(buff, IPSTR, IP2STR(&info.gw.addr));
+        jsonString(w, "gateway", buff);
+        jsonString(w, "hostname", flashConfig.hostname);
     } else {
-        len += os_sprintf(buff+len, ", \"ip\": \"-none-\"");
+        jsonString(w, "ip", "-none-");
     }
-    len += os_sprintf(buff+len, ", \"staticip\": \"%d.%d.%d.%d\"", IP2STR(&flashConfig.staticip));
-    len += os_sprintf(buff+len, ", \"dhcp\": \"%s\"", flashConfig.staticip > 0 ? "off" : "on");
-
-    return len;
+    os_sprintf(buff, IPSTR, IP2STR(&flashConfig.staticip));
+    jsonString(w, "staticip", buff);
+    jsonString(w, "dhcp", flashConfig.staticip > 0 ? "off" : "on");
 }
 
+// The json writer keeps the number of items sent so far in connData->cgiData, the output is
+// spread over several calls, if it doesn't fit into the send buffer
 int ICACHE_FLASH_ATTR cgiWiFiConnStatus(HttpdConnData *connData) {
-  char buff[1024];
-  int len;
+  JsonWriter w;
 
   if (connData->conn==NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
-  jsonHeader(connData, 200);
+  if (connData->cgiData == NULL) {
+    jsonHeader(connData, 200);
+    // the items have to be the same on every call, so the reason is taken from the first one
+    connData->cgiPrivData = (void *)(int)wifiReason;
+  }
+  uint8_t reason = (int)connData->cgiPrivData;
 
-  len = os_sprintf(buff, "{");
-  len += printWifiInfo(buff+len);
-  len += os_sprintf(buff+len, ", ");
+  jsonStart(&w, connData, (int)connData->cgiData);
+  jsonObjectOpen(&w, NULL);
+  printWifiInfo(&w);
 
-  if (wifiReason != 0) {
-    len += os_sprintf(buff+len, "\"reason\": \"%s\", ", wifiGetReason());
+  if (reason != 0) {
+    jsonString(&w, "reason", wifiGetReason(reason));
   }
 
 #if 0
@@ -799,25 +817,25 @@ int ICACHE_FLASH_ATTR cgiWiFiConnStatus(HttpdConnData *connData) {
   }
 #endif
 
-  len += os_sprintf(buff+len, "\"x\":0}\n");
-  //DBG("  -> %s\n", buff);
-  httpdSend(connData, buff, len);
-  return HTTPD_CGI_DONE;
+  jsonInt(&w, "x", 0);
+  jsonObjectClose(&w);
+  connData->cgiData = (void *)jsonEnd(&w);
+  return connData->cgiData ? HTTPD_CGI_MORE : HTTPD_CGI_DONE;
 }
 
 // Cgi to return various Wifi information
 int ICACHE_FLASH_ATTR cgiWifiInfo(HttpdConnData *connData) {
-  char buff[1024];
+  JsonWriter w;
 
   if (connData->conn==NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
-
-  os_strcpy(buff, "{");
-  printWifiInfo(buff+1);
-  os_strcat(buff, "}");
-
-  jsonHeader(connData, 200);
-  httpdSend(connData, buff, -1);
-  return HTTPD_CGI_DONE;
+  if (connData->cgiData == NULL) jsonHeader(connData, 200);
+
+  jsonStart(&w, connData, (int)connData->cgiData);
+  jsonObjectOpen(&w, NULL);
+  printWifiInfo(&w);
+  jsonObjectClose(&w);
+  connData->cgiData = (void *)jsonEnd(&w);
+  return connData->cgiData ? HTTPD_CGI_MORE : HTTPD_CGI_DONE;
 }
 
 // Check string againt invalid characters
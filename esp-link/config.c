@@ -44,6 +44,9 @@ FlashConfig flashDefault = {
     .artnet_subnet = 0,
     .artnet_universe = 0,
     .artnet_pwmstart = 1,
+    .artnet_failsafe = 0,
+    .artnet_failsafe_fade = 0,
+    .artnet_failsafe_timeout = 0,
 };
 
 typedef union {
@@ -145,7 +148,7 @@ bool ICACHE_FLASH_ATTR configRestore(void) {
   // if neither is OK, we revert to defaults
   if (flash_pri < 0) {
     os_memcpy(&flashConfig, &flashDefault, sizeof(FlashConfig));
-    char chipIdStr[6];
+    char chipIdStr[7];
     os_sprintf(chipIdStr, "%06x", system_get_chip_id());
 #ifdef CHIP_IN_HOSTNAME
     char hostname[16];
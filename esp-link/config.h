@@ -51,6 +51,10 @@ typedef struct {
   uint8_t  artnet_subnet;
   uint8_t  artnet_universe;
   uint16_t  artnet_pwmstart;
+  uint8_t  artnet_failsafe;            // data loss policy (FailsafeMode)
+  uint8_t  artnet_failsafe_fade;       // fade time (s) of the data loss policy
+  uint16_t artnet_failsafe_timeout;    // inter-frame timeout (ms), 0 for the default
+  uint8_t  artnet_scene[32];           // failsafe scene, starting at artnet_pwmstart
 } FlashConfig;
 extern FlashConfig flashConfig;
 
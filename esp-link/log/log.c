@@ -83,49 +83,100 @@ log_write_char(char c) {
   log_write(c);
 }
 
+// state of an ajaxLog response, which is spread over several calls
+typedef struct {
+  int start; // log position of the first char of the text
+  int end;   // log position after the last char of the text
+  int done;  // state of the json writer between the calls (see jsonEnd)
+} LogResponse;
+
+// write the log text between the log positions start and end as a string value, the text is
+// passed in the same pieces on every call (see jsonStringAppend), text, which has been dropped
+// from the buffer meanwhile, is replaced by what has been written into its place
+static void ICACHE_FLASH_ATTR
+logText(JsonWriter *w, int start, int end) {
+  int rd = ((log_rd + start - log_pos) % BUF_MAX + BUF_MAX) % BUF_MAX;
+  int len = end - start;
+  jsonStringOpen(w, "text");
+  if (rd + len > BUF_MAX) {
+    jsonStringAppend(w, log_buf+rd, BUF_MAX-rd);
+    len -= BUF_MAX-rd;
+    rd = 0;
+  }
+  jsonStringAppend(w, log_buf+rd, len);
+  jsonStringClose(w);
+}
+
 int ICACHE_FLASH_ATTR
 ajaxLog(HttpdConnData *connData) {
-  char buff[2048];
-  int len; // length of text in buff
-  int log_len = (log_wr+BUF_MAX-log_rd) % BUF_MAX; // num chars in log_buf
-  int start = 0; // offset onto log_wr to start sending out chars
+  LogResponse *resp = connData->cgiData;
+  JsonWriter w;
 
-  if (connData->conn==NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
-  jsonHeader(connData, 200);
-
-  // figure out where to start in buffer based on URI param
-  len = httpdFindArg(connData->getArgs, "start", buff, sizeof(buff));
-  if (len > 0) {
-    start = atoi(buff);
-    if (start < log_pos) {
-      start = 0;
-    } else if (start >= log_pos+log_len) {
-      start = log_len;
-    } else {
-      start = start - log_pos;
+  if (connData->conn==NULL) { // Connection aborted. Clean up.
+    if (resp != NULL) os_free(resp);
+    return HTTPD_CGI_DONE;
+  }
+
+  if (resp == NULL) {
+    int log_len = (log_wr+BUF_MAX-log_rd) % BUF_MAX; // num chars in log_buf
+    resp = os_zalloc(sizeof(LogResponse));
+    if (resp == NULL) {
+      errorResponse(connData, 500, "Out of memory");
+      return HTTPD_CGI_DONE;
+    }
+    connData->cgiData = resp;
+    jsonHeader(connData, 200);
+
+    // figure out where to start in buffer based on URI param, the end of the text is the
+    // end of the log now, so the response doesn't grow while it is sent
+    resp->start = log_pos;
+    resp->end = log_pos + log_len;
+    char *arg = httpdGetArg(connData, "start", NULL);
+    if (arg != NULL && *arg != 0) {
+      int start = atoi(arg);
+      if (start >= resp->end) {
+        resp->start = resp->end;
+      } else if (start > log_pos) {
+        resp->start = start;
+      }
     }
   }
 
-  // start outputting
-  len = os_sprintf(buff, "{\"len\":%d, \"start\":%d, \"text\": \"",
-      log_len-start, log_pos+start);
+  jsonStart(&w, connData, resp->done);
+  jsonObjectOpen(&w, NULL);
+  jsonInt(&w, "len", resp->end - resp->start);
+  jsonInt(&w, "start", resp->start);
+  logText(&w, resp->start, resp->end);
+  jsonObjectClose(&w);
+  resp->done = jsonEnd(&w);
+  if (resp->done > 0) return HTTPD_CGI_MORE;
+
+  os_free(resp);
+  connData->cgiData = NULL;
+  return HTTPD_CGI_DONE;
+}
 
+// copy the log text from the position *pos on into buff (see "start" of ajaxLog), text that has
+// been dropped from the buffer already is skipped. Returns the length and advances *pos.
+int ICACHE_FLASH_ATTR
+logRead(int *pos, char *buff, int len) {
+  int log_len = (log_wr+BUF_MAX-log_rd) % BUF_MAX; // num chars in log_buf
+  int start = *pos - log_pos;
+  if (start < 0 || start > log_len) start = 0;
+  int n = 0;
   int rd = (log_rd+start) % BUF_MAX;
-  while (len < 2040 && rd != log_wr) {
-    uint8_t c = log_buf[rd];
-    if (c == '\\' || c == '"') {
-      buff[len++] = '\\';
-      buff[len++] = c;
-    } else if (c < ' ') {
-      len += os_sprintf(buff+len, "\\u%04x", c);
-    } else {
-      buff[len++] = c;
-    }
+  while (n < len && rd != log_wr) {
+    buff[n++] = log_buf[rd];
     rd = (rd + 1) % BUF_MAX;
   }
-  os_strcpy(buff+len, "\"}"); len+=2;
-  httpdSend(connData, buff, len);
-  return HTTPD_CGI_DONE;
+  *pos = log_pos + start + n;
+  return n;
+}
+
+// Server-Sent Events stream of the log text, see cgiTextStream
+int ICACHE_FLASH_ATTR
+ajaxLogStream(HttpdConnData *connData) {
+  return cgiTextStream(connData, logRead);
 }
 
 static const char* const dbg_mode[] = { "auto", "off", "on0", "on1" };
@@ -134,11 +185,11 @@ int ICACHE_FLASH_ATTR
 ajaxLogDbg(HttpdConnData *connData) {
   if (connData->conn==NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
   char buff[512];
-  int len, status = 400;
-  len = httpdFindArg(connData->getArgs, "mode", buff, sizeof(buff));
-  if (len > 0) {
+  int status = 400;
+  char *arg = httpdGetArg(connData, "mode", NULL);
+  if (arg != NULL && *arg != 0) {
 	for (uint8 mode=0; mode<sizeof(dbg_mode)/sizeof(dbg_mode[0]); mode++) {
-		if (os_strcmp(buff, dbg_mode[mode]) == 0) {
+		if (os_strcmp(arg, dbg_mode[mode]) == 0) {
 			flashConfig.log_mode = mode;
 			if (mode != LOG_MODE_AUTO) log_uart(mode >= LOG_MODE_ON0);
 			status = configSave() ? 200 : 400;
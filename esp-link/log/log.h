@@ -12,6 +12,8 @@ void logInit(void);
 void log_uart(bool enable);
 int ajaxLog(HttpdConnData *connData);
 int ajaxLogDbg(HttpdConnData *connData);
+int ajaxLogStream(HttpdConnData *connData);
+int logRead(int *pos, char *buff, int len);
 
 void dumpMem(void *addr, int len);
 
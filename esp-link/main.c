@@ -22,6 +22,7 @@
 #include "config.h"
 #include "gpio.h"
 #include "stringdefs.h"
+#include "stack.h"
 
 #ifdef LOG
 #include "log.h"
@@ -35,6 +36,10 @@
 #include "console.h"
 #endif
 
+#ifdef WEBSOCKET
+#include "cgiws.h"
+#endif
+
 #ifdef SERIAL_BRIDGE
 #include "serbridge.h"
 #include "serled.h"
@@ -55,9 +60,7 @@
 #include "artnet.h"
 #include "cgiartnet.h"
 #endif
-#ifdef PWMOUT
-#include "pwm.h"
-#endif
+#include "output.h"
 #ifdef HEATER
 #include "heater.h"
 #endif
@@ -103,12 +106,17 @@ HttpdBuiltInUrl builtInUrls[] = {
 #ifdef LOG
   { "/log/text", ajaxLog, NULL },
   { "/log/dbg", ajaxLogDbg, NULL },
+  { "/log/stream", ajaxLogStream, NULL },
 #endif
 #ifdef CONSOLE
   { "/console/reset", ajaxConsoleReset, NULL },
   { "/console/baud", ajaxConsoleBaud, NULL },
   { "/console/text", ajaxConsole, NULL },
   { "/console/send", ajaxConsoleSend, NULL },
+  { "/console/stream", ajaxConsoleStream, NULL },
+#endif
+#ifdef WEBSOCKET
+  { "/ws", cgiWebSocket, NULL },
 #endif
   //Enable the line below to protect the WiFi configuration with an username/password combo.
   //    {"/wifi/*", authBasic, myPassFn},
@@ -135,7 +143,8 @@ HttpdBuiltInUrl builtInUrls[] = {
 #ifdef SHOW_HEAP_USE
 static ETSTimer prHeapTimer;
 static void ICACHE_FLASH_ATTR prHeapTimerCb(void *arg) {
-  os_printf("Heap: %ld\n", (unsigned long)system_get_free_heap_size());
+  os_printf("Heap: %ld, max stack: %ld\n", (unsigned long)system_get_free_heap_size(),
+      (unsigned long)stackHighWater());
 }
 #endif
 
@@ -164,6 +173,8 @@ void user_init(void) {
 #ifdef DEBUG
     const uint32 time = system_get_time();
 #endif
+  // mark the unused stack for the high water mark report
+  stackPaint();
 
   // get the flash config so we know how to init things
   //configWipe(); // uncomment to reset the config for testing purposes
@@ -237,10 +248,7 @@ void user_init(void) {
   cgiServicesSNTPInit();
 #endif
 
-#ifdef PWMOUT
-  uint8_t duty[] = {0, 0, 0};
-  pwm_init(100, duty);
-#endif
+  output_init();
 
 #ifdef MQTT
   NOTICE("initializing MQTT");
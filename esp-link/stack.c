@@ -0,0 +1,26 @@
+// Stack usage measurement: the unused part of the system stack is filled with a pattern
+// at boot, the deepest overwritten word marks the maximum stack depth so far.
+
+#include <esp8266.h>
+#include "stack.h"
+
+// The system stack grows down from the end of the dram, the SDK reserves 8KB for it.
+#define STACK_TOP     0x40000000
+#define STACK_BOTTOM  0x3FFFE000
+#define STACK_PATTERN 0xA5A5A5A5
+// Bytes below the current stack pointer, which are left untouched while painting
+#define STACK_MARGIN  256
+
+// Fill the stack below the caller with the pattern. Has to be called early in user_init.
+void ICACHE_FLASH_ATTR stackPaint(void) {
+  uint32_t marker;
+  uint32_t *end = (uint32_t *)(((uint32_t)&marker - STACK_MARGIN) & ~3);
+  for (uint32_t *p = (uint32_t *)STACK_BOTTOM; p < end; p++) *p = STACK_PATTERN;
+}
+
+// Returns the maximum amount of stack bytes used since stackPaint.
+uint32_t ICACHE_FLASH_ATTR stackHighWater(void) {
+  uint32_t *p = (uint32_t *)STACK_BOTTOM;
+  while (p < (uint32_t *)STACK_TOP && *p == STACK_PATTERN) p++;
+  return STACK_TOP - (uint32_t)p;
+}
@@ -0,0 +1,7 @@
+#ifndef STACK_H
+#define STACK_H
+
+void stackPaint(void);
+uint32_t stackHighWater(void);
+
+#endif // STACK_H
@@ -0,0 +1,168 @@
+// WebSocket for live control of the outputs and pushing the log and the console.
+// The received slots are applied right away, new log and console data and changed
+// outputs are pushed after each sent frame and by a short timer, which runs while
+// WebSockets are open.
+
+#include <esp8266.h>
+#include "cgi.h"
+#include "output.h"
+#include "cgiws.h"
+#include "espfsformat.h"
+#ifdef LOG
+#include "log.h"
+#endif
+#ifdef CONSOLE
+#include "console.h"
+#endif
+
+#ifdef CGIWS_DBG
+#define DBG(format, ...) do { os_printf(format, ## __VA_ARGS__); } while(0)
+#else
+#define DBG(format, ...) do { } while(0)
+#endif
+
+// interval of checking for new data to push (ms)
+#define WS_POLL_MS 50
+// max amount of log or console bytes per frame
+#define WS_MAX_TEXT 512
+
+// state of a WebSocket connection (connData->cgiData)
+typedef struct {
+  int logPos;              // next log position to send
+  int consolePos;          // next console position to send
+  uint32 outputHash;       // hash of the output state being sent or last sent
+  uint16_t outputNext;     // next slot of that state to send, 0 if none is being sent
+  bool outputSent;         // all slots of outputHash have been sent
+} WsState;
+
+static ETSTimer wsTimer;
+static bool wsTimerArmed;
+
+// FNV-1a hash of all output slots, to notice changes without keeping a copy
+static uint32 ICACHE_FLASH_ATTR wsOutputHash(void) {
+  uint32 hash = FNV1A_INIT;
+  for (uint16_t i = 0; i < output_channels(); i++) hash = fnv1aByte(hash, output_getSlot(i));
+  return hash;
+}
+
+// push the output state, in several frames from their start slot on, if it doesn't fit into
+// the send buffer. The rest follows with the next calls.
+static void ICACHE_FLASH_ATTR wsPushOutput(HttpdConnData *connData, WsState *state) {
+  if (state->outputNext == 0) {
+    uint32 hash = wsOutputHash();
+    if (state->outputSent && hash == state->outputHash) return;
+    state->outputHash = hash;
+    state->outputSent = false;
+  }
+
+  uint16_t channels = output_channels();
+  while (state->outputNext < channels) {
+    int space;
+    char *buff = httpdWsFrameBuffer(connData, &space);
+    if (buff == NULL || space <= 3) return;
+    int n = channels - state->outputNext;
+    if (n > space - 3) n = space - 3;
+    buff[0] = WS_MSG_OUTPUT;
+    buff[1] = state->outputNext >> 8;
+    buff[2] = state->outputNext;
+    for (int i = 0; i < n; i++) buff[3 + i] = output_getSlot(state->outputNext + i);
+    httpdWsFrameCommit(connData, WS_OPCODE_BINARY, 3 + n);
+    state->outputNext += n;
+  }
+  state->outputNext = 0;
+  state->outputSent = true;
+}
+
+#if defined(LOG) || defined(CONSOLE)
+// push the bytes following *pos of a ring buffer read by readFn (logRead or consoleRead)
+static void ICACHE_FLASH_ATTR wsPushText(HttpdConnData *connData, uint8_t type, int *pos,
+    int (*readFn)(int *pos, char *buff, int len)) {
+  int space;
+  char *buff = httpdWsFrameBuffer(connData, &space);
+  if (buff == NULL || space <= 5) return;
+  if (space > 5 + WS_MAX_TEXT) space = 5 + WS_MAX_TEXT;
+
+  int len = readFn(pos, buff + 5, space - 5);
+  if (len == 0) return;
+  // data dropped from the ring buffer is skipped, so the start is known after reading only
+  int start = *pos - len;
+  buff[0] = type;
+  buff[1] = start >> 24;
+  buff[2] = start >> 16;
+  buff[3] = start >> 8;
+  buff[4] = start;
+  httpdWsFrameCommit(connData, WS_OPCODE_BINARY, 5 + len);
+}
+#endif
+
+// received message of the browser
+static void ICACHE_FLASH_ATTR wsRecv(HttpdConnData *connData, int opcode, char *data, int len) {
+  WsState *state = connData->cgiData;
+  const uint8_t *msg = (const uint8_t *)data;
+  if (state == NULL || opcode != WS_OPCODE_BINARY || len < 1) return;
+
+  switch (msg[0]) {
+  case WS_MSG_SET_SLOTS: {
+    if (len < 3) return;
+    uint16_t slot = (msg[1] << 8) | msg[2];
+    output_beginFrame();
+    for (int i = 3; i < len; i++) output_setSlot(slot++, msg[i]);
+    output_commit();
+    break;
+  }
+  case WS_MSG_GET_OUTPUT:
+    state->outputSent = false;
+    break;
+  default:
+    DBG("WS: unknown message 0x%02x\n", msg[0]);
+    break;
+  }
+}
+
+// the cgi is only called after a sent callback, so idle connections are checked for new data
+// by a timer, which runs while WebSockets are open
+static void ICACHE_FLASH_ATTR wsTimerCb(void *arg) {
+  if (httpdWsPoll(cgiWebSocket) == 0) {
+    os_timer_disarm(&wsTimer);
+    wsTimerArmed = false;
+  }
+}
+
+int ICACHE_FLASH_ATTR cgiWebSocket(HttpdConnData *connData) {
+  WsState *state = connData->cgiData;
+  if (connData->conn == NULL) {
+    // Connection aborted. Clean up.
+    if (state != NULL) os_free(state);
+    connData->cgiData = NULL;
+    return HTTPD_CGI_DONE;
+  }
+
+  if (state == NULL) {
+    if (!httpdWsUpgrade(connData, wsRecv)) {
+      errorResponse(connData, 400, "WebSocket handshake expected, or too many WebSockets open");
+      return HTTPD_CGI_DONE;
+    }
+    state = (WsState *)os_zalloc(sizeof(WsState));
+    if (state == NULL) return HTTPD_CGI_DONE; // closes the connection
+    connData->cgiData = state;
+    DBG("WS: connected\n");
+    if (!wsTimerArmed) {
+      os_timer_disarm(&wsTimer);
+      os_timer_setfn(&wsTimer, wsTimerCb, NULL);
+      os_timer_arm(&wsTimer, WS_POLL_MS, 1);
+      wsTimerArmed = true;
+    }
+    // the first push follows the sent callback of the handshake response
+    return HTTPD_CGI_MORE;
+  }
+
+  wsPushOutput(connData, state);
+#ifdef LOG
+  wsPushText(connData, WS_MSG_LOG, &state->logPos, logRead);
+#endif
+#ifdef CONSOLE
+  wsPushText(connData, WS_MSG_CONSOLE, &state->consolePos, consoleRead);
+#endif
+  return HTTPD_CGI_MORE;
+}
+
@@ -0,0 +1,24 @@
+#ifndef CGIWS_H
+#define CGIWS_H
+
+#include "httpd.h"
+
+// Binary messages of the WebSocket at /ws. Multi-byte values are big endian.
+//
+// browser -> esp-link:
+//   WS_MSG_SET_SLOTS  slot(2) value(1)...   set consecutive output slots, starting at slot
+//   WS_MSG_GET_OUTPUT                       request the output state, even if unchanged
+//
+// esp-link -> browser:
+//   WS_MSG_OUTPUT     slot(2) value(1)...   output slots, sent whenever they change
+//   WS_MSG_LOG        pos(4) text...        log text starting at pos (see /log/text)
+//   WS_MSG_CONSOLE    pos(4) bytes...       console bytes starting at pos (see /console/text)
+#define WS_MSG_SET_SLOTS  0x01
+#define WS_MSG_GET_OUTPUT 0x02
+#define WS_MSG_OUTPUT     0x81
+#define WS_MSG_LOG        0x82
+#define WS_MSG_CONSOLE    0x83
+
+int cgiWebSocket(HttpdConnData *connData);
+
+#endif // CGIWS_H
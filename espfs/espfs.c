@@ -21,6 +21,7 @@ It's written for use with httpd, but doesn't need to be used as such.
 #ifdef __ets__
 //esp build
 #include <esp8266.h>
+#include <stdint.h>
 #else
 //Test build
 #include <stdio.h>
@@ -33,12 +34,26 @@ It's written for use with httpd, but doesn't need to be used as such.
 #define os_strncmp strncmp
 #define os_strcmp strcmp
 #define os_strcpy strcpy
+#define os_strlen strlen
+#define os_memcmp memcmp
 #define os_printf printf
 #define ICACHE_FLASH_ATTR
 #endif
 
 #include "espfsformat.h"
 #include "espfs.h"
+#include "heatshrink.h"
+
+//Compressed bytes read from flash at once for the heatshrink decoder
+#define HEATSHRINK_INPUT_LEN 32
+
+//decompData of heatshrink compressed files
+typedef struct {
+	HeatshrinkDecoder *dec;
+	uint8_t input[HEATSHRINK_INPUT_LEN];
+	int inputPos;
+	int inputLen;
+} EspFsHeatshrink;
 
 static char* espFsData = NULL;
 
@@ -80,7 +95,7 @@ bool ICACHE_FLASH_ATTR espFsIsImage(const void* const flashAddress) {
 
 EspFsInitResult ICACHE_FLASH_ATTR espFsInit(void *flashAddress) {
 	// base address must be aligned to 4 bytes
-	if (((int)flashAddress & 3) != 0) {
+	if (((uintptr_t)flashAddress & 3) != 0) {
 		return ESPFS_INIT_RESULT_BAD_ALIGN;
 	}
 
@@ -93,27 +108,43 @@ EspFsInitResult ICACHE_FLASH_ATTR espFsInit(void *flashAddress) {
 	return ESPFS_INIT_RESULT_OK;
 }
 
-//Copies len bytes over from dst to src, but does it using *only*
-//aligned 32-bit reads. Yes, it's no too optimized but it's short and sweet and it works.
-
-//ToDo: perhaps os_memcpy also does unaligned accesses?
-#ifdef __ets__
+//Copies len bytes over from src to dst, but does it using *only* aligned 32-bit reads of src.
+//The unaligned head and tail bytes are shifted out of one word each, the rest is copied
+//word by word (with 32-bit stores, if dst is aligned too).
+//This is used on the host too, so the espfsbench tool measures the same code.
 void ICACHE_FLASH_ATTR memcpyAligned(char *dst, char *src, int len) {
-	int x;
-	int w, b;
-	for (x=0; x<len; x++) {
-		b=((int)src&3);
-		w=*((int *)(src-b));
-		if (b==0) *dst=(w>>0);
-		if (b==1) *dst=(w>>8);
-		if (b==2) *dst=(w>>16);
-		if (b==3) *dst=(w>>24);
-		dst++; src++;
+	uint32_t w;
+	int b=((size_t)src&3);
+	if (len<=0) return;
+	if (b!=0) {
+		w=*((uint32_t *)(src-b))>>(8*b);
+		while (b<4 && len>0) {
+			*dst++=w;
+			w>>=8;
+			src++; b++; len--;
+		}
+	}
+	if (((size_t)dst&3)==0) {
+		uint32_t *d=(uint32_t *)dst;
+		uint32_t *s=(uint32_t *)src;
+		for (; len>=4; len-=4) *d++=*s++;
+		dst=(char *)d;
+		src=(char *)s;
+	} else {
+		for (; len>=4; len-=4) {
+			w=*((uint32_t *)src);
+			dst[0]=w; dst[1]=w>>8; dst[2]=w>>16; dst[3]=w>>24;
+			dst+=4; src+=4;
+		}
+	}
+	if (len>0) {
+		w=*((uint32_t *)src);
+		while (len-->0) {
+			*dst++=w;
+			w>>=8;
+		}
 	}
 }
-#else
-#define memcpyAligned memcpy
-#endif
 
 // Returns flags of opened file.
 int ICACHE_FLASH_ATTR espFsFlags(EspFsFile *fh) {
@@ -129,6 +160,74 @@ int ICACHE_FLASH_ATTR espFsFlags(EspFsFile *fh) {
 	return (int)flags;
 }
 
+//Allocate the file desc struct for the file header at hpos.
+static EspFsFile ICACHE_FLASH_ATTR *espFsOpenAt(char *hpos, EspFsHeader *h) {
+	EspFsFile *r;
+	if (h->compression!=COMPRESS_NONE && h->compression!=COMPRESS_HEATSHRINK) {
+#ifdef ESPFS_DBG
+		os_printf("Invalid compression: %d\n", h->compression);
+#endif
+		return NULL;
+	}
+	r=(EspFsFile *)os_malloc(sizeof(EspFsFile)); //Alloc file desc mem
+	//os_printf("Alloc %p[%d]\n", r, sizeof(EspFsFile));
+	if (r==NULL) return NULL;
+	r->header=(EspFsHeader *)hpos;
+	r->decompressor=h->compression;
+	r->posComp=hpos+sizeof(EspFsHeader)+h->nameLen; //Skip to content.
+	r->posStart=r->posComp;
+	r->posDecomp=0;
+	r->decompData=NULL;
+	if (h->compression==COMPRESS_HEATSHRINK) {
+		//Decoder params are stored in the 1st byte: window bits << 4 | lookahead bits.
+		uint8_t parm;
+		EspFsHeatshrink *hs=(EspFsHeatshrink *)os_malloc(sizeof(EspFsHeatshrink));
+		memcpyAligned((char*)&parm, r->posComp, 1);
+		r->posComp++;
+		if (hs!=NULL) hs->dec=heatshrinkDecoderAlloc(parm>>4, parm&0xf);
+		if (hs==NULL || hs->dec==NULL) {
+#ifdef ESPFS_DBG
+			os_printf("Heatshrink decoder alloc failed, params %x\n", parm);
+#endif
+			if (hs!=NULL) os_free(hs);
+			os_free(r);
+			return NULL;
+		}
+		hs->inputPos=0;
+		hs->inputLen=0;
+		r->decompData=hs;
+	}
+	return r;
+}
+
+//Look the file up in the index of the image. Only the index entries with a matching
+//name hash and their file names are read from flash.
+static EspFsFile ICACHE_FLASH_ATTR *espFsOpenIndexed(char *fileName, EspFsHeader *indexHeader) {
+	char *p=espFsData+sizeof(EspFsHeader)+indexHeader->nameLen;
+	int32_t count=*(int32_t *)p;
+	EspFsIndexEntry *entries=(EspFsIndexEntry *)(p+sizeof(EspFsIndex));
+	uint32_t hash=espFsNameHash(fileName);
+	int nameLen=os_strlen(fileName)+1;
+	char namebuf[256];
+	EspFsHeader h;
+	int lo=0, hi=count;
+
+	if (nameLen>sizeof(namebuf)) return NULL;
+	//find the first entry with the hash. All values are aligned words, so they can be read directly.
+	while (lo<hi) {
+		int mid=(lo+hi)/2;
+		if (entries[mid].nameHash<hash) lo=mid+1; else hi=mid;
+	}
+	for (; lo<count && entries[lo].nameHash==hash; lo++) {
+		char *hpos=espFsData+entries[lo].offset;
+		os_memcpy(&h, hpos, sizeof(EspFsHeader));
+		if (h.nameLen<nameLen) continue;
+		memcpyAligned(namebuf, hpos+sizeof(EspFsHeader), nameLen);
+		if (os_memcmp(namebuf, fileName, nameLen)==0) return espFsOpenAt(hpos, &h);
+	}
+	return NULL;
+}
+
 //Open a file and return a pointer to the file desc struct.
 EspFsFile ICACHE_FLASH_ATTR *espFsOpen(char *fileName) {
 	if (espFsData == NULL) {
@@ -141,9 +240,11 @@ EspFsFile ICACHE_FLASH_ATTR *espFsOpen(char *fileName) {
 	char *hpos;
 	char namebuf[256];
 	EspFsHeader h;
-	EspFsFile *r;
 	//Strip initial slashes
 	while(fileName[0]=='/') fileName++;
+	//Images with an index don't need to be searched
+	os_memcpy(&h, p, sizeof(EspFsHeader));
+	if (h.flags&FLAG_INDEX) return espFsOpenIndexed(fileName, &h);
 	//Go find that file!
 	while(1) {
 		hpos=p;
@@ -166,31 +267,59 @@ EspFsFile ICACHE_FLASH_ATTR *espFsOpen(char *fileName) {
 //				namebuf, (unsigned int)h.nameLen, (unsigned int)h.fileLenComp, h.compression, h.flags);
 		if (os_strcmp(namebuf, fileName)==0) {
 			//Yay, this is the file we need!
-			p+=h.nameLen; //Skip to content.
-			r=(EspFsFile *)os_malloc(sizeof(EspFsFile)); //Alloc file desc mem
-			//os_printf("Alloc %p[%d]\n", r, sizeof(EspFsFile));
-			if (r==NULL) return NULL;
-			r->header=(EspFsHeader *)hpos;
-			r->decompressor=h.compression;
-			r->posComp=p;
-			r->posStart=p;
-			r->posDecomp=0;
-			if (h.compression==COMPRESS_NONE) {
-				r->decompData=NULL;
-			} else {
-#ifdef ESPFS_DBG
-				os_printf("Invalid compression: %d\n", h.compression);
-#endif
-				return NULL;
-			}
-			return r;
+			return espFsOpenAt(hpos, &h);
 		}
 		//We don't need this file. Skip name and file
 		p+=h.nameLen+h.fileLenComp;
-		if ((int)p&3) p+=4-((int)p&3); //align to next 32bit val
+		if ((uintptr_t)p&3) p+=4-((uintptr_t)p&3); //align to next 32bit val
 	}
 }
 
+//Copies the hash of the stored file data into hash (ESPFS_HASH_LEN bytes).
+//Returns false, if the image has been built without hashes.
+bool ICACHE_FLASH_ATTR espFsHash(EspFsFile *fh, uint8_t *hash) {
+	int8_t flags;
+	int16_t nameLen;
+	if (fh==NULL) return false;
+	memcpyAligned((char*)&flags, (char*)&fh->header->flags, 1);
+	if (!(flags&FLAG_HASH)) return false;
+	memcpyAligned((char*)&nameLen, (char*)&fh->header->nameLen, 2);
+	memcpyAligned((char*)hash, (char*)fh->header+sizeof(EspFsHeader)+nameLen-ESPFS_HASH_LEN, ESPFS_HASH_LEN);
+	return true;
+}
+
+//Copies the prebaked http response headers of the file into buff.
+//Returns their length or 0, if the image has none or they don't fit into len bytes.
+int ICACHE_FLASH_ATTR espFsHeaders(EspFsFile *fh, char *buff, int len) {
+	int8_t flags;
+	int16_t nameLen;
+	int32_t headersLen;
+	char *end;
+	if (fh==NULL || buff==NULL) return 0;
+	memcpyAligned((char*)&flags, (char*)&fh->header->flags, 1);
+	if ((flags&(FLAG_HASH|FLAG_HEADERS))!=(FLAG_HASH|FLAG_HEADERS)) return 0;
+	memcpyAligned((char*)&nameLen, (char*)&fh->header->nameLen, 2);
+	//the headers and their length are in front of the hash
+	end=(char*)fh->header+sizeof(EspFsHeader)+nameLen-ESPFS_HASH_LEN-4;
+	memcpyAligned((char*)&headersLen, end, 4);
+	if (headersLen>len) return 0;
+	memcpyAligned(buff, end-((headersLen+3)&~3), headersLen);
+	return headersLen;
+}
+
+//Returns the amount of bytes espFsRead will return for the file, or -1 for an invalid handle.
+//Files stored without espfs compression (including gzipped ones) are returned as stored.
+int ICACHE_FLASH_ATTR espFsSize(EspFsFile *fh) {
+	int len;
+	if (fh==NULL) return -1;
+	if (fh->decompressor==COMPRESS_NONE) {
+		memcpyAligned((char*)&len, (char*)&fh->header->fileLenComp, 4);
+	} else {
+		memcpyAligned((char*)&len, (char*)&fh->header->fileLenDecomp, 4);
+	}
+	return len;
+}
+
 //Read len bytes from the given file into buff. Returns the actual amount of bytes read.
 int ICACHE_FLASH_ATTR espFsRead(EspFsFile *fh, char *buff, int len) {
 	int flen, fdlen;
@@ -209,6 +338,27 @@ int ICACHE_FLASH_ATTR espFsRead(EspFsFile *fh, char *buff, int len) {
 		fh->posComp+=len;
 //		os_printf("Done reading %d bytes, pos=%x\n", len, fh->posComp);
 		return len;
+	} else if (fh->decompressor==COMPRESS_HEATSHRINK) {
+		EspFsHeatshrink *hs=(EspFsHeatshrink *)fh->decompData;
+		int decoded=0, used;
+		if (len>fdlen-fh->posDecomp) len=fdlen-fh->posDecomp;
+		while (decoded<len) {
+			if (hs->inputPos==hs->inputLen) {
+				//Refill the input from flash
+				int toRead=flen-(fh->posComp-fh->posStart);
+				if (toRead<=0) break; //Broken image, the data ended early
+				if (toRead>HEATSHRINK_INPUT_LEN) toRead=HEATSHRINK_INPUT_LEN;
+				memcpyAligned((char*)hs->input, fh->posComp, toRead);
+				fh->posComp+=toRead;
+				hs->inputPos=0;
+				hs->inputLen=toRead;
+			}
+			decoded+=heatshrinkDecode(hs->dec, hs->input+hs->inputPos, hs->inputLen-hs->inputPos, &used,
+					(uint8_t*)buff+decoded, len-decoded);
+			hs->inputPos+=used;
+		}
+		fh->posDecomp+=decoded;
+		return decoded;
 	}
 	return 0;
 }
@@ -216,6 +366,11 @@ int ICACHE_FLASH_ATTR espFsRead(EspFsFile *fh, char *buff, int len) {
 //Close the file.
 void ICACHE_FLASH_ATTR espFsClose(EspFsFile *fh) {
 	if (fh==NULL) return;
+	if (fh->decompressor==COMPRESS_HEATSHRINK && fh->decompData!=NULL) {
+		EspFsHeatshrink *hs=(EspFsHeatshrink *)fh->decompData;
+		heatshrinkDecoderFree(hs->dec);
+		os_free(hs);
+	}
 	//os_printf("Freed %p\n", fh);
 	os_free(fh);
 }
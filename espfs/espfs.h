@@ -15,6 +15,9 @@ bool espFsIsImage(const void* const flashAddress);
 EspFsInitResult espFsInit(void *flashAddress);
 EspFsFile *espFsOpen(char *fileName);
 int espFsFlags(EspFsFile *fh);
+int espFsSize(EspFsFile *fh);
+bool espFsHash(EspFsFile *fh, uint8_t *hash);
+int espFsHeaders(EspFsFile *fh, char *buff, int len);
 int espFsRead(EspFsFile *fh, char *buff, int len);
 void espFsClose(EspFsFile *fh);
 
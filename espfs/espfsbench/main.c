@@ -0,0 +1,106 @@
+/*
+Host benchmark of the espfs read path. Reads every file of an image completely with
+different read sizes and prints the decode throughput per compression.
+
+Usage: espfsbench image.espfs
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "espfsformat.h"
+#include "espfs.h"
+
+//Read sizes to compare, cgiEspFsHook reads 1024 bytes per call
+static const int readSizes[]={64, 256, 512, 1024, 2048};
+//Repeat the reads until this amount of bytes has been read per file and size
+#define BENCH_BYTES (4*1024*1024)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+//Names of all files in the image, found by walking the headers
+static int listFiles(char *image, char names[][256], int max) {
+	char *p=image;
+	int count=0;
+	while (count<max) {
+		EspFsHeader h;
+		memcpy(&h, p, sizeof(EspFsHeader));
+		if (h.magic!=ESPFS_MAGIC || (h.flags&FLAG_LASTFILE)) break;
+		if (!(h.flags&FLAG_INDEX)) {
+			strncpy(names[count], p+sizeof(EspFsHeader), 255);
+			names[count][255]=0;
+			count++;
+		}
+		p+=sizeof(EspFsHeader)+h.nameLen+h.fileLenComp;
+		while ((p-image)&3) p++;
+	}
+	return count;
+}
+
+int main(int argc, char **argv) {
+	static char names[256][256];
+	static char buff[4096];
+	if (argc!=2) {
+		fprintf(stderr, "Usage: %s image.espfs\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f=fopen(argv[1], "rb");
+	if (f==NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size=ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *image=malloc(size); //malloc results are aligned for any type
+	if (fread(image, 1, size, f)!=size) {
+		perror(argv[1]);
+		return 1;
+	}
+	fclose(f);
+	if (espFsInit(image)!=ESPFS_INIT_RESULT_OK) {
+		fprintf(stderr, "%s is no espfs image\n", argv[1]);
+		return 1;
+	}
+
+	int count=listFiles(image, names, 256);
+	printf("%-24s %-10s %8s", "file", "compr", "bytes");
+	for (int s=0; s<sizeof(readSizes)/sizeof(readSizes[0]); s++) printf(" %7d B", readSizes[s]);
+	printf("\n");
+
+	for (int i=0; i<count; i++) {
+		EspFsFile *fh=espFsOpen(names[i]);
+		if (fh==NULL) {
+			printf("%-24s cannot open\n", names[i]);
+			continue;
+		}
+		EspFsHeader h;
+		memcpy(&h, *(EspFsHeader **)fh, sizeof(EspFsHeader));
+		int len=espFsSize(fh);
+		espFsClose(fh);
+		printf("%-24s %-10s %8d", names[i], h.compression==COMPRESS_HEATSHRINK ? "heatshrink" :
+				(h.flags&FLAG_GZIP) ? "gzip" : "none", len);
+
+		for (int s=0; s<sizeof(readSizes)/sizeof(readSizes[0]); s++) {
+			long total=0;
+			double start=now();
+			while (total<BENCH_BYTES && len>0) {
+				fh=espFsOpen(names[i]);
+				int r;
+				while ((r=espFsRead(fh, buff, readSizes[s]))>0) total+=r;
+				espFsClose(fh);
+			}
+			double t=now()-start;
+			printf(" %6.1f MB", t>0 ? total/t/1e6 : 0.0);
+		}
+		printf("/s\n");
+	}
+	return 0;
+}
@@ -17,6 +17,17 @@ with the FLAG_LASTFILE flag set.
 
 #define FLAG_LASTFILE (1<<0)
 #define FLAG_GZIP (1<<1)
+//The name area ends with an ESPFS_HASH_LEN byte hash of the stored file data (after the padded
+//name, so readers not knowing the flag still find the name and skip the whole area).
+#define FLAG_HASH (1<<2)
+#define ESPFS_HASH_LEN 8
+//The first header of the image can carry a directory index instead of a file. Its name is
+//empty and its data is an EspFsIndex followed by the entries sorted by name hash.
+#define FLAG_INDEX (1<<3)
+//The name area holds the prebaked http response headers of the file (status line up to
+//Content-Length, without the empty line) in front of the hash: the headers padded to 32 bit,
+//followed by their length as int32_t. Only used together with FLAG_HASH.
+#define FLAG_HEADERS (1<<4)
 #define COMPRESS_NONE 0
 #define COMPRESS_HEATSHRINK 1
 #define ESPFS_MAGIC 0x73665345
@@ -30,4 +41,53 @@ typedef struct {
 	int32_t fileLenDecomp;
 } __attribute__((packed)) EspFsHeader;
 
+typedef struct {
+	int32_t count;			//amount of EspFsIndexEntry
+} __attribute__((packed)) EspFsIndex;
+
+typedef struct {
+	uint32_t nameHash;		//espFsNameHash of the file name
+	int32_t offset;			//offset of the file header from the start of the image
+} __attribute__((packed)) EspFsIndexEntry;
+
+//Compressed firmware or espfs image for OTA uploads (mkespfsimage -z), which cgiUploadFirmware
+//decompresses while it writes the flash. The header is followed by the heatshrink bit stream.
+#define OTA_MAGIC 0x5a41544f
+
+typedef struct {
+	int32_t magic;
+	int32_t size;			//size of the decompressed image
+	uint16_t crc;			//CRC-16/KERMIT of the decompressed image (crc16_data)
+	int8_t compression;		//COMPRESS_HEATSHRINK
+	uint8_t params;			//heatshrink window bits<<4 | lookahead bits
+} __attribute__((packed)) OtaHeader;
+
+//Delta to the firmware in the running partition (mkespfsimage -z new.bin -b old.bin). The
+//OtaHeader with this magic is followed by an OtaDeltaHeader, size and crc are those of the new
+//image. The decompressed stream consists of records of three little endian int32: the count of
+//bytes to add to the base image, the count of extra bytes and how far to move in the base
+//image afterwards. Each record is followed by the bytes to add and then the extra bytes.
+#define OTA_DELTA_MAGIC 0x4c544f44
+
+typedef struct {
+	int32_t baseSize;		//size of the base image
+	uint16_t baseCrc;		//CRC-16/KERMIT of the base image
+	uint16_t reserved;
+} __attribute__((packed)) OtaDeltaHeader;
+
+//32 bit FNV-1a: start with FNV1A_INIT and add the bytes one by one with fnv1aByte.
+#define FNV1A_INIT 2166136261u
+
+static inline uint32_t fnv1aByte(uint32_t hash, uint8_t byte) {
+	return (hash^byte)*16777619u;
+}
+
+//FNV-1a hash of a file name (without leading slashes), used to sort and search the index.
+//httpd hashes the built-in urls the same way.
+static inline uint32_t espFsNameHash(const char *name) {
+	uint32_t hash=FNV1A_INIT;
+	while (*name) hash=fnv1aByte(hash, (uint8_t)*name++);
+	return hash;
+}
+
 #endif
\ No newline at end of file
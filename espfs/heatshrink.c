@@ -0,0 +1,112 @@
+/*
+Streaming heatshrink decoder for compressed espfs files. See heatshrink.h for the format.
+*/
+
+#ifdef __ets__
+//esp build
+#include <esp8266.h>
+#else
+//Test build
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#define os_malloc malloc
+#define os_free free
+#define os_memset memset
+#define ICACHE_FLASH_ATTR
+#endif
+
+#include "heatshrink.h"
+
+enum {
+	HS_TAG,			//1 bit: literal or back reference
+	HS_LITERAL,		//8 bits
+	HS_INDEX,		//windowBits
+	HS_COUNT,		//lookaheadBits
+};
+
+//Allocate a decoder with its window. Returns NULL for unsupported parameters.
+HeatshrinkDecoder ICACHE_FLASH_ATTR *heatshrinkDecoderAlloc(uint8_t windowBits, uint8_t lookaheadBits) {
+	HeatshrinkDecoder *dec;
+	if (windowBits<4 || windowBits>HEATSHRINK_MAX_WINDOW_BITS || lookaheadBits<3 || lookaheadBits>=windowBits) {
+		return NULL;
+	}
+	dec=(HeatshrinkDecoder *)os_malloc(sizeof(HeatshrinkDecoder)+(1<<windowBits));
+	if (dec==NULL) return NULL;
+	os_memset(dec, 0, sizeof(HeatshrinkDecoder)+(1<<windowBits));
+	dec->windowBits=windowBits;
+	dec->lookaheadBits=lookaheadBits;
+	dec->state=HS_TAG;
+	dec->window=(uint8_t *)(dec+1);
+	return dec;
+}
+
+void ICACHE_FLASH_ATTR heatshrinkDecoderFree(HeatshrinkDecoder *dec) {
+	os_free(dec);
+}
+
+//Decode up to outLen bytes from the inLen bytes in in. inUsed is set to the amount of
+//consumed input bytes. Returns the amount of bytes written into out, which is less than
+//outLen only if the input has been used up.
+int ICACHE_FLASH_ATTR heatshrinkDecode(HeatshrinkDecoder *dec, const uint8_t *in, int inLen, int *inUsed, uint8_t *out, int outLen) {
+	const uint16_t mask=(1<<dec->windowBits)-1;
+	int inPos=0, outPos=0;
+
+	while (outPos<outLen) {
+		if (dec->backrefCount>0) {
+			uint8_t c=dec->window[(dec->head-dec->backrefIndex)&mask];
+			dec->window[dec->head++&mask]=c;
+			out[outPos++]=c;
+			dec->backrefCount--;
+			continue;
+		}
+
+		//Collect the bits of the current field, MSB first
+		uint8_t need;
+		switch (dec->state) {
+		case HS_TAG: need=1; break;
+		case HS_LITERAL: need=8; break;
+		case HS_INDEX: need=dec->windowBits; break;
+		default: need=dec->lookaheadBits; break;
+		}
+		while (dec->accBits<need) {
+			if (dec->inBits==0) {
+				if (inPos>=inLen) {
+					*inUsed=inPos;
+					return outPos;
+				}
+				dec->inByte=in[inPos++];
+				dec->inBits=8;
+			}
+			uint8_t take=need-dec->accBits;
+			if (take>dec->inBits) take=dec->inBits;
+			dec->acc=(dec->acc<<take)|((dec->inByte>>(dec->inBits-take))&((1<<take)-1));
+			dec->inBits-=take;
+			dec->accBits+=take;
+		}
+		uint16_t value=dec->acc;
+		dec->acc=0;
+		dec->accBits=0;
+
+		switch (dec->state) {
+		case HS_TAG:
+			dec->state=value ? HS_LITERAL : HS_INDEX;
+			break;
+		case HS_LITERAL:
+			dec->window[dec->head++&mask]=value;
+			out[outPos++]=value;
+			dec->state=HS_TAG;
+			break;
+		case HS_INDEX:
+			dec->backrefIndex=value+1;
+			dec->state=HS_COUNT;
+			break;
+		default:
+			dec->backrefCount=value+1;
+			dec->state=HS_TAG;
+			break;
+		}
+	}
+	*inUsed=inPos;
+	return outPos;
+}
@@ -0,0 +1,32 @@
+#ifndef HEATSHRINK_H
+#define HEATSHRINK_H
+
+/*
+Streaming decoder for the heatshrink LZSS format (https://github.com/atomicobject/heatshrink).
+Items are packed MSB first: a 1 bit is followed by an 8 bit literal, a 0 bit by a back reference
+of windowBits (offset-1) and lookaheadBits (count-1). The decoder only keeps the window of the
+last 2^windowBits output bytes, so it needs no buffer for the whole file.
+*/
+
+//Largest window accepted by the decoder (2KB)
+#define HEATSHRINK_MAX_WINDOW_BITS 11
+
+typedef struct {
+	uint8_t windowBits;
+	uint8_t lookaheadBits;
+	uint8_t state;			//field which is currently read
+	uint8_t inByte;			//input byte which is currently read
+	uint8_t inBits;			//bits left in inByte
+	uint8_t accBits;		//bits of the current field read so far
+	uint16_t acc;			//value of the current field read so far
+	uint16_t backrefIndex;	//offset of the back reference being copied
+	uint16_t backrefCount;	//bytes left to copy of the back reference
+	uint16_t head;			//next write position in window
+	uint8_t *window;
+} HeatshrinkDecoder;
+
+HeatshrinkDecoder *heatshrinkDecoderAlloc(uint8_t windowBits, uint8_t lookaheadBits);
+void heatshrinkDecoderFree(HeatshrinkDecoder *dec);
+int heatshrinkDecode(HeatshrinkDecoder *dec, const uint8_t *in, int inLen, int *inUsed, uint8_t *out, int outLen);
+
+#endif
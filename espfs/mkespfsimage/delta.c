@@ -0,0 +1,179 @@
+/*
+Delta between two firmware images, following bsdiff by Colin Percival: the new image is
+matched against a suffix array of the old one, the matches are extended while they mostly
+agree, and the bytes of a match are stored as difference to the old ones. A firmware, which
+only changes a few functions, differs from the old one mostly in relocated addresses, so the
+differences are mostly zeroes and compress well.
+
+The control records, differences and extra bytes go into one stream, as described at
+OtaDeltaHeader in espfsformat.h, so the esp can apply it while it is received without
+buffering anything but the control record.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "delta.h"
+
+typedef struct {
+	char *buff;
+	size_t len, size;
+} DeltaOut;
+
+static void deltaWrite(DeltaOut *o, const void *data, size_t len) {
+	if (o->len+len>o->size) {
+		while (o->len+len>o->size) o->size=o->size ? o->size*2 : 65536;
+		o->buff=realloc(o->buff, o->size);
+	}
+	memcpy(o->buff+o->len, data, len);
+	o->len+=len;
+}
+
+//Control record values are stored little endian, like the xtensa uses them
+static void deltaWrite32(DeltaOut *o, int32_t v) {
+	unsigned char b[4]={v, v>>8, v>>16, v>>24};
+	deltaWrite(o, b, 4);
+}
+
+//Suffix array by prefix doubling, the suffixes are sorted by the ranks of their first k bytes
+static const int *sortRank;
+static int sortK, sortN;
+
+static int compareSuffixes(const void *a, const void *b) {
+	int i=*(const int *)a, j=*(const int *)b;
+	if (sortRank[i]!=sortRank[j]) return sortRank[i]<sortRank[j] ? -1 : 1;
+	int ri=i+sortK<=sortN ? sortRank[i+sortK] : -1;
+	int rj=j+sortK<=sortN ? sortRank[j+sortK] : -1;
+	return ri<rj ? -1 : ri>rj;
+}
+
+//Returns the n+1 suffixes of old sorted, including the empty one at n
+static int *suffixArray(const unsigned char *old, int n) {
+	int *sa=malloc((n+1)*sizeof(int));
+	int *rank=malloc((n+1)*sizeof(int));
+	int *next=malloc((n+1)*sizeof(int));
+	for (int i=0; i<n; i++) {
+		sa[i]=i;
+		rank[i]=old[i];
+	}
+	sa[n]=n;
+	rank[n]=-1;
+	sortRank=rank;
+	sortN=n;
+	for (sortK=1; ; sortK*=2) {
+		qsort(sa, n+1, sizeof(int), compareSuffixes);
+		next[sa[0]]=0;
+		for (int i=1; i<=n; i++) {
+			next[sa[i]]=next[sa[i-1]]+(compareSuffixes(&sa[i-1], &sa[i])<0);
+		}
+		memcpy(rank, next, (n+1)*sizeof(int));
+		if (rank[sa[n]]==n) break;
+	}
+	free(rank);
+	free(next);
+	return sa;
+}
+
+static int matchLen(const unsigned char *a, int aLen, const unsigned char *b, int bLen) {
+	int i;
+	for (i=0; i<aLen && i<bLen; i++) {
+		if (a[i]!=b[i]) break;
+	}
+	return i;
+}
+
+//Binary search for the longest match of new in old, returns its length and position
+static int search(const int *sa, const unsigned char *old, int oldLen,
+		const unsigned char *new, int newLen, int st, int en, int *pos) {
+	while (en-st>=2) {
+		int x=st+(en-st)/2;
+		int n=oldLen-sa[x]<newLen ? oldLen-sa[x] : newLen;
+		if (memcmp(old+sa[x], new, n)<0) st=x;
+		else en=x;
+	}
+	int x=matchLen(old+sa[st], oldLen-sa[st], new, newLen);
+	int y=matchLen(old+sa[en], oldLen-sa[en], new, newLen);
+	*pos=x>y ? sa[st] : sa[en];
+	return x>y ? x : y;
+}
+
+char *makeDelta(const unsigned char *old, size_t oldSize, const unsigned char *new, size_t newSize,
+		size_t *deltaLen) {
+	int oldLen=oldSize, newLen=newSize;
+	int *sa=suffixArray(old, oldLen);
+	DeltaOut o={NULL, 0, 0};
+	int scan=0, len=0, pos=0;
+	int lastScan=0, lastPos=0, lastOffset=0;
+
+	while (scan<newLen) {
+		int oldScore=0;
+		int sc;
+		//Find the next match, which is better than continuing with the last offset
+		for (sc=scan+=len; scan<newLen; scan++) {
+			len=search(sa, old, oldLen, new+scan, newLen-scan, 0, oldLen, &pos);
+			for (; sc<scan+len; sc++) {
+				if (sc+lastOffset<oldLen && old[sc+lastOffset]==new[sc]) oldScore++;
+			}
+			if ((len==oldScore && len!=0) || len>oldScore+8) break;
+			if (scan+lastOffset<oldLen && old[scan+lastOffset]==new[scan]) oldScore--;
+		}
+		if (len==oldScore && scan!=newLen) continue;
+
+		//Extend the last match forwards and the new one backwards, as long as at least half
+		//of the bytes agree
+		int s=0, best=0, lenF=0, lenB=0;
+		for (int i=0; lastScan+i<scan && lastPos+i<oldLen; ) {
+			if (old[lastPos+i]==new[lastScan+i]) s++;
+			i++;
+			if (s*2-i>best*2-lenF) {
+				best=s;
+				lenF=i;
+			}
+		}
+		if (scan<newLen) {
+			s=0;
+			best=0;
+			for (int i=1; scan>=lastScan+i && pos>=i; i++) {
+				if (old[pos-i]==new[scan-i]) s++;
+				if (s*2-i>best*2-lenB) {
+					best=s;
+					lenB=i;
+				}
+			}
+		}
+		//Split an overlap of both extensions where it fits best
+		if (lastScan+lenF>scan-lenB) {
+			int overlap=(lastScan+lenF)-(scan-lenB);
+			int lenS=0;
+			s=0;
+			best=0;
+			for (int i=0; i<overlap; i++) {
+				if (new[lastScan+lenF-overlap+i]==old[lastPos+lenF-overlap+i]) s++;
+				if (new[scan-lenB+i]==old[pos-lenB+i]) s--;
+				if (s>best) {
+					best=s;
+					lenS=i+1;
+				}
+			}
+			lenF+=lenS-overlap;
+			lenB-=lenS;
+		}
+
+		int extra=(scan-lenB)-(lastScan+lenF);
+		deltaWrite32(&o, lenF);
+		deltaWrite32(&o, extra);
+		deltaWrite32(&o, (pos-lenB)-(lastPos+lenF));
+		for (int i=0; i<lenF; i++) {
+			unsigned char d=new[lastScan+i]-old[lastPos+i];
+			deltaWrite(&o, &d, 1);
+		}
+		deltaWrite(&o, new+lastScan+lenF, extra);
+
+		lastScan=scan-lenB;
+		lastPos=pos-lenB;
+		lastOffset=pos-scan;
+	}
+	free(sa);
+	*deltaLen=o.len;
+	return o.buff;
+}
@@ -0,0 +1,11 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+
+//Makes a bsdiff style delta from the old to the new image. The returned buffer is malloc'd,
+//its length goes to deltaLen.
+char *makeDelta(const unsigned char *old, size_t oldLen, const unsigned char *new, size_t newLen,
+		size_t *deltaLen);
+
+#endif
@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <pthread.h>
 #include "espfs.h"
 #ifdef __MINGW32__
 #include "mman-win32/mman.h"
@@ -18,6 +20,8 @@
 #include <arpa/inet.h>
 #endif
 #include "espfsformat.h"
+#include "delta.h"
+#include "mimetypes.h"
 
 //Gzip
 #ifdef ESPFS_GZIP
@@ -28,6 +32,25 @@
 
 
 
+//The image is collected in memory, because the index at its start needs the offsets of all files.
+static char *image=NULL;
+static size_t imageLen=0, imageSize=0;
+static EspFsIndexEntry *indexEntries=NULL;
+static int indexCount=0, indexSize=0;
+
+void imageWrite(const void *data, size_t len) {
+	if (imageLen+len>imageSize) {
+		while (imageLen+len>imageSize) imageSize=imageSize ? imageSize*2 : 65536;
+		image=realloc(image, imageSize);
+		if (image==NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	memcpy(image+imageLen, data, len);
+	imageLen+=len;
+}
+
 //Routines to convert host format to the endianness used in the xtensa
 short htoxs(short in) {
 	char r[2];
@@ -46,25 +69,38 @@ int htoxl(int in) {
 }
 
 #ifdef ESPFS_GZIP
-size_t compressGzip(char *in, int insize, char *out, int outsize, int level) {
+//Deflate in with the given zlib strategy at level 9. With maxEffort zlib follows the hash
+//chains as far as possible, which is slow but packs a bit better than plain level 9.
+//The gzip header has no mtime and an 'unknown' OS, so the image does not depend on the build host.
+//Returns the compressed size or outsize+1 if it does not fit.
+size_t compressGzip(char *in, int insize, char *out, int outsize, int strategy, int maxEffort) {
 	z_stream stream;
+	gz_header header;
 	int zresult;
 
 	stream.zalloc = Z_NULL;
 	stream.zfree  = Z_NULL;
 	stream.opaque = Z_NULL;
-	stream.next_in = in;
+	stream.next_in = (Bytef *)in;
 	stream.avail_in = insize;
-	stream.next_out = out;
+	stream.next_out = (Bytef *)out;
 	stream.avail_out = outsize;
 	// 31 -> 15 window bits + 16 for gzip
-	zresult = deflateInit2 (&stream, level, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
+	zresult = deflateInit2 (&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 31, 9, strategy);
 	if (zresult != Z_OK) {
 		fprintf(stderr, "DeflateInit2 failed with code %d\n", zresult);
 		exit(1);
 	}
+	memset(&header, 0, sizeof(header));
+	header.os = 255;
+	deflateSetHeader(&stream, &header);
+	if (maxEffort) deflateTune(&stream, 258, 258, 258, 32768);
 
 	zresult = deflate(&stream, Z_FINISH);
+	if (zresult == Z_OK || zresult == Z_BUF_ERROR) {
+		deflateEnd(&stream);
+		return outsize+1;
+	}
 	if (zresult != Z_STREAM_END) {
 		fprintf(stderr, "Deflate failed with code %d\n", zresult);
 		exit(1);
@@ -79,6 +115,26 @@ size_t compressGzip(char *in, int insize, char *out, int outsize, int level) {
 	return stream.total_out;
 }
 
+//Deflate in with all strategies, with and without maxEffort, and keep the smallest result.
+//Returns the compressed size or outsize+1 if nothing fits.
+size_t compressGzipBest(char *in, int insize, char *out, int outsize) {
+	static const int strategies[]={Z_DEFAULT_STRATEGY, Z_FILTERED};
+	char *tmp=malloc(outsize);
+	size_t best=outsize+1, len;
+	int s, e;
+	for (s=0; s<sizeof(strategies)/sizeof(strategies[0]); s++) {
+		for (e=0; e<2; e++) {
+			len=compressGzip(in, insize, tmp, outsize, strategies[s], e);
+			if (len<best) {
+				best=len;
+				memcpy(out, tmp, len);
+			}
+		}
+	}
+	free(tmp);
+	return best;
+}
+
 char **gzipExtensions = NULL;
 
 int shouldCompressGzip(char *name) {
@@ -130,120 +186,632 @@ int parseGzipExtensions(char *input) {
 }
 #endif
 
-int handleFile(int f, char *name, int compression, int level, char **compName, off_t *csizePtr) {
-	char *fdat, *cdat;
-	off_t size, csize;
-	EspFsHeader h;
-	int nameLen;
-	int8_t flags = 0;
-	size=lseek(f, 0, SEEK_END);
-	fdat=mmap(NULL, size, PROT_READ, MAP_SHARED, f, 0);
-	if (fdat==MAP_FAILED) {
+//Heatshrink window and lookahead bits for the compression levels 1-2, 3-4, 5-6, 7-8 and 9.
+//The decoder on the esp needs 2^window bytes of RAM per open file.
+static const int heatshrinkWindow[]={5, 6, 8, 10, 11};
+static const int heatshrinkLookahead[]={3, 3, 4, 4, 4};
+
+typedef struct {
+	char *out;
+	size_t len;
+	size_t size;
+	unsigned char cur;
+	int bits;
+} BitWriter;
+
+//Append the count lower bits of value, MSB first. Returns 0 if the output is full.
+int putBits(BitWriter *w, int value, int count) {
+	while (count>0) {
+		count--;
+		w->cur=(w->cur<<1)|((value>>count)&1);
+		if (++w->bits==8) {
+			if (w->len>=w->size) return 0;
+			w->out[w->len++]=w->cur;
+			w->cur=0;
+			w->bits=0;
+		}
+	}
+	return 1;
+}
+
+//Compress in with heatshrink (LZSS, see espfs/heatshrink.h). The first output byte holds the
+//decoder parameters. Returns the compressed size or outsize+1 if it does not fit.
+size_t compressHeatshrinkParams(char *in, int insize, char *out, int outsize, int ws, int ls) {
+	unsigned char *data=(unsigned char *)in;
+	BitWriter w={out, 1, outsize, 0, 0};
+	int i, j;
+	out[0]=(ws<<4)|ls;
+
+	i=0;
+	while (i<insize) {
+		int maxLen=1<<ls, best=0, bestOffset=0;
+		if (maxLen>insize-i) maxLen=insize-i;
+		//Longest match in the window, the nearest one wins
+		for (j=i-1; j>=0 && j>=i-(1<<ws); j--) {
+			int k=0;
+			while (k<maxLen && data[j+k]==data[i+k]) k++;
+			if (k>best) {
+				best=k;
+				bestOffset=i-j;
+				if (best==maxLen) break;
+			}
+		}
+		int ok;
+		if (best*9>1+ws+ls) {
+			ok=putBits(&w, 0, 1) && putBits(&w, bestOffset-1, ws) && putBits(&w, best-1, ls);
+			i+=best;
+		} else {
+			ok=putBits(&w, 1, 1) && putBits(&w, data[i], 8);
+			i++;
+		}
+		if (!ok) return outsize+1;
+	}
+	if (w.bits>0 && !putBits(&w, 0, 8-w.bits)) return outsize+1;
+	return w.len;
+}
+
+size_t compressHeatshrink(char *in, int insize, char *out, int outsize, int level) {
+	if (level==-1) level=7;
+	return compressHeatshrinkParams(in, insize, out, outsize, heatshrinkWindow[(level-1)/2],
+		heatshrinkLookahead[(level-1)/2]);
+}
+
+const char *getMimetype(char *name) {
+	int i=0;
+	char *ext=name+strlen(name)-1;
+	while (ext!=name && *ext!='.') ext--;
+	if (*ext=='.') ext++;
+	while (mimeTypes[i].ext!=NULL && strcmp(ext, mimeTypes[i].ext)!=0) i++;
+	return mimeTypes[i].mimetype;
+}
+
+//Build the response headers cgiEspFsHook would send for the file, so the server can copy
+//them instead of formatting them for each request. The connection dependent headers and
+//the empty line are added by the server.
+int buildHeaders(char *buff, int buffLen, char *name, int flags, off_t len, unsigned char *hash) {
+	char etag[2*ESPFS_HASH_LEN+1];
+	int i;
+	for (i=0; i<ESPFS_HASH_LEN; i++) sprintf(etag+2*i, "%02x", hash[ESPFS_HASH_LEN-1-i]);
+	return snprintf(buff, buffLen,
+		"HTTP/1.1 200 OK\r\n"
+		"Server: esp-link\r\n"
+		"Content-Type: %s\r\n"
+		"%s"
+		"Cache-Control: max-age=3600, must-revalidate\r\n"
+		"ETag: \"%s\"\r\n"
+		"Content-Length: %d\r\n",
+		getMimetype(name), (flags&FLAG_GZIP) ? "Content-Encoding: gzip\r\n" : "", etag, (int)len);
+}
+
+//Conservative minifiers for the web pages. They only drop whitespace and comments,
+//so the output is never longer than the input.
+static const char *htmlRawTags[]={"pre", "textarea", "script", "style", NULL};
+
+//Position of str in in[pos..len) or len if not found
+static size_t findString(const char *in, size_t pos, size_t len, const char *str) {
+	size_t n=strlen(str);
+	for (; pos+n<=len; pos++) {
+		if (memcmp(in+pos, str, n)==0) return pos;
+	}
+	return len;
+}
+
+//Case insensitive search of the closing tag "</tag" in in[pos..len)
+static size_t findClosingTag(const char *in, size_t pos, size_t len, const char *tag) {
+	size_t n=strlen(tag);
+	for (; pos+2+n<=len; pos++) {
+		if (in[pos]=='<' && in[pos+1]=='/' && strncasecmp(in+pos+2, tag, n)==0) return pos;
+	}
+	return len;
+}
+
+//Drop comments, collapse whitespace and remove whitespace between tags (like the
+//--remove-intertag-spaces of htmlcompressor). Attribute values and the content of
+//pre, textarea, script and style elements are kept as they are.
+size_t minifyHtml(const char *in, size_t len, char *out) {
+	size_t i=0, o=0, j;
+	int inTag=0, t;
+	while (i<len) {
+		char c=in[i];
+		if (!inTag && c=='<' && i+4<=len && strncmp(in+i, "<!--", 4)==0) {
+			i=findString(in, i+4, len, "-->");
+			if (i<len) i+=3;
+			continue;
+		}
+		if (!inTag && c=='<') {
+			inTag=1;
+			for (t=0; htmlRawTags[t]!=NULL; t++) {
+				size_t n=strlen(htmlRawTags[t]);
+				if (i+1+n<len && strncasecmp(in+i+1, htmlRawTags[t], n)==0 &&
+						(in[i+1+n]=='>' || isspace((unsigned char)in[i+1+n]))) {
+					j=findClosingTag(in, i, len, htmlRawTags[t]);
+					memcpy(out+o, in+i, j-i);
+					o+=j-i;
+					i=j;
+					break;
+				}
+			}
+			if (htmlRawTags[t]!=NULL) continue;
+		} else if (inTag && c=='>') {
+			inTag=0;
+		} else if (inTag && (c=='"' || c=='\'')) {
+			for (j=i+1; j<len && in[j]!=c; j++);
+			if (j<len) j++;
+			memcpy(out+o, in+i, j-i);
+			o+=j-i;
+			i=j;
+			continue;
+		} else if (isspace((unsigned char)c)) {
+			for (j=i; j<len && isspace((unsigned char)in[j]); j++);
+			if (o>0 && j<len && !(out[o-1]=='>' && in[j]=='<')) out[o++]=' ';
+			i=j;
+			continue;
+		}
+		out[o++]=in[i++];
+	}
+	return o;
+}
+
+//Drop comments except /*! license comments, collapse whitespace and remove it around
+//braces, semicolons, commas and child combinators. Strings are kept as they are.
+size_t minifyCss(const char *in, size_t len, char *out) {
+	size_t i=0, o=0, j;
+	while (i<len) {
+		char c=in[i];
+		if (c=='/' && i+1<len && in[i+1]=='*') {
+			j=findString(in, i+2, len, "*/");
+			if (j<len) j+=2;
+			if (i+2<len && in[i+2]=='!') {
+				memcpy(out+o, in+i, j-i);
+				o+=j-i;
+				if (j<len && isspace((unsigned char)in[j])) out[o++]='\n';
+			}
+			i=j;
+			continue;
+		}
+		if (c=='"' || c=='\'') {
+			for (j=i+1; j<len && in[j]!=c; j++) {
+				if (in[j]=='\\') j++;
+			}
+			if (j<len) j++;
+			memcpy(out+o, in+i, j-i);
+			o+=j-i;
+			i=j;
+			continue;
+		}
+		if (isspace((unsigned char)c)) {
+			for (j=i; j<len && isspace((unsigned char)in[j]); j++);
+			if (o>0 && j<len && !strchr("{};,>: \n", out[o-1]) && !strchr("{};,>", in[j])) out[o++]=' ';
+			i=j;
+			continue;
+		}
+		if (c=='}' && o>0 && out[o-1]==';') o--;
+		out[o++]=c;
+		i++;
+	}
+	return o;
+}
+
+//Strip indentation, trailing whitespace, empty lines and lines with only a // comment.
+//Line breaks are kept, so automatic semicolon insertion still works. Lines continuing
+//a string (previous line ends with a backslash) are kept as they are.
+size_t minifyJs(const char *in, size_t len, char *out) {
+	size_t i=0, o=0, start, end, next;
+	int continued=0;
+	while (i<len) {
+		for (next=i; next<len && in[next]!='\n'; next++);
+		start=i;
+		end=next;
+		if (!continued) {
+			while (start<end && isspace((unsigned char)in[start])) start++;
+			while (end>start && isspace((unsigned char)in[end-1])) end--;
+		}
+		if (continued || (end>start && !(end-start>=2 && in[start]=='/' && in[start+1]=='/'))) {
+			memcpy(out+o, in+start, end-start);
+			o+=end-start;
+			if (next<len) out[o++]='\n';
+			continued=end>start && in[end-1]=='\\';
+		}
+		i=next+1;
+	}
+	return o;
+}
+
+//Minify the file depending on its extension. Returns a new buffer and updates len,
+//or NULL if the file type is not minified.
+char *minifyFile(char *name, char *data, off_t *len) {
+	const char *ext=strrchr(name, '.');
+	char *out;
+	if (ext==NULL) return NULL;
+	ext++;
+	out=malloc(*len+1);
+	if (strcmp(ext, "html")==0 || strcmp(ext, "htm")==0 || strcmp(ext, "tpl")==0) {
+		*len=minifyHtml(data, *len, out);
+	} else if (strcmp(ext, "css")==0) {
+		*len=minifyCss(data, *len, out);
+	} else if (strcmp(ext, "js")==0) {
+		*len=minifyJs(data, *len, out);
+	} else {
+		free(out);
+		return NULL;
+	}
+	return out;
+}
+
+//64 bit FNV-1a hash of the stored file data, used as strong ETag by the web server.
+//Stored as little endian like all other values of the image.
+void hashFile(char *data, off_t len, unsigned char *hash) {
+	uint64_t h=0xcbf29ce484222325ULL;
+	off_t i;
+	for (i=0; i<len; i++) {
+		h^=(unsigned char)data[i];
+		h*=0x100000001b3ULL;
+	}
+	for (i=0; i<ESPFS_HASH_LEN; i++) {
+		hash[i]=h>>(8*i);
+	}
+}
+
+//A file of the image. The files are compressed by the worker threads and written
+//in the order of the sorted name list, so the image does not depend on the thread timing.
+typedef struct {
+	char *path;
+	char *name;
+	char *fdat;		//mapped file
+	off_t size;		//size of the file
+	char *data;		//file data after minifying, fdat if not minified
+	off_t dataLen;
+	char *cdat;		//stored data, data if stored uncompressed
+	off_t csize;
+	int compression;
+	int8_t flags;
+} FileJob;
+
+static FileJob *jobs=NULL;
+static int jobCount=0, jobSize=0, nextJob=0;
+static pthread_mutex_t jobMutex=PTHREAD_MUTEX_INITIALIZER;
+static int compType=COMPRESS_NONE;
+static int compLvl=-1;
+static int minify=0;
+
+//Try all compressors allowed for the file and keep the smallest result.
+//Runs in the worker threads, so it must not touch the image.
+void compressFile(FileJob *job) {
+	char *cdat;
+	off_t csize;
+	int f=open(job->path, O_RDONLY);
+	if (f<0) {
+		perror(job->path);
+		exit(1);
+	}
+	job->size=lseek(f, 0, SEEK_END);
+	job->fdat=job->size ? mmap(NULL, job->size, PROT_READ, MAP_SHARED, f, 0) : "";
+	close(f);
+	if (job->fdat==MAP_FAILED) {
 		perror("mmap");
-		return 0;
+		exit(1);
+	}
+	job->dataLen=job->size;
+	job->data=minify ? minifyFile(job->name, job->fdat, &job->dataLen) : NULL;
+	if (job->data==NULL) job->data=job->fdat;
+
+	job->compression=COMPRESS_NONE;
+	job->flags=0;
+	job->cdat=job->data;
+	job->csize=job->dataLen;
+
+	if (compType==COMPRESS_HEATSHRINK && job->dataLen>0) {
+		cdat=malloc(job->csize);
+		csize=compressHeatshrink(job->data, job->dataLen, cdat, job->csize, compLvl);
+		if (csize<job->csize) {
+			job->cdat=cdat;
+			job->csize=csize;
+			job->compression=COMPRESS_HEATSHRINK;
+		} else {
+			free(cdat);
+		}
+	} else if (compType!=COMPRESS_NONE && compType!=COMPRESS_HEATSHRINK) {
+		fprintf(stderr, "Unknown compression - %d\n", compType);
+		exit(1);
 	}
 
 #ifdef ESPFS_GZIP
-	if (shouldCompressGzip(name)) {
-		csize = size*3;
-		if (csize<100) // gzip has some headers that do not fit when trying to compress small files
-			csize = 100; // enlarge buffer if this is the case
-		cdat=malloc(csize);
-		csize=compressGzip(fdat, size, cdat, csize, level);
-		compression = COMPRESS_NONE;
-		flags = FLAG_GZIP;
-	} else
+	//Only for files the browsers are expected to accept gzipped
+	if (shouldCompressGzip(job->name) && job->dataLen>0) {
+		cdat=malloc(job->csize);
+		csize=compressGzipBest(job->data, job->dataLen, cdat, job->csize);
+		if (csize<job->csize) {
+			if (job->cdat!=job->data) free(job->cdat);
+			job->cdat=cdat;
+			job->csize=csize;
+			job->compression=COMPRESS_NONE;
+			job->flags=FLAG_GZIP;
+		} else {
+			free(cdat);
+		}
+	}
 #endif
-	if (compression==COMPRESS_NONE) {
-		csize=size;
-		cdat=fdat;
-	} else {
-		fprintf(stderr, "Unknown compression - %d\n", compression);
-		exit(1);
+}
+
+void *compressWorker(void *arg) {
+	int x;
+	while (1) {
+		pthread_mutex_lock(&jobMutex);
+		x=nextJob++;
+		pthread_mutex_unlock(&jobMutex);
+		if (x>=jobCount) return NULL;
+		compressFile(&jobs[x]);
 	}
+}
 
-	if (csize>size) {
-		//Compressing enbiggened this file. Revert to uncompressed store.
-		compression=COMPRESS_NONE;
-		csize=size;
-		cdat=fdat;
-		flags=0;
+//Append a compressed file to the image. Returns the compression rate.
+int writeFile(FileJob *job, char **compName) {
+	EspFsHeader h;
+	int nameLen;
+	char *name=job->name;
+	off_t csize=job->csize;
+	int8_t flags=job->flags;
+	unsigned char hash[ESPFS_HASH_LEN];
+	char headers[512];
+	int headersLen, x;
+
+	//Remember the file for the index
+	if (indexCount==indexSize) {
+		indexSize=indexSize ? indexSize*2 : 64;
+		indexEntries=realloc(indexEntries, indexSize*sizeof(EspFsIndexEntry));
 	}
+	indexEntries[indexCount].nameHash=espFsNameHash(name);
+	indexEntries[indexCount].offset=imageLen;
+	indexCount++;
+
+	hashFile(job->cdat, csize, hash);
+	flags|=FLAG_HASH;
+	//espFsRead returns heatshrink files decompressed, all others as stored
+	headersLen=buildHeaders(headers, sizeof(headers), name, flags,
+			job->compression==COMPRESS_HEATSHRINK ? job->dataLen : csize, hash);
+	flags|=FLAG_HEADERS;
 
 	//Fill header data
 	h.magic=('E'<<0)+('S'<<8)+('f'<<16)+('s'<<24);
 	h.flags=flags;
-	h.compression=compression;
+	h.compression=job->compression;
 	h.nameLen=nameLen=strlen(name)+1;
 	if (h.nameLen&3) h.nameLen+=4-(h.nameLen&3); //Round to next 32bit boundary
+	h.nameLen+=((headersLen+3)&~3)+4+ESPFS_HASH_LEN;
 	h.nameLen=htoxs(h.nameLen);
 	h.fileLenComp=htoxl(csize);
-	h.fileLenDecomp=htoxl(size);
+	h.fileLenDecomp=htoxl(job->dataLen);
 
-	write(1, &h, sizeof(EspFsHeader));
-	write(1, name, nameLen);
+	imageWrite(&h, sizeof(EspFsHeader));
+	imageWrite(name, nameLen);
 	while (nameLen&3) {
-		write(1, "\000", 1);
+		imageWrite("\000", 1);
 		nameLen++;
 	}
-	write(1, cdat, csize);
+	imageWrite(headers, headersLen);
+	for (x=headersLen; x&3; x++) imageWrite("\000", 1);
+	x=htoxl(headersLen);
+	imageWrite(&x, 4);
+	imageWrite(hash, ESPFS_HASH_LEN);
+	imageWrite(job->cdat, csize);
 	//Pad out to 32bit boundary
 	while (csize&3) {
-		write(1, "\000", 1);
+		imageWrite("\000", 1);
 		csize++;
 	}
-	munmap(fdat, size);
 
-	if (compName != NULL) {
-		if (h.compression==COMPRESS_NONE) {
-			if (h.flags & FLAG_GZIP) {
-				*compName = "gzip";
-			} else {
-				*compName = "none";
-			}
-		} else {
-			*compName = "unknown";
-		}
+	if (job->compression==COMPRESS_HEATSHRINK) {
+		*compName = "heatshrink";
+	} else if (flags & FLAG_GZIP) {
+		*compName = "gzip";
+	} else if (job->data!=job->fdat) {
+		*compName = "minified";
+	} else {
+		*compName = "none";
 	}
-  *csizePtr = csize;
-	return (csize*100)/size;
+	if (job->cdat!=job->data) free(job->cdat);
+	if (job->data!=job->fdat) free(job->data);
+	if (job->size) munmap(job->fdat, job->size);
+	return job->size ? (job->csize*100)/job->size : 100;
+}
+
+int compareJobs(const void *a, const void *b) {
+	return strcmp(((const FileJob *)a)->name, ((const FileJob *)b)->name);
 }
 
-//Write final dummy header with FLAG_LASTFILE set.
+int cpuCount() {
+#ifdef __WIN32__
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long n=sysconf(_SC_NPROCESSORS_ONLN);
+	return n>0 ? n : 1;
+#endif
+}
+
+int compareIndexEntries(const void *a, const void *b) {
+	uint32_t ha=((const EspFsIndexEntry *)a)->nameHash;
+	uint32_t hb=((const EspFsIndexEntry *)b)->nameHash;
+	return (ha>hb)-(ha<hb);
+}
+
+//Write final dummy header with FLAG_LASTFILE set and the image with the index in front of it.
 void finishArchive() {
 	EspFsHeader h;
+	EspFsIndex index;
+	int x, indexLen, dataLen;
 	h.magic=('E'<<0)+('S'<<8)+('f'<<16)+('s'<<24);
 	h.flags=FLAG_LASTFILE;
 	h.compression=COMPRESS_NONE;
 	h.nameLen=htoxs(0);
 	h.fileLenComp=htoxl(0);
 	h.fileLenDecomp=htoxl(0);
+	imageWrite(&h, sizeof(EspFsHeader));
+
+	//The index is a file with an empty name (4 bytes incl. padding) in front of all other files
+	qsort(indexEntries, indexCount, sizeof(EspFsIndexEntry), compareIndexEntries);
+	dataLen=sizeof(EspFsIndex)+indexCount*sizeof(EspFsIndexEntry);
+	indexLen=sizeof(EspFsHeader)+4+dataLen;
+	h.flags=FLAG_INDEX;
+	h.nameLen=htoxs(4);
+	h.fileLenComp=htoxl(dataLen);
+	h.fileLenDecomp=htoxl(dataLen);
 	write(1, &h, sizeof(EspFsHeader));
+	write(1, "\000\000\000\000", 4);
+	index.count=htoxl(indexCount);
+	write(1, &index, sizeof(EspFsIndex));
+	for (x=0; x<indexCount; x++) {
+		EspFsIndexEntry e;
+		e.nameHash=htoxl(indexEntries[x].nameHash);
+		e.offset=htoxl(indexEntries[x].offset+indexLen);
+		write(1, &e, sizeof(EspFsIndexEntry));
+	}
+	write(1, image, imageLen);
+}
+
+//CRC-16/KERMIT like crc16_add in serial/crc16.c, which checks OTA uploads on the esp
+unsigned short crc16Add(unsigned char b, unsigned short acc) {
+	acc^=b;
+	acc=(acc>>8)|(acc<<8);
+	acc^=(acc&0xff00)<<4;
+	acc^=(acc>>8)>>4;
+	acc^=(acc&0xff00)>>5;
+	return acc;
+}
+
+static char *readImage(const char *path, off_t *len) {
+	struct stat statBuf;
+	char *data;
+	int fd=open(path, O_RDONLY);
+	if (fd<0 || fstat(fd, &statBuf)<0) {
+		perror(path);
+		return NULL;
+	}
+	data=malloc(statBuf.st_size+1);
+	if (read(fd, data, statBuf.st_size)!=statBuf.st_size) {
+		perror(path);
+		return NULL;
+	}
+	close(fd);
+	*len=statBuf.st_size;
+	return data;
+}
+
+static unsigned short crc16Image(const char *data, off_t len) {
+	unsigned short crc=0;
+	for (off_t i=0; i<len; i++) crc=crc16Add(data[i], crc);
+	return crc;
+}
+
+//Write a firmware or espfs image heatshrink compressed with an OtaHeader to stdout, for
+//cgiUploadFirmware to decompress while flashing. With a base image a compressed delta to it
+//is written instead, which the esp applies to the image in its running partition. If that
+//doesn't come out smaller, e.g. for an espfs of compressed files, the plain image is written,
+//which cgiUploadFirmware takes as well.
+int makeOtaImage(const char *path, const char *basePath, int level) {
+	OtaHeader h;
+	OtaDeltaHeader dh;
+	char *data, *base=NULL, *stream, *cdat, *tmp;
+	off_t len, baseLen=0;
+	size_t streamLen, csize, outLen;
+	data=readImage(path, &len);
+	if (data==NULL) return 1;
+	stream=data;
+	streamLen=len;
+	if (basePath!=NULL) {
+		base=readImage(basePath, &baseLen);
+		if (base==NULL) return 1;
+		stream=makeDelta((unsigned char *)base, baseLen, (unsigned char *)data, len, &streamLen);
+	}
+	//The long runs of zeroes in a delta want longer matches than the files of an espfs, so
+	//the lookahead, which packs best, is picked
+	cdat=malloc(streamLen*2+16);
+	tmp=malloc(streamLen*2+16);
+	int ws=heatshrinkWindow[(level-1)/2];
+	csize=streamLen*2+16;
+	for (int ls=heatshrinkLookahead[(level-1)/2]; ls<=8 && ls<ws; ls++) {
+		size_t n=compressHeatshrinkParams(stream, streamLen, tmp, streamLen*2+16, ws, ls);
+		if (n<csize) {
+			csize=n;
+			memcpy(cdat, tmp, n);
+		}
+	}
+	free(tmp);
+
+#ifdef __WIN32__
+	setmode(fileno(stdout), _O_BINARY);
+#endif
+	outLen=sizeof(OtaHeader)+csize-1;
+	if (base!=NULL) outLen+=sizeof(OtaDeltaHeader);
+	if (outLen>=(size_t)len) {
+		write(1, data, len);
+		fprintf(stderr, "%s: %u bytes uncompressed, compressed%s it would take %u bytes, crc %04x\n",
+			path, (unsigned)len, base!=NULL ? " as delta" : "", (unsigned)outLen, crc16Image(data, len));
+		goto done;
+	}
+
+	//The first byte of the heatshrink output holds its parameters, it goes into the header
+	h.magic=htoxl(base!=NULL ? OTA_DELTA_MAGIC : OTA_MAGIC);
+	h.size=htoxl(len);
+	h.crc=htoxs(crc16Image(data, len));
+	h.compression=COMPRESS_HEATSHRINK;
+	h.params=cdat[0];
+	write(1, &h, sizeof(OtaHeader));
+	if (base!=NULL) {
+		dh.baseSize=htoxl(baseLen);
+		dh.baseCrc=htoxs(crc16Image(base, baseLen));
+		dh.reserved=0;
+		write(1, &dh, sizeof(OtaDeltaHeader));
+	}
+	write(1, cdat+1, csize-1);
+	fprintf(stderr, "%s: %u -> %u bytes (%d%%)%s, crc %04x\n", path, (unsigned)len, (unsigned)outLen,
+		(int)(outLen*100/(len ? len : 1)), base!=NULL ? " as delta" : "", crc16Image(data, len));
+done:
+	if (base!=NULL) {
+		free(base);
+		free(stream);
+	}
+	free(data);
+	free(cdat);
+	return 0;
 }
 
 int main(int argc, char **argv) {
-	int f, x;
+	int x;
 	char fileName[1024];
 	char *realName;
 	struct stat statBuf;
 	int serr;
 	int rate;
 	int err=0;
-	int compType;  //default compression type - heatshrink
-	int compLvl=-1;
-
-	compType = COMPRESS_NONE;
+	int threadCount=cpuCount();
+	char *otaFile=NULL;
+	char *otaBase=NULL;
+	pthread_t *threads;
 
 	for (x=1; x<argc; x++) {
-		if (strcmp(argv[x], "-c")==0 && argc>=x-2) {
+		if (strcmp(argv[x], "-c")==0 && x+1<argc) {
 			compType=atoi(argv[x+1]);
 			x++;
-		} else if (strcmp(argv[x], "-l")==0 && argc>=x-2) {
+		} else if (strcmp(argv[x], "-l")==0 && x+1<argc) {
 			compLvl=atoi(argv[x+1]);
 			if (compLvl<1 || compLvl>9) err=1;
 			x++;
+		} else if (strcmp(argv[x], "-j")==0 && x+1<argc) {
+			threadCount=atoi(argv[x+1]);
+			if (threadCount<1) err=1;
+			x++;
+		} else if (strcmp(argv[x], "-m")==0) {
+			minify=1;
+		} else if (strcmp(argv[x], "-z")==0 && x+1<argc) {
+			otaFile=argv[x+1];
+			x++;
+		} else if (strcmp(argv[x], "-b")==0 && x+1<argc) {
+			otaBase=argv[x+1];
+			x++;
 #ifdef ESPFS_GZIP
-		} else if (strcmp(argv[x], "-g")==0 && argc>=x-2) {
+		} else if (strcmp(argv[x], "-g")==0 && x+1<argc) {
 			if (!parseGzipExtensions(argv[x+1])) err=1;
 			x++;
 #endif
@@ -260,27 +828,36 @@ int main(int argc, char **argv) {
 
 	if (err) {
 		fprintf(stderr, "%s - Program to create espfs images\n", argv[0]);
-		fprintf(stderr, "Usage: \nfind | %s [-c compressor] [-l compression_level] ", argv[0]);
+		fprintf(stderr, "Usage: \nfind | %s [-c compressor] [-l compression_level] [-j threads] [-m] ", argv[0]);
 #ifdef ESPFS_GZIP
 		fprintf(stderr, "[-g gzipped_extensions] ");
 #endif
 		fprintf(stderr, "> out.espfs\n");
+		fprintf(stderr, "       %s -z image [-b base_image] [-l compression_level] > image.hs\n", argv[0]);
 		fprintf(stderr, "Compressors:\n");
 		fprintf(stderr, "0 - None(default)\n");
+		fprintf(stderr, "1 - Heatshrink\n");
 		fprintf(stderr, "\nCompression level: 1 is worst but low RAM usage, higher is better compression \nbut uses more ram on decompression. -1 = compressors default.\n");
+		fprintf(stderr, "\nThreads: count of files compressed in parallel. Defaults to the count of CPUs.\n");
+		fprintf(stderr, "\n-m: minify html, css and js files (whitespace and comments only).\n");
+		fprintf(stderr, "\n-z: compress a firmware or espfs image with heatshrink for OTA uploads, level 9 \nby default (2KB window). The image is written uncompressed, if that is smaller.\n");
+		fprintf(stderr, "\n-b: make the OTA image a delta to the base image, which is the one in the \nrunning partition. esp-link rejects it, if the base doesn't match.\n");
 #ifdef ESPFS_GZIP
-		fprintf(stderr, "\nGzipped extensions: list of comma separated, case sensitive file extensions \nthat will be gzipped. Defaults to 'html,css,js'\n");
+		fprintf(stderr, "\nGzipped extensions: list of comma separated, case sensitive file extensions \nthat may be gzipped. Defaults to 'html,css,js,ico'\n");
+		fprintf(stderr, "\nEach file is stored with the smallest of gzip (maximum effort), the selected \ncompressor and no compression.\n");
 #endif
 		exit(0);
 	}
 
+	if (otaFile!=NULL) return makeOtaImage(otaFile, otaBase, compLvl==-1 ? 9 : compLvl);
+
 #ifdef __WIN32__
 	setmode(fileno(stdout), _O_BINARY);
 #endif
 
 	while(fgets(fileName, sizeof(fileName), stdin)) {
 		//Kill off '\n' at the end
-		fileName[strlen(fileName)-1]=0;
+		fileName[strcspn(fileName, "\r\n")]=0;
 		//Only include files
 		serr=stat(fileName, &statBuf);
 		if ((serr==0) && S_ISREG(statBuf.st_mode)) {
@@ -288,23 +865,40 @@ int main(int argc, char **argv) {
 			realName=fileName;
 			if (fileName[0]=='.') realName++;
 			if (realName[0]=='/') realName++;
-			f=open(fileName, O_RDONLY);
-			if (f>0) {
-				char *compName = "unknown";
-        off_t csize;
-				rate=handleFile(f, realName, compType, compLvl, &compName, &csize);
-				fprintf(stderr, "%-16s (%3d%%, %s, %4u bytes)\n", realName, rate, compName, (uint32_t)csize);
-				close(f);
-			} else {
-				perror(fileName);
+			if (jobCount==jobSize) {
+				jobSize=jobSize ? jobSize*2 : 64;
+				jobs=realloc(jobs, jobSize*sizeof(FileJob));
 			}
+			memset(&jobs[jobCount], 0, sizeof(FileJob));
+			jobs[jobCount].path=strdup(fileName);
+			jobs[jobCount].name=jobs[jobCount].path+(realName-fileName);
+			jobCount++;
 		} else {
 			if (serr!=0) {
 				perror(fileName);
 			}
 		}
 	}
+	//The order of find depends on the file system, sort the files for reproducible images
+	qsort(jobs, jobCount, sizeof(FileJob), compareJobs);
+
+	if (threadCount>jobCount) threadCount=jobCount;
+	threads=malloc(threadCount*sizeof(pthread_t));
+	for (x=0; x<threadCount; x++) {
+		if (pthread_create(&threads[x], NULL, compressWorker, NULL)!=0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (x=0; x<threadCount; x++) pthread_join(threads[x], NULL);
+	free(threads);
+
+	for (x=0; x<jobCount; x++) {
+		char *compName = "unknown";
+		rate=writeFile(&jobs[x], &compName);
+		fprintf(stderr, "%-16s (%3d%%, %s, %4u bytes)\n", jobs[x].name, rate, compName, (uint32_t)jobs[x].csize);
+		free(jobs[x].path);
+	}
 	finishArchive();
 	return 0;
 }
-
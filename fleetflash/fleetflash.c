@@ -0,0 +1,527 @@
+/*
+Flashes a fleet of esp-links over wifi, like wiflash does one at a time. The nodes are given on
+the command line or discovered, checked with /flash/next, flashed a few at a time and then
+rebooted in small groups, so a venue never has all its fixtures down at once. A group is only
+rebooted, after the previous one came back with the new firmware, the rollout stops at the
+first node, which doesn't.
+
+Usage: fleetflash [-a] [-m] [-s range] [-b broadcast] [-j uploads] [-r retries] [-g group]
+                  [-w seconds] [-t seconds] [-p request]... [-e espfs.img] [-n]
+                  [node...] [user1.bin user2.bin]
+  -a  discover the nodes with ArtPoll
+  -m  discover the nodes with mDNS (_http._tcp)
+  -s  probe a range of nodes: 192.168.1.10-60 or, for hosthttpd, 127.0.0.1:8101-8108
+  -b  broadcast address of the ArtPoll, default 255.255.255.255
+  -j  number of concurrent uploads, default 4
+  -r  retries of a failed upload, default 2
+  -g  number of nodes rebooted at once, default 1
+  -w  seconds to wait after a group came back, before the next is rebooted, default 2
+  -t  seconds a node may take to come back after a reboot, default 60
+  -p  request sent to each node after its upload (or alone), e.g. "/log/dbg?mode=off",
+      POSTed unless it starts with a method: "GET /console/baud?rate=115200"
+  -e  upload an espfs image instead of firmware, the nodes are reset to load it
+  -n  only discover and check the nodes
+  node  host[:port], the firmware files can be compressed (mkespfsimage -z)
+
+The exit status is 0 if all nodes were flashed and came back, 1 otherwise.
+*/
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_NODES 256
+#define ARTNET_PORT 6454
+#define MDNS_PORT 5353
+#define DISCOVER_MS 2000
+
+typedef struct {
+  char name[64];    // host[:port]
+  int next;         // partition /flash/next offered before the upload, 1 or 2, 0 if unknown
+  int ok;           // checked, flashed and, after the reboot, back
+} Node;
+
+static Node nodes[MAX_NODES];
+static int nodeCount;
+
+static int uploads = 4, retries = 2, groupSize = 1, groupWait = 2, rebootTimeout = 60;
+static char *requests[16];
+static int requestCount;
+static char *image[2];      // user1.bin and user2.bin, or the espfs image in image[0]
+static int imageLen[2];
+static int espfs;
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+static void addNode(const char *name) {
+  for (int i = 0; i < nodeCount; i++) {
+    if (strcmp(nodes[i].name, name) == 0) return;
+  }
+  if (nodeCount == MAX_NODES) {
+    fprintf(stderr, "too many nodes, %s skipped\n", name);
+    return;
+  }
+  snprintf(nodes[nodeCount].name, sizeof(nodes[0].name), "%s", name);
+  nodeCount++;
+}
+
+//===== HTTP
+
+//Connects to host[:port] with a timeout for the connect and each read or write
+static int httpConnect(const char *node, int timeout) {
+  char host[64];
+  const char *port = "80";
+  snprintf(host, sizeof(host), "%s", node);
+  char *colon = strchr(host, ':');
+  if (colon != NULL) {
+    *colon = 0;
+    port = colon + 1;
+  }
+  struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *ai;
+  if (getaddrinfo(host, port, &hints, &ai) != 0) return -1;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct timeval tv = { timeout, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(ai);
+  return fd;
+}
+
+static int writeAll(int fd, const char *data, int len) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n <= 0) return -1;
+    data += n;
+    len -= n;
+  }
+  return 0;
+}
+
+//Sends a request and returns the HTTP status or -1, the body of the response goes to resp
+static int httpRequest(const char *node, const char *method, const char *path,
+    const char *body, int bodyLen, char *resp, int respLen, int timeout) {
+  char buff[1024];
+  int fd = httpConnect(node, timeout);
+  if (fd < 0) return -1;
+  int n = snprintf(buff, sizeof(buff), "%s %s HTTP/1.0\r\nHost: %s\r\nContent-Length: %d\r\n"
+      "Connection: close\r\n\r\n", method, path, node, bodyLen);
+  if (writeAll(fd, buff, n) < 0 || (bodyLen > 0 && writeAll(fd, body, bodyLen) < 0)) {
+    close(fd);
+    return -1;
+  }
+  // the response is read until the server closes the connection
+  int len = 0;
+  char *r = malloc(65536);
+  while (len < 65535 && (n = read(fd, r + len, 65535 - len)) > 0) len += n;
+  close(fd);
+  r[len] = 0;
+  int status = -1;
+  char *bodyStart = strstr(r, "\r\n\r\n");
+  if (sscanf(r, "HTTP/%*d.%*d %d", &status) != 1 || bodyStart == NULL) status = -1;
+  if (resp != NULL) {
+    snprintf(resp, respLen, "%s", bodyStart != NULL ? bodyStart + 4 : "");
+    resp[strcspn(resp, "\r\n")] = 0;
+  }
+  free(r);
+  return status;
+}
+
+//Returns the partition /flash/next offers, 1 or 2, or 0 if the node doesn't answer
+static int flashNext(const char *node, int timeout) {
+  char resp[64];
+  if (httpRequest(node, "GET", "/flash/next", NULL, 0, resp, sizeof(resp), timeout) != 200) return 0;
+  if (strcmp(resp, "user1.bin") == 0) return 1;
+  if (strcmp(resp, "user2.bin") == 0) return 2;
+  return 0;
+}
+
+//===== Discovery
+
+//Collects the addresses, which answer within DISCOVER_MS, the replies are checked with match
+static void collectReplies(int fd, int (*match)(const char *data, int len), const char *how) {
+  long end = now() + DISCOVER_MS;
+  for (long left; (left = end - now()) > 0; ) {
+    char data[1024], name[64];
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    struct timeval tv = { left / 1000, (left % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int n = recvfrom(fd, data, sizeof(data), 0, (struct sockaddr *)&from, &fromLen);
+    if (n < 0) break;
+    if (!match(data, n)) continue;
+    inet_ntop(AF_INET, &from.sin_addr, name, sizeof(name));
+    printf("%s: found with %s\n", name, how);
+    addNode(name);
+  }
+}
+
+static int isPollReply(const char *data, int len) {
+  return len >= 10 && memcmp(data, "Art-Net\0", 8) == 0 && data[8] == 0x00 && data[9] == 0x21;
+}
+
+//Reads the dotted name at pos of a DNS message, following compression pointers. Returns the
+//position after the name, -1 if it is malformed.
+static int dnsName(const unsigned char *data, int len, int pos, char *name, int nameLen) {
+  int end = -1, jumps = 0, n = 0;
+  while (pos < len) {
+    int l = data[pos];
+    if (l == 0) {
+      name[n] = 0;
+      return end < 0 ? pos + 1 : end;
+    }
+    if ((l & 0xc0) == 0xc0) {
+      if (pos + 1 >= len || ++jumps > 16) return -1;
+      if (end < 0) end = pos + 2;
+      pos = ((l & 0x3f) << 8) | data[pos + 1];
+      continue;
+    }
+    if (pos + 1 + l > len || n + l + 2 > nameLen) return -1;
+    if (n > 0) name[n++] = '.';
+    memcpy(name + n, data + pos + 1, l);
+    n += l;
+    pos += 1 + l;
+  }
+  return -1;
+}
+
+//A response with a PTR record for _http._tcp.local, the answer to discoverMdns
+static int isMdnsResponse(const char *data, int len) {
+  const unsigned char *d = (const unsigned char *)data;
+  char name[256];
+  if (len < 12 || !(d[2] & 0x80)) return 0;
+  int questions = (d[4] << 8) | d[5], answers = (d[6] << 8) | d[7];
+  int pos = 12;
+  for (int i = 0; i < questions; i++) {
+    pos = dnsName(d, len, pos, name, sizeof(name));
+    if (pos < 0 || pos + 4 > len) return 0;
+    pos += 4; // type and class
+  }
+  for (int i = 0; i < answers; i++) {
+    pos = dnsName(d, len, pos, name, sizeof(name));
+    if (pos < 0 || pos + 10 > len) return 0;
+    int type = (d[pos] << 8) | d[pos + 1];
+    int dataLen = (d[pos + 8] << 8) | d[pos + 9];
+    if (type == 12 && strcasecmp(name, "_http._tcp.local") == 0) return 1;
+    pos += 10 + dataLen;
+  }
+  return 0;
+}
+
+static int udpSocket(void) {
+  int one = 1;
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+  return fd;
+}
+
+//The nodes reply to the address the ArtPoll came from
+static void discoverArtPoll(const char *broadcast) {
+  static const char poll[14] = { 'A', 'r', 't', '-', 'N', 'e', 't', 0, 0x00, 0x20, 0, 14, 0, 0 };
+  struct sockaddr_in to = { .sin_family = AF_INET, .sin_port = htons(ARTNET_PORT) };
+  inet_pton(AF_INET, broadcast, &to.sin_addr);
+  int fd = udpSocket();
+  if (sendto(fd, poll, sizeof(poll), 0, (struct sockaddr *)&to, sizeof(to)) < 0) {
+    perror("ArtPoll");
+  }
+  collectReplies(fd, isPollReply, "ArtPoll");
+  close(fd);
+}
+
+//A one-shot query for the http services, which is answered by unicast
+static void discoverMdns(void) {
+  static const char name[] = "\005_http\004_tcp\005local";
+  char query[64] = { 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0 }; // one question
+  int len = 12;
+  memcpy(query + len, name, sizeof(name)); // including the terminating 0
+  len += sizeof(name);
+  query[len++] = 0; query[len++] = 12;     // PTR
+  query[len++] = 0x80; query[len++] = 1;   // IN, unicast response
+  struct sockaddr_in to = { .sin_family = AF_INET, .sin_port = htons(MDNS_PORT) };
+  inet_pton(AF_INET, "224.0.0.251", &to.sin_addr);
+  int fd = udpSocket();
+  if (sendto(fd, query, len, 0, (struct sockaddr *)&to, sizeof(to)) < 0) perror("mDNS");
+  collectReplies(fd, isMdnsResponse, "mDNS");
+  close(fd);
+}
+
+//A range like 192.168.1.10-60 or 127.0.0.1:8101-8108, the last number counts up
+static void probeRange(const char *range) {
+  char prefix[64];
+  int from, to;
+  const char *dash = strrchr(range, '-');
+  const char *start = dash;
+  while (start != NULL && start > range && start[-1] >= '0' && start[-1] <= '9') start--;
+  if (dash == NULL || start == range || start - range >= sizeof(prefix) ||
+      sscanf(start, "%d-%d", &from, &to) != 2 || to < from) {
+    fprintf(stderr, "bad range %s\n", range);
+    exit(1);
+  }
+  snprintf(prefix, start - range + 1, "%s", range);
+  for (int i = from; i <= to; i++) {
+    char name[80];
+    snprintf(name, sizeof(name), "%s%d", prefix, i);
+    addNode(name);
+  }
+}
+
+//===== Parallel work
+
+//Runs work for each node in a child process, at most parallel at once. The exit status of the
+//child goes to the node with result, -1 if the child couldn't be started or was killed.
+static void forEachNode(int parallel, int (*work)(Node *n), void (*result)(Node *n, int status)) {
+  pid_t pids[MAX_NODES];
+  int running = 0;
+  fflush(stdout);
+  for (int i = 0; i < nodeCount || running > 0; ) {
+    if (i < nodeCount && running < parallel) {
+      pid_t pid = fork();
+      if (pid == 0) exit(work(&nodes[i]));
+      if (pid < 0) {
+        printf("%s: fork failed: %s\n", nodes[i].name, strerror(errno));
+        result(&nodes[i], -1);
+        pids[i++] = 0;
+        continue;
+      }
+      pids[i++] = pid;
+      running++;
+      continue;
+    }
+    int status;
+    pid_t pid = wait(&status);
+    if (pid < 0) break;
+    running--;
+    for (int j = 0; j < i; j++) {
+      if (pids[j] == pid) result(&nodes[j], WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    }
+  }
+}
+
+static int checkWork(Node *n) {
+  return flashNext(n->name, 3);
+}
+
+static void checkResult(Node *n, int next) {
+  n->next = next == 1 || next == 2 ? next : 0;
+  if (n->next == 0) printf("%s: no esp-link, skipped\n", n->name);
+  else printf("%s: runs user%d.bin\n", n->name, 3 - n->next);
+}
+
+static int uploadWork(Node *n) {
+  char resp[256];
+  int status = 0;
+  if (image[0] != NULL) {
+    int i = espfs ? 0 : n->next - 1;
+    for (int attempt = 0; attempt <= retries; attempt++) {
+      if (attempt > 0) sleep(attempt);
+      long start = now();
+      status = httpRequest(n->name, "POST", "/flash/upload", image[i], imageLen[i],
+          resp, sizeof(resp), 30);
+      if (status == 200 && strstr(resp, "\"crc\"") != NULL) {
+        printf("%s: uploaded %s in %ld ms %s\n", n->name, espfs ? "espfs" : i ? "user2.bin" :
+            "user1.bin", now() - start, resp);
+        break;
+      }
+      printf("%s: upload failed (%d) %s\n", n->name, status, status < 0 ? strerror(errno) : resp);
+      fflush(stdout);
+      // an image, which the node refuses, doesn't get better by trying again
+      if (status >= 400 && status < 500) return 1;
+    }
+    if (status != 200) return 1;
+  }
+  for (int r = 0; r < requestCount; r++) {
+    char method[8] = "POST";
+    const char *path = requests[r];
+    if (path[0] != '/') {
+      sscanf(path, "%7s", method);
+      path += strcspn(path, " ");
+      path += strspn(path, " ");
+    }
+    status = httpRequest(n->name, method, path, NULL, 0, resp, sizeof(resp), 10);
+    printf("%s: %s %s: %d %s\n", n->name, method, path, status, resp);
+    if (status != 200) return 1;
+  }
+  return 0;
+}
+
+static void uploadResult(Node *n, int status) {
+  n->ok = status == 0;
+}
+
+//Waits for the node to come back after the reboot with the partition flipped, or with the same
+//one after a reset for an espfs image. The node reboots 2 s after the request, until it has been
+//seen down, an answer from the old firmware doesn't tell anything.
+static int waitBack(Node *n, long start) {
+  int expect = espfs ? n->next : 3 - n->next;
+  int down = 0;
+  sleep(2);
+  while (now() - start < rebootTimeout * 1000L) {
+    int next = flashNext(n->name, 2);
+    if (next == expect && (down || !espfs || now() - start > 5000)) {
+      printf("%s: back in %ld ms\n", n->name, now() - start);
+      return 0;
+    }
+    if (next != 0 && down) {
+      printf("%s: came back with the old firmware\n", n->name);
+      return 1;
+    }
+    if (next == 0) down = 1;
+    usleep(500000);
+  }
+  printf("%s: didn't come back within %d s\n", n->name, rebootTimeout);
+  return 1;
+}
+
+static int rebootWork(Node *n) {
+  long start = now();
+  int status = httpRequest(n->name, "GET", espfs ? "/log/reset" : "/flash/reboot", NULL, 0,
+      NULL, 0, 10);
+  // the node may go away before it answers
+  if (status != 200 && status != -1) {
+    printf("%s: reboot refused (%d)\n", n->name, status);
+    return 1;
+  }
+  return waitBack(n, start);
+}
+
+//Reboots the nodes in groups, the next group only after all of the previous are back
+static int rebootGroups(void) {
+  Node all[MAX_NODES];
+  int allCount = nodeCount, failed = 0;
+  memcpy(all, nodes, sizeof(Node) * nodeCount);
+  for (int g = 0; g < allCount && !failed; ) {
+    // forEachNode works on nodes, which gets the next group of flashed nodes
+    nodeCount = 0;
+    for (; g < allCount && nodeCount < groupSize; g++) {
+      if (all[g].ok) nodes[nodeCount++] = all[g];
+    }
+    if (nodeCount == 0) break;
+    printf("rebooting");
+    for (int i = 0; i < nodeCount; i++) printf(" %s", nodes[i].name);
+    printf("\n");
+    forEachNode(groupSize, rebootWork, uploadResult);
+    for (int i = 0; i < nodeCount; i++) {
+      if (!nodes[i].ok) failed = 1;
+      for (int j = 0; j < allCount; j++) {
+        if (strcmp(all[j].name, nodes[i].name) == 0) all[j].ok = nodes[i].ok;
+      }
+    }
+    if (failed) printf("stopping, the remaining nodes keep their firmware\n");
+    else if (g < allCount) sleep(groupWait);
+  }
+  memcpy(nodes, all, sizeof(Node) * allCount);
+  nodeCount = allCount;
+  return failed;
+}
+
+static char *readFile(const char *path, int *len) {
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(path);
+    exit(1);
+  }
+  char *data = malloc(st.st_size);
+  if (read(fd, data, st.st_size) != st.st_size) {
+    perror(path);
+    exit(1);
+  }
+  close(fd);
+  *len = st.st_size;
+  return data;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-a] [-m] [-s range] [-b broadcast] [-j uploads] [-r retries] "
+      "[-g group]\n       [-w seconds] [-t seconds] [-p request]... [-e espfs.img] [-n] "
+      "[node...] [user1.bin user2.bin]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int artPoll = 0, mdns = 0, dryRun = 0, c;
+  const char *broadcast = "255.255.255.255";
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  while ((c = getopt(argc, argv, "ab:e:g:j:mnp:r:s:t:w:")) != -1) {
+    switch (c) {
+    case 'a': artPoll = 1; break;
+    case 'b': broadcast = optarg; break;
+    case 'e': image[0] = readFile(optarg, &imageLen[0]); espfs = 1; break;
+    case 'g': groupSize = atoi(optarg); break;
+    case 'j': uploads = atoi(optarg); break;
+    case 'm': mdns = 1; break;
+    case 'n': dryRun = 1; break;
+    case 'p':
+      if (requestCount == 16) usage(argv[0]);
+      requests[requestCount++] = optarg;
+      break;
+    case 'r': retries = atoi(optarg); break;
+    case 's': probeRange(optarg); break;
+    case 't': rebootTimeout = atoi(optarg); break;
+    case 'w': groupWait = atoi(optarg); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (uploads < 1 || groupSize < 1) usage(argv[0]);
+
+  // the last two arguments are the firmware, if they are files
+  int last = argc;
+  if (!espfs && argc - optind >= 2 && access(argv[argc - 1], R_OK) == 0 &&
+      access(argv[argc - 2], R_OK) == 0) {
+    image[0] = readFile(argv[argc - 2], &imageLen[0]);
+    image[1] = readFile(argv[argc - 1], &imageLen[1]);
+    last = argc - 2;
+  }
+  for (int i = optind; i < last; i++) addNode(argv[i]);
+  if (artPoll) discoverArtPoll(broadcast);
+  if (mdns) discoverMdns();
+  if (nodeCount == 0) {
+    fprintf(stderr, "no nodes\n");
+    return 1;
+  }
+  if (image[0] == NULL && requestCount == 0) dryRun = 1;
+
+  // check all nodes first, the ones, which aren't an esp-link, are dropped
+  forEachNode(32, checkWork, checkResult);
+  int n = 0;
+  for (int i = 0; i < nodeCount; i++) {
+    if (nodes[i].next != 0) nodes[n++] = nodes[i];
+  }
+  int skipped = nodeCount - n;
+  nodeCount = n;
+  if (dryRun || nodeCount == 0) return skipped > 0 || nodeCount == 0;
+
+  long start = now();
+  forEachNode(uploads, uploadWork, uploadResult);
+  int failed = 0;
+  if (image[0] != NULL) failed = rebootGroups();
+
+  int ok = 0;
+  for (int i = 0; i < nodeCount; i++) ok += nodes[i].ok;
+  printf("%d of %d nodes done in %ld s", ok, nodeCount + skipped, (now() - start) / 1000);
+  for (int i = 0; i < nodeCount; i++) {
+    if (!nodes[i].ok) printf(", %s failed", nodes[i].name);
+  }
+  printf("%s\n", failed ? ", rollout stopped" : "");
+  return ok == nodeCount + skipped ? 0 : 1;
+}
@@ -22,25 +22,59 @@ function updateText(resp) {
   var delay = 3000;
   if (resp != null && resp.len > 0) {
 //    console.log("updateText got", resp.len, "chars at", resp.start);
-    var isScrolledToBottom = el.scrollHeight - el.clientHeight <= el.scrollTop + 1;
-    //console.log("isScrolledToBottom="+isScrolledToBottom, "scrollHeight="+el.scrollHeight,
-    //            "clientHeight="+el.clientHeight, "scrollTop="+el.scrollTop,
-    //            "" + (el.scrollHeight - el.clientHeight) + "<=" + (el.scrollTop + 1));
-
-    // append the text
     if (resp.start > el.textEnd) {
-      el.innerHTML = el.innerHTML.concat("\r\n<missing lines\r\n");
+      appendText("\r\n<missing lines\r\n");
     }
-    el.innerHTML = el.innerHTML.concat(resp.text);
+    appendText(resp.text);
     el.textEnd = resp.start + resp.len;
     delay = 500;
-
-    // scroll to bottom
-    if(isScrolledToBottom) el.scrollTop = el.scrollHeight - el.clientHeight;
   }
   return delay;
 }
 
+function appendText(text) {
+  var el = $("#console");
+  var isScrolledToBottom = el.scrollHeight - el.clientHeight <= el.scrollTop + 1;
+  //console.log("isScrolledToBottom="+isScrolledToBottom, "scrollHeight="+el.scrollHeight,
+  //            "clientHeight="+el.clientHeight, "scrollTop="+el.scrollTop,
+  //            "" + (el.scrollHeight - el.clientHeight) + "<=" + (el.scrollTop + 1));
+
+  // append the text
+  el.innerHTML = el.innerHTML.concat(text);
+
+  // scroll to bottom
+  if(isScrolledToBottom) el.scrollTop = el.scrollHeight - el.clientHeight;
+}
+
+// follow the text with the Server-Sent Events stream next to console_url (".../stream"), the
+// id of each event is the text position after it. Falls back to polling if the browser or
+// the esp-link doesn't support it, returns false if the browser doesn't.
+function streamText(repeat) {
+  var el = $("#console");
+  if (typeof EventSource == "undefined") {
+    fetchText(100, repeat);
+    return false;
+  }
+  if (el.textEnd == undefined) {
+    el.textEnd = 0;
+    el.innerHTML = "";
+  }
+  var opened = false;
+  var es = new EventSource(console_url.replace(/text$/, "stream") + "?start=" + el.textEnd);
+  es.onopen = function() { opened = true; };
+  es.onmessage = function(e) {
+    appendText(e.data);
+    el.textEnd = parseInt(e.lastEventId, 10);
+  };
+  // once open, the browser reconnects by itself
+  es.onerror = function() {
+    if (opened) return;
+    es.close();
+    fetchText(1000, repeat);
+  };
+  return true;
+}
+
 function retryLoad(repeat) {
   fetchText(1000, repeat);
 }
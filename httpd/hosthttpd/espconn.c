@@ -0,0 +1,345 @@
+/*
+Host replacement of the SDK's espconn TCP server functions on top of non-blocking BSD sockets
+and an epoll loop. Only what httpd uses is there.
+
+The SDK behaviour, which httpd depends on, is kept:
+- callbacks are never called from within espconn_* calls, but from the loop
+- espconn_sent copies the data, the sent callback follows, when it has been written
+- a second espconn_sent before the sent callback fails
+- espconn_disconnect closes, after the pending data has been written, and the disconnect
+  callback follows
+- received data is passed in pieces of at most one TCP segment (1460 bytes)
+- espconn_tcp_set_max_con_allow closes further connections at once, so httpd never sees them
+*/
+
+#define _GNU_SOURCE
+#include <esp8266.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "host.h"
+
+//Size of the pieces passed to the receive callback, the TCP MSS of lwip
+#define HOST_RECV_LEN 1460
+
+typedef struct HostConn {
+  struct espconn conn;          // passed to the callbacks
+  esp_tcp tcp;
+  int fd;
+  char *out;                    // data of espconn_sent, which hasn't been written yet
+  int outLen;
+  int outPos;
+  bool sentPending;             // the sent callback is due
+  bool sending;                 // between espconn_sent and its sent callback
+  bool closing;                 // espconn_disconnect has been called
+  bool dead;                    // the socket has been closed, the callback is due
+  sint8 err;                    // reported with the reconnect callback, 0 for a disconnect
+  uint32_t timeout;             // idle timeout in ms, 0 for none
+  uint32_t lastActive;
+  struct HostConn *next;
+} HostConn;
+
+HostStats hostStats;
+
+static struct espconn *listenConn;
+static int listenFd = -1;
+static int epollFd = -1;
+static int maxConnAllow = 5; // default of the SDK
+static int openConns;
+static HostConn *conns;
+static bool stopLoop;
+
+static HostConn *hostConn(struct espconn *conn) {
+  for (HostConn *hc = conns; hc != NULL; hc = hc->next) {
+    if (&hc->conn == conn) return hc;
+  }
+  return NULL;
+}
+
+static void hostWatch(HostConn *hc, bool out) {
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLRDHUP | (out ? EPOLLOUT : 0);
+  ev.data.ptr = hc;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, hc->fd, &ev);
+}
+
+//Closes the socket, the disconnect or reconnect callback is called by hostDispatch
+static void hostClose(HostConn *hc, sint8 err) {
+  if (hc->dead) return;
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, hc->fd, NULL);
+  close(hc->fd);
+  hc->fd = -1;
+  hc->dead = true;
+  hc->err = err;
+  openConns--;
+}
+
+//Writes as much of the pending data as the socket takes
+static void hostFlush(HostConn *hc) {
+  while (hc->outPos < hc->outLen) {
+    ssize_t n = send(hc->fd, hc->out + hc->outPos, hc->outLen - hc->outPos, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        hostWatch(hc, true);
+        return;
+      }
+      hostStats.resets++;
+      hostClose(hc, ESPCONN_RST);
+      return;
+    }
+    hc->outPos += n;
+    hostStats.bytesOut += n;
+  }
+  free(hc->out);
+  hc->out = NULL;
+  hc->outLen = hc->outPos = 0;
+  hostWatch(hc, false);
+  if (hc->sending) hc->sentPending = true;
+  if (hc->closing) {
+    hostStats.closedLocal++;
+    hostClose(hc, 0);
+  }
+}
+
+static void hostAccept(void) {
+  for (;;) {
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    int fd = accept4(listenFd, (struct sockaddr *)&addr, &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+    if (openConns >= maxConnAllow) {
+      hostStats.refused++;
+      close(fd);
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    HostConn *hc = calloc(1, sizeof(HostConn));
+    hc->fd = fd;
+    hc->conn.type = ESPCONN_TCP;
+    hc->conn.state = ESPCONN_CONNECT;
+    hc->conn.proto.tcp = &hc->tcp;
+    hc->tcp.local_port = listenConn->proto.tcp->local_port;
+    hc->tcp.remote_port = ntohs(addr.sin_port);
+    memcpy(hc->tcp.remote_ip, &addr.sin_addr.s_addr, 4);
+    hc->lastActive = hostMillis();
+    hc->next = conns;
+    conns = hc;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = hc;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+
+    openConns++;
+    hostStats.accepted++;
+    if (openConns > hostStats.maxOpen) hostStats.maxOpen = openConns;
+    if (listenConn->proto.tcp->connect_callback) listenConn->proto.tcp->connect_callback(&hc->conn);
+  }
+}
+
+static void hostRecv(HostConn *hc) {
+  char buff[HOST_RECV_LEN];
+  ssize_t n = recv(hc->fd, buff, sizeof(buff), 0);
+  if (n > 0) {
+    hostStats.bytesIn += n;
+    hc->lastActive = hostMillis();
+    // data, which arrives after espconn_disconnect, is dropped like lwip does
+    if (!hc->closing && hc->conn.recv_callback) hc->conn.recv_callback(&hc->conn, buff, n);
+  } else if (n == 0) {
+    hostStats.closedRemote++;
+    hostClose(hc, 0);
+  } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+    hostStats.resets++;
+    hostClose(hc, ESPCONN_RST);
+  }
+}
+
+//Calls the sent, disconnect and reconnect callbacks, which are due, and frees closed connections
+static void hostDispatch(void) {
+  bool again = true;
+  while (again) {
+    again = false;
+    for (HostConn **p = &conns; *p != NULL; ) {
+      HostConn *hc = *p;
+      if (hc->dead) {
+        *p = hc->next;
+        free(hc->out);
+        if (hc->err != 0) {
+          if (hc->tcp.reconnect_callback) hc->tcp.reconnect_callback(&hc->conn, hc->err);
+        } else {
+          if (hc->tcp.disconnect_callback) hc->tcp.disconnect_callback(&hc->conn);
+        }
+        free(hc);
+        again = true;
+        continue;
+      }
+      if (hc->sentPending) {
+        hc->sentPending = false;
+        hc->sending = false;
+        if (hc->conn.sent_callback) hc->conn.sent_callback(&hc->conn);
+        again = true;
+      }
+      p = &hc->next;
+    }
+  }
+}
+
+static void hostCheckTimeouts(void) {
+  uint32_t now = hostMillis();
+  for (HostConn *hc = conns; hc != NULL; hc = hc->next) {
+    if (!hc->dead && hc->timeout != 0 && now - hc->lastActive > hc->timeout) {
+      hostStats.timeouts++;
+      hostClose(hc, 0);
+    }
+  }
+}
+
+void hostStop(void) {
+  stopLoop = true;
+}
+
+void hostLoop(void) {
+  struct epoll_event events[64];
+  stopLoop = false;
+  while (!stopLoop) {
+    int wait = hostRunTimers();
+    hostDispatch();
+    if (wait < 0 || wait > 100) wait = 100; // for the idle timeouts
+    int n = epoll_wait(epollFd, events, 64, wait);
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.ptr == NULL) {
+        hostAccept();
+        continue;
+      }
+      HostConn *hc = events[i].data.ptr;
+      if (hc->dead) continue;
+      if (events[i].events & EPOLLOUT) hostFlush(hc);
+      if (!hc->dead && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+        hostRecv(hc);
+      }
+    }
+    // closed connections are freed by hostDispatch, so it runs after the events
+    hostDispatch();
+    hostCheckTimeouts();
+  }
+}
+
+int hostListening(void) {
+  return listenFd >= 0 && epollFd >= 0;
+}
+
+sint8 espconn_accept(struct espconn *espconn) {
+  struct sockaddr_in addr;
+  int one = 1;
+  listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd < 0) return ESPCONN_MEM;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(espconn->proto.tcp->local_port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 64) < 0) {
+    perror("espconn_accept");
+    close(listenFd);
+    listenFd = -1;
+    return ESPCONN_ISCONN;
+  }
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0) {
+    perror("espconn_accept");
+    return ESPCONN_MEM;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+  listenConn = espconn;
+  espconn->state = ESPCONN_LISTEN;
+  return ESPCONN_OK;
+}
+
+sint8 espconn_sent(struct espconn *espconn, uint8 *psent, uint16 length) {
+  HostConn *hc = hostConn(espconn);
+  if (hc == NULL || hc->dead || hc->closing) return ESPCONN_ARG;
+  if (hc->sending) {
+    hostStats.sendBusy++;
+    return ESPCONN_MAXNUM;
+  }
+  hc->out = malloc(length);
+  memcpy(hc->out, psent, length);
+  hc->outLen = length;
+  hc->outPos = 0;
+  hc->sending = true;
+  hc->lastActive = hostMillis();
+  hostFlush(hc);
+  return ESPCONN_OK;
+}
+
+sint8 espconn_disconnect(struct espconn *espconn) {
+  HostConn *hc = hostConn(espconn);
+  if (hc == NULL) return ESPCONN_ARG;
+  if (hc->closing || hc->dead) return ESPCONN_OK;
+  hc->closing = true;
+  if (hc->out == NULL) {
+    hostStats.closedLocal++;
+    hostClose(hc, 0);
+  }
+  return ESPCONN_OK;
+}
+
+sint8 espconn_delete(struct espconn *espconn) {
+  return espconn_disconnect(espconn);
+}
+
+sint8 espconn_regist_connectcb(struct espconn *espconn, espconn_connect_callback connect_cb) {
+  espconn->proto.tcp->connect_callback = connect_cb;
+  return ESPCONN_OK;
+}
+
+sint8 espconn_regist_recvcb(struct espconn *espconn, espconn_recv_callback recv_cb) {
+  espconn->recv_callback = recv_cb;
+  return ESPCONN_OK;
+}
+
+sint8 espconn_regist_reconcb(struct espconn *espconn, espconn_reconnect_callback recon_cb) {
+  espconn->proto.tcp->reconnect_callback = recon_cb;
+  return ESPCONN_OK;
+}
+
+sint8 espconn_regist_disconcb(struct espconn *espconn, espconn_connect_callback discon_cb) {
+  espconn->proto.tcp->disconnect_callback = discon_cb;
+  return ESPCONN_OK;
+}
+
+sint8 espconn_regist_sentcb(struct espconn *espconn, espconn_sent_callback sent_cb) {
+  espconn->sent_callback = sent_cb;
+  return ESPCONN_OK;
+}
+
+//Only the per connection timeout (type_flag 1) is supported
+sint8 espconn_regist_time(struct espconn *espconn, uint32 interval, uint8 type_flag) {
+  HostConn *hc = hostConn(espconn);
+  if (hc == NULL) return ESPCONN_ARG;
+  hc->timeout = interval * 1000;
+  hc->lastActive = hostMillis();
+  return ESPCONN_OK;
+}
+
+sint8 espconn_set_opt(struct espconn *espconn, uint8 opt) {
+  return ESPCONN_OK;
+}
+
+sint8 espconn_tcp_set_max_con_allow(struct espconn *espconn, uint8 num) {
+  maxConnAllow = num;
+  return ESPCONN_OK;
+}
+
+sint8 espconn_tcp_get_max_con_allow(struct espconn *espconn) {
+  return maxConnAllow;
+}
@@ -0,0 +1,44 @@
+// Interface of the host build between the SDK replacement, the espconn shim and main
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+//Counters of the espconn shim, printed by hosthttpd on exit and on SIGUSR1
+typedef struct {
+  uint32_t accepted;      // connections passed to the connect callback
+  uint32_t refused;       // connections closed at once, espconn_tcp_set_max_con_allow reached
+  uint32_t maxOpen;       // max number of open connections at the same time
+  uint32_t closedLocal;   // connections closed by espconn_disconnect
+  uint32_t closedRemote;  // connections closed by the client
+  uint32_t resets;        // connections reset, reported with the reconnect callback
+  uint32_t timeouts;      // idle connections closed after espconn_regist_time
+  uint32_t sendBusy;      // espconn_sent called before the sent callback
+  uint64_t bytesIn;
+  uint64_t bytesOut;
+} HostStats;
+
+extern HostStats hostStats;
+
+//Milliseconds since the start of the process
+uint32_t hostMillis(void);
+
+//Returns 1, if espconn_accept has opened the listen socket
+int hostListening(void);
+
+//Runs the event loop until hostStop is called
+void hostLoop(void);
+void hostStop(void);
+
+//Runs the timers, which are due, returns the ms until the next one or -1
+int hostRunTimers(void);
+
+//Emulated flash, see sdk.c
+int hostFlashOpen(const char *path, uint32_t size);
+void hostFlashSave(void);
+
+//Set by system_restart and system_restart_enhance, the address of the firmware to boot
+extern uint32_t hostRebootAddr;
+extern int hostRebootRequested;
+
+#endif
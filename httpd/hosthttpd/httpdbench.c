@@ -0,0 +1,535 @@
+/*
+Load generator for httpd: runs a number of concurrent clients against hosthttpd (or a device)
+and reports the requests per second, the latency distribution and the failed requests, e.g.
+connections closed without a response, because the connection pool (MAX_CONN) was full.
+
+Usage: httpdbench [-H host[:port]] [-c clients] [-n requests | -d seconds] [-k] [-0] [-t timeout]
+                  [-s session] [path...]
+  -H  server, default 127.0.0.1:8080
+  -c  number of concurrent clients, default 4
+  -n  total number of requests, default 1000
+  -d  run for this many seconds instead of a number of requests
+  -k  keep the connections open between requests, default is a connection per request
+  -0  send HTTP/1.0 requests, with -k a connection is only reused when the response confirms
+      it with Connection: keep-alive
+  -t  timeout of a request in seconds, default 10
+  -s  replay a recorded session, every client runs through it in a loop
+  path  requested round robin by the clients, default /
+
+A session file has one request per line: an optional delay in ms after the previous response,
+the method, the path and for a POST the name of a file with the body, e.g.
+  GET /home.html
+  +20 GET /menu
+  +500 POST /flash/upload user1.bin
+Lines starting with # are skipped. A browser session can be recorded with the network tab of the
+developer tools and saved as HAR, which can be turned into a session with jq:
+  jq -r '.log.entries[].request | "\(.method) \(.url | sub("^https?://[^/]*"; ""))"' s.har
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  int delay;          // ms to wait before sending the request
+  char method[8];
+  char *path;
+  char *body;         // POST data
+  int bodyLen;
+} Request;
+
+enum { ST_IDLE, ST_WAIT, ST_CONNECTING, ST_SENDING, ST_HEAD, ST_BODY, ST_CHUNK, ST_CLOSE };
+
+typedef struct {
+  int fd;
+  int state;
+  int next;           // index of the next request
+  int reused;         // the connection has carried a response before
+  char *out;          // request being sent
+  int outLen, outPos;
+  char head[4096];    // response head
+  int headLen;
+  int status;
+  long remaining;     // body bytes or bytes of the current chunk still to come
+  int chunkState;     // 0 size line, 1 data, 2 crlf after data, 3 trailer
+  char line[32];
+  int lineLen;
+  uint64_t start;     // time the request was started, us
+  uint64_t wakeup;    // time to send the next request in ST_WAIT
+} Client;
+
+static Request *reqs;
+static int reqCount;
+static struct sockaddr_in server;
+static char hostHeader[128];
+static int epollFd;
+static int keepAlive;
+static int http10;
+static long maxRequests = 1000;
+static double duration;
+static int timeoutMs = 10000;
+
+// results
+static long started, done;
+static uint32_t *latencies; // us
+static long latCount, latCap;
+static long statusCount[6];
+static long errConnect, errClosed, errTimeout, errBad;
+static long retries, connects;
+static uint64_t bytesRead;
+
+static uint64_t nowUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void addRequest(const char *method, const char *path, const char *bodyFile, int delay) {
+  reqs = realloc(reqs, (reqCount + 1) * sizeof(Request));
+  Request *r = &reqs[reqCount++];
+  memset(r, 0, sizeof(Request));
+  r->delay = delay;
+  snprintf(r->method, sizeof(r->method), "%s", method);
+  r->path = strdup(path);
+  if (bodyFile == NULL) return;
+  FILE *f = fopen(bodyFile, "rb");
+  if (f == NULL) {
+    perror(bodyFile);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  r->bodyLen = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  r->body = malloc(r->bodyLen);
+  if (fread(r->body, 1, r->bodyLen, f) != (size_t)r->bodyLen) {
+    perror(bodyFile);
+    exit(1);
+  }
+  fclose(f);
+}
+
+static void readSession(const char *path) {
+  FILE *f = fopen(path, "r");
+  char line[1024];
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char *tok[4];
+    int n = 0, delay = 0;
+    char *save;
+    for (char *t = strtok_r(line, " \t\r\n", &save); t && n < 4; t = strtok_r(NULL, " \t\r\n", &save))
+      tok[n++] = t;
+    if (n == 0 || tok[0][0] == '#') continue;
+    int i = 0;
+    if (tok[0][0] == '+') delay = atoi(tok[i++] + 1);
+    if (n - i < 2) {
+      fprintf(stderr, "%s: bad line %s\n", path, tok[0]);
+      exit(1);
+    }
+    addRequest(tok[i], tok[i + 1], n - i > 2 ? tok[i + 2] : NULL, delay);
+  }
+  fclose(f);
+}
+
+static void watch(Client *c, int op, uint32_t events) {
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.ptr = c;
+  epoll_ctl(epollFd, op, c->fd, &ev);
+}
+
+static void closeClient(Client *c) {
+  if (c->fd >= 0) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+  }
+  c->fd = -1;
+  c->reused = 0;
+}
+
+static int finished(void) {
+  if (duration > 0) return 0; // ended by the main loop
+  return started >= maxRequests;
+}
+
+static void startRequest(Client *c);
+
+static void connectClient(Client *c) {
+  c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  connects++;
+  int one = 1;
+  setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(c->fd, (struct sockaddr *)&server, sizeof(server)) < 0 && errno != EINPROGRESS) {
+    errConnect++;
+    closeClient(c);
+    c->state = ST_IDLE;
+    return;
+  }
+  c->state = ST_CONNECTING;
+  watch(c, EPOLL_CTL_ADD, EPOLLOUT);
+}
+
+//Sends the next request, connecting first if necessary
+static void startRequest(Client *c) {
+  Request *r = &reqs[c->next];
+  if (c->state != ST_SENDING || c->out == NULL) {
+    free(c->out);
+    c->out = malloc(512 + strlen(r->path) + r->bodyLen);
+    c->outLen = sprintf(c->out, "%s %s HTTP/1.%d\r\nHost: %s\r\n%s", r->method, r->path,
+        http10 ? 0 : 1, hostHeader, !keepAlive ? "Connection: close\r\n" :
+        http10 ? "Connection: keep-alive\r\n" : "");
+    if (r->body != NULL) {
+      c->outLen += sprintf(c->out + c->outLen, "Content-Length: %d\r\n", r->bodyLen);
+    }
+    c->outLen += sprintf(c->out + c->outLen, "\r\n");
+    if (r->body != NULL) {
+      memcpy(c->out + c->outLen, r->body, r->bodyLen);
+      c->outLen += r->bodyLen;
+    }
+    c->outPos = 0;
+    c->start = nowUs();
+  }
+  c->headLen = 0;
+  c->status = 0;
+  if (c->fd < 0) {
+    c->state = ST_SENDING;
+    connectClient(c);
+    return;
+  }
+  c->state = ST_SENDING;
+  watch(c, EPOLL_CTL_MOD, EPOLLOUT);
+}
+
+//Schedules the next request of the client
+static void nextRequest(Client *c) {
+  if (finished()) {
+    closeClient(c);
+    c->state = ST_IDLE;
+    return;
+  }
+  started++;
+  int delay = reqs[c->next].delay;
+  free(c->out);
+  c->out = NULL;
+  c->state = ST_WAIT;
+  c->wakeup = nowUs() + delay * 1000ULL;
+  if (delay == 0) startRequest(c);
+}
+
+static void responseDone(Client *c, int keep) {
+  uint64_t lat = nowUs() - c->start;
+  if (latCount == latCap) {
+    latCap = latCap ? latCap * 2 : 4096;
+    latencies = realloc(latencies, latCap * sizeof(uint32_t));
+  }
+  latencies[latCount++] = lat;
+  int cls = c->status / 100;
+  statusCount[cls >= 1 && cls <= 5 ? cls : 0]++;
+  done++;
+  c->next = (c->next + 1) % reqCount;
+  if (keep) {
+    c->reused = 1;
+    watch(c, EPOLL_CTL_MOD, EPOLLIN);
+  } else {
+    closeClient(c);
+  }
+  nextRequest(c);
+}
+
+static void failRequest(Client *c, long *counter) {
+  (*counter)++;
+  done++;
+  closeClient(c);
+  c->next = (c->next + 1) % reqCount;
+  nextRequest(c);
+}
+
+static const char *findHeader(Client *c, const char *name) {
+  int n = strlen(name);
+  for (char *p = strstr(c->head, "\r\n"); p != NULL; p = strstr(p + 2, "\r\n")) {
+    if (strncasecmp(p + 2, name, n) == 0 && p[2 + n] == ':') {
+      const char *v = p + 3 + n;
+      while (*v == ' ') v++;
+      return v;
+    }
+  }
+  return NULL;
+}
+
+//Whether the connection stays open after the response, an HTTP/1.0 client like -0 closes it
+//unless the server confirms the keep-alive
+static int keepResponse(Client *c) {
+  const char *conn = findHeader(c, "Connection");
+  if (!keepAlive) return 0;
+  if (http10) return conn != NULL && strncasecmp(conn, "keep-alive", 10) == 0;
+  return !(conn != NULL && strncasecmp(conn, "close", 5) == 0);
+}
+
+//Parses the response head and sets up reading the body
+static void parseHead(Client *c) {
+  if (sscanf(c->head, "HTTP/1.%*d %d", &c->status) != 1) {
+    failRequest(c, &errBad);
+    return;
+  }
+  const char *te = findHeader(c, "Transfer-Encoding");
+  const char *cl = findHeader(c, "Content-Length");
+  if (te != NULL && strncasecmp(te, "chunked", 7) == 0) {
+    c->state = ST_CHUNK;
+    c->chunkState = 0;
+    c->lineLen = 0;
+  } else if (cl != NULL) {
+    c->state = ST_BODY;
+    c->remaining = atol(cl);
+  } else if (c->status == 204 || c->status == 304 || c->status == 101) {
+    c->state = ST_BODY;
+    c->remaining = 0;
+  } else {
+    c->state = ST_CLOSE;
+  }
+}
+
+//Feeds received body data, returns the bytes used, -1 when the response is complete
+static int feedBody(Client *c, const char *data, int len) {
+  int used = 0;
+  if (c->state == ST_BODY) {
+    int n = len < c->remaining ? len : c->remaining;
+    c->remaining -= n;
+    if (c->remaining == 0) return -1;
+    return n;
+  }
+  if (c->state == ST_CLOSE) return len;
+  while (used < len) {
+    char ch = data[used];
+    if (c->chunkState == 1) {
+      int n = len - used < c->remaining ? len - used : c->remaining;
+      used += n;
+      c->remaining -= n;
+      if (c->remaining == 0) c->chunkState = 2;
+      continue;
+    }
+    used++;
+    if (ch != '\n') {
+      if (ch != '\r' && c->lineLen < (int)sizeof(c->line) - 1) c->line[c->lineLen++] = ch;
+      continue;
+    }
+    c->line[c->lineLen] = 0;
+    if (c->chunkState == 0) {
+      c->remaining = strtol(c->line, NULL, 16);
+      c->chunkState = c->remaining > 0 ? 1 : 3;
+    } else if (c->chunkState == 2) {
+      c->chunkState = 0;
+    } else if (c->lineLen == 0) {
+      return -1; // empty line after the last chunk
+    }
+    c->lineLen = 0;
+  }
+  return used;
+}
+
+static void onReadable(Client *c) {
+  char buff[16384];
+  ssize_t n = recv(c->fd, buff, sizeof(buff), 0);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+  if (n <= 0) {
+    if (c->state == ST_CLOSE) {
+      responseDone(c, 0);
+    } else if (c->state == ST_HEAD && c->headLen == 0 && c->reused) {
+      // the server closed the idle keep-alive connection, that's no error
+      retries++;
+      closeClient(c);
+      startRequest(c);
+    } else if (c->state == ST_HEAD || c->state == ST_BODY || c->state == ST_CHUNK) {
+      failRequest(c, &errClosed);
+    } else {
+      closeClient(c);
+    }
+    return;
+  }
+  bytesRead += n;
+  int pos = 0;
+  if (c->state == ST_HEAD) {
+    int space = sizeof(c->head) - 1 - c->headLen;
+    int take = n < space ? n : space;
+    memcpy(c->head + c->headLen, buff, take);
+    c->headLen += take;
+    c->head[c->headLen] = 0;
+    char *end = strstr(c->head, "\r\n\r\n");
+    if (end == NULL) {
+      if (c->headLen == (int)sizeof(c->head) - 1) failRequest(c, &errBad);
+      return;
+    }
+    int headBytes = end + 4 - c->head;
+    pos = take - (c->headLen - headBytes);
+    parseHead(c);
+    if (c->state == ST_BODY && c->remaining == 0) {
+      responseDone(c, keepResponse(c));
+      return;
+    }
+    if (c->state == ST_HEAD || c->state == ST_IDLE) return;
+  }
+  while (pos < n) {
+    int used = feedBody(c, buff + pos, n - pos);
+    if (used < 0) {
+      responseDone(c, keepResponse(c));
+      return;
+    }
+    pos += used;
+  }
+}
+
+static void onWritable(Client *c) {
+  if (c->state == ST_CONNECTING) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+      failRequest(c, &errConnect);
+      return;
+    }
+    c->state = ST_SENDING;
+  }
+  while (c->outPos < c->outLen) {
+    ssize_t n = send(c->fd, c->out + c->outPos, c->outLen - c->outPos, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+      if (c->reused && c->outPos == 0) {
+        retries++;
+        closeClient(c);
+        startRequest(c);
+      } else {
+        failRequest(c, &errClosed);
+      }
+      return;
+    }
+    c->outPos += n;
+  }
+  c->state = ST_HEAD;
+  watch(c, EPOLL_CTL_MOD, EPOLLIN);
+}
+
+static int compareU32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static double percentile(double p) {
+  if (latCount == 0) return 0;
+  long i = (long)(p / 100.0 * (latCount - 1) + 0.5);
+  return latencies[i] / 1000.0;
+}
+
+int main(int argc, char **argv) {
+  int clients = 4;
+  char *host = "127.0.0.1:8080";
+  char *session = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "H:c:n:d:k0t:s:")) != -1) {
+    switch (opt) {
+    case 'H': host = optarg; break;
+    case 'c': clients = atoi(optarg); break;
+    case 'n': maxRequests = atol(optarg); break;
+    case 'd': duration = atof(optarg); break;
+    case 'k': keepAlive = 1; break;
+    case '0': http10 = 1; break;
+    case 't': timeoutMs = atof(optarg) * 1000; break;
+    case 's': session = optarg; break;
+    default:
+      fprintf(stderr, "Usage: %s [-H host[:port]] [-c clients] [-n requests | -d seconds] [-k] [-0] "
+          "[-t timeout] [-s session] [path...]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (session != NULL) readSession(session);
+  for (int i = optind; i < argc; i++) addRequest("GET", argv[i], NULL, 0);
+  if (reqCount == 0) addRequest("GET", "/", NULL, 0);
+  if (clients < 1) clients = 1;
+
+  char name[128];
+  int port = 8080;
+  snprintf(name, sizeof(name), "%s", host);
+  char *colon = strchr(name, ':');
+  if (colon != NULL) {
+    *colon = 0;
+    port = atoi(colon + 1);
+  }
+  struct hostent *he = gethostbyname(name);
+  if (he == NULL) {
+    fprintf(stderr, "unknown host %s\n", name);
+    return 1;
+  }
+  memset(&server, 0, sizeof(server));
+  server.sin_family = AF_INET;
+  server.sin_port = htons(port);
+  memcpy(&server.sin_addr, he->h_addr_list[0], 4);
+  snprintf(hostHeader, sizeof(hostHeader), "%s", host);
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  Client *cl = calloc(clients, sizeof(Client));
+  uint64_t t0 = nowUs();
+  for (int i = 0; i < clients; i++) {
+    cl[i].fd = -1;
+    // session replays start at the beginning, path lists are spread over the clients
+    cl[i].next = session != NULL ? 0 : i % reqCount;
+    nextRequest(&cl[i]);
+  }
+
+  struct epoll_event events[256];
+  for (;;) {
+    uint64_t now = nowUs();
+    if (duration > 0 && now - t0 >= duration * 1e6) break;
+    int active = 0;
+    for (int i = 0; i < clients; i++) {
+      Client *c = &cl[i];
+      if (c->state == ST_IDLE) continue;
+      active++;
+      if (c->state == ST_WAIT) {
+        if (now >= c->wakeup) startRequest(c);
+      } else if (now - c->start > (uint64_t)timeoutMs * 1000) {
+        failRequest(c, &errTimeout);
+      }
+    }
+    if (active == 0) break;
+    int n = epoll_wait(epollFd, events, 256, 10);
+    for (int i = 0; i < n; i++) {
+      Client *c = events[i].data.ptr;
+      if (c->fd < 0) continue;
+      if (c->state == ST_CONNECTING || c->state == ST_SENDING) {
+        if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) onWritable(c);
+      } else {
+        onReadable(c);
+      }
+    }
+  }
+  double secs = (nowUs() - t0) / 1e6;
+
+  qsort(latencies, latCount, sizeof(uint32_t), compareU32);
+  double sum = 0;
+  for (long i = 0; i < latCount; i++) sum += latencies[i];
+  printf("%ld requests in %.2fs, %d clients, %s%s\n", latCount, secs, clients,
+      http10 ? "HTTP/1.0 " : "", keepAlive ? "keep-alive" : "connection per request");
+  printf("requests/s: %.1f, read: %.1f KB/s\n", latCount / secs, bytesRead / 1024.0 / secs);
+  printf("latency ms: min %.2f, avg %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n",
+      percentile(0), latCount ? sum / latCount / 1000.0 : 0, percentile(50), percentile(90),
+      percentile(99), percentile(100));
+  printf("status: 2xx %ld, 3xx %ld, 4xx %ld, 5xx %ld, other %ld\n", statusCount[2],
+      statusCount[3], statusCount[4], statusCount[5], statusCount[0] + statusCount[1]);
+  printf("errors: %ld connect, %ld closed without response, %ld timeouts, %ld bad responses\n",
+      errConnect, errClosed, errTimeout, errBad);
+  printf("connections opened: %ld, closed keep-alive connections reopened: %ld\n", connects,
+      retries);
+  return errConnect + errClosed + errTimeout + errBad > 0 ? 2 : 0;
+}
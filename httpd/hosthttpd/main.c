@@ -0,0 +1,166 @@
+/*
+Host build of the esp-link web server: httpd, the espfs file system and the esp-link cgis,
+which don't need the WiFi, run on Linux on top of the espconn shim in espconn.c. It serves the
+same URLs as the firmware, so browsers, load generators (see httpdbench.c) and the flash tools
+can be pointed at it.
+
+Usage: hosthttpd [-p port] [-e espfs.img] [-f flash.bin] [-u 1|2]
+  -p  TCP port, default 8080
+  -e  espfs image to serve, build/espfs.img of the firmware build
+  -f  file with the emulated 4MB flash, it keeps the config and the uploaded firmware over
+      restarts, without it the flash is empty and kept in memory
+  -u  partition of the running firmware, /flash/next offers the other one. A reboot after a
+      firmware upload starts the process again with the other partition.
+
+SIGUSR1 prints the counters of the espconn shim, SIGINT/SIGTERM prints them and exits.
+*/
+
+#include <esp8266.h>
+#include <signal.h>
+#include <unistd.h>
+#include "httpd.h"
+#include "httpdespfs.h"
+#include "cgi.h"
+#include "cgiflash.h"
+#include "safeupgrade.h"
+#include "espfs.h"
+#include "config.h"
+#include "log.h"
+#include "host.h"
+
+#define USER1_BIN_ADDR 0x1000
+
+char *esp_link_version = "esp-link host build";
+
+extern uint32 *hostIrom;
+
+HttpdBuiltInUrl builtInUrls[] = {
+  { "/", cgiRedirect, "/home.html" },
+  { "/menu", cgiMenu, NULL },
+  { "/flash/next", cgiGetFirmwareNext, NULL },
+  { "/flash/upload", cgiUploadFirmware, NULL },
+  { "/flash/reboot", cgiRebootFirmware, NULL },
+  { "/log/reset", cgiReset, NULL },
+  { "/log/text", ajaxLog, NULL },
+  { "/log/dbg", ajaxLogDbg, NULL },
+  { "/log/stream", ajaxLogStream, NULL },
+  { "*", cgiEspFsHook, NULL }, //Catch-all cgi function for the filesystem
+  { NULL, NULL, NULL }
+};
+
+static volatile sig_atomic_t statsRequested;
+static volatile sig_atomic_t stopRequested;
+
+static void onSignal(int sig) {
+  if (sig == SIGUSR1) statsRequested = 1;
+  else stopRequested = 1;
+  hostStop();
+}
+
+static void printStats(void) {
+  fprintf(stderr, "connections: %u accepted, %u refused (pool full), %u max open\n",
+      hostStats.accepted, hostStats.refused, hostStats.maxOpen);
+  fprintf(stderr, "closed: %u by server, %u by client, %u resets, %u idle timeouts\n",
+      hostStats.closedLocal, hostStats.closedRemote, hostStats.resets, hostStats.timeouts);
+  fprintf(stderr, "bytes: %llu in, %llu out, espconn_sent while busy: %u\n",
+      (unsigned long long)hostStats.bytesIn, (unsigned long long)hostStats.bytesOut,
+      hostStats.sendBusy);
+}
+
+//Reads the espfs image into word aligned memory like the flash of the device
+static void *loadImage(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint32_t *image = calloc(1, (size + 3) & ~3);
+  if (fread(image, 1, size, f) != (size_t)size) {
+    perror(path);
+    free(image);
+    image = NULL;
+  }
+  fclose(f);
+  return image;
+}
+
+int main(int argc, char **argv) {
+  int port = 8080;
+  char *espfsPath = NULL;
+  char *flashPath = NULL;
+  int part = 1;
+  int c;
+
+  while ((c = getopt(argc, argv, "p:e:f:u:")) != -1) {
+    switch (c) {
+    case 'p': port = atoi(optarg); break;
+    case 'e': espfsPath = optarg; break;
+    case 'f': flashPath = optarg; break;
+    case 'u': part = atoi(optarg) == 2 ? 2 : 1; break;
+    default:
+      fprintf(stderr, "Usage: %s [-p port] [-e espfs.img] [-f flash.bin] [-u 1|2]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  uint32_t partAddr = part == 2 ? USER2_BIN_SPI_FLASH_ADDR : USER1_BIN_ADDR;
+  hostIrom = (uint32 *)(uintptr_t)(0x40200000 + partAddr + 0x10);
+  if (hostFlashOpen(flashPath, 0) < 0) {
+    fprintf(stderr, "Cannot read %s\n", flashPath);
+    return 1;
+  }
+
+  // the same steps as user_init
+  cgiFlashCheckUpgradeHealthy();
+  configRestore();
+  logInit();
+  os_printf("\n\n** %s, running user%d.bin\n", esp_link_version, part);
+
+  if (espfsPath != NULL) {
+    void *image = loadImage(espfsPath);
+    if (image == NULL) return 1;
+    EspFsInitResult res = espFsInit(image);
+    os_printf("espFsInit %s (%u)\n", res ? "ERR" : "ok", res);
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGUSR1, onSignal);
+
+  // httpdInit ignores the result of espconn_accept like the firmware, which can't do better
+  httpdInit(builtInUrls, port);
+  if (!hostListening()) {
+    fprintf(stderr, "Cannot listen on port %d\n", port);
+    return 1;
+  }
+  fprintf(stderr, "listening on port %d\n", port);
+
+  for (;;) {
+    hostLoop();
+    if (statsRequested) {
+      statsRequested = 0;
+      printStats();
+    }
+    if (stopRequested || hostRebootRequested) break;
+  }
+  printStats();
+  hostFlashSave();
+  if (!hostRebootRequested) return 0;
+
+  // start over like the device, the config and the flashed firmware are in the flash file
+  char partArg[2] = { hostRebootAddr >= USER2_BIN_SPI_FLASH_ADDR ? '2' : '1', 0 };
+  char portArg[8];
+  sprintf(portArg, "%d", port);
+  char *args[] = { argv[0], "-p", portArg, "-u", partArg, NULL, NULL, NULL, NULL, NULL };
+  int n = 5;
+  if (espfsPath) { args[n++] = "-e"; args[n++] = espfsPath; }
+  if (flashPath) { args[n++] = "-f"; args[n++] = flashPath; }
+  fprintf(stderr, "rebooting into user%s.bin\n", partArg);
+  execv("/proc/self/exe", args);
+  perror("execv");
+  return 1;
+}
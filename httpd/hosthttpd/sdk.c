@@ -0,0 +1,304 @@
+/*
+Host replacement of the SDK functions used by httpd and the esp-link cgis: memory, strings,
+printing, timers, the system functions and the SPI flash, which is emulated in memory and can
+be kept in a file.
+*/
+
+#include <esp8266.h>
+#include <stdarg.h>
+#include <time.h>
+#include "uart.h"
+#include "host.h"
+
+//Flash size of the emulation, a 4MB module with 512KB+512KB partitions
+#define HOST_FLASH_SIZE (4*1024*1024)
+
+static uint8_t *flash;
+static uint32_t flashSize;
+static char *flashPath;
+
+uint32_t hostRebootAddr;
+int hostRebootRequested;
+
+//The address of the running firmware, cgiflash.c is compiled with _irom0_text_start defined
+//as (*hostIrom), so &_irom0_text_start tells the partition (see main.c)
+uint32 *hostIrom;
+
+static void (*putc1)(char c);
+static bool osPrint = true;
+
+//===== Memory and strings
+
+void *pvPortMalloc(size_t xWantedSize, char *file, int line) {
+  return malloc(xWantedSize);
+}
+
+void *pvPortZalloc(size_t xWantedSize, char *file, int line) {
+  return calloc(1, xWantedSize);
+}
+
+void vPortFree(void *ptr, char *file, int line) {
+  free(ptr);
+}
+
+//The heap of the device isn't emulated, this is about what esp-link has free
+uint32 system_get_free_heap_size(void) {
+  return 20000;
+}
+
+int ets_memcmp(const void *s1, const void *s2, size_t n) { return memcmp(s1, s2, n); }
+void *ets_memcpy(void *dest, const void *src, size_t n) { return memcpy(dest, src, n); }
+void *ets_memmove(void *dest, const void *src, size_t n) { return memmove(dest, src, n); }
+void *ets_memset(void *s, int c, size_t n) { return memset(s, c, n); }
+void ets_bzero(void *s, size_t n) { memset(s, 0, n); }
+int ets_strcmp(const char *s1, const char *s2) { return strcmp(s1, s2); }
+char *ets_strcpy(char *dest, const char *src) { return strcpy(dest, src); }
+size_t ets_strlen(const char *s) { return strlen(s); }
+int ets_strncmp(const char *s1, const char *s2, int len) { return strncmp(s1, s2, len); }
+char *ets_strncpy(char *dest, const char *src, size_t n) { return strncpy(dest, src, n); }
+char *ets_strstr(const char *haystack, const char *needle) { return strstr(haystack, needle); }
+
+int ets_sprintf(char *str, const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  int n = vsprintf(str, format, ap);
+  va_end(ap);
+  return n;
+}
+
+int ets_vsprintf(char *str, const char *format, va_list argptr) {
+  return vsprintf(str, format, argptr);
+}
+
+int ets_vsnprintf(char *buffer, size_t sizeOfBuffer, const char *format, va_list argptr) {
+  return vsnprintf(buffer, sizeOfBuffer, format, argptr);
+}
+
+int os_snprintf(char *str, size_t size, const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  int n = vsnprintf(str, size, format, ap);
+  va_end(ap);
+  return n;
+}
+
+//===== Printing, os_printf goes to the putc1 function like on the device (the web log)
+
+void ets_install_putc1(void *routine) {
+  putc1 = routine;
+}
+
+void system_set_os_print(uint8 onoff) {
+  osPrint = onoff;
+}
+
+int os_printf_plus(const char *format, ...) {
+  char buff[1024];
+  va_list ap;
+  va_start(ap, format);
+  int n = vsnprintf(buff, sizeof(buff), format, ap);
+  va_end(ap);
+  if (n > (int)sizeof(buff) - 1) n = sizeof(buff) - 1;
+  if (!osPrint) return n;
+  for (int i = 0; i < n; i++) {
+    if (putc1) putc1(buff[i]);
+    else fputc(buff[i], stderr);
+  }
+  return n;
+}
+
+void uart0_write_char(char c) {
+  fputc(c, stderr);
+}
+
+void uart1_write_char(char c) {
+  fputc(c, stderr);
+}
+
+void ets_delay_us(int us) {
+}
+
+void gpio_init(void) {
+}
+
+void gpio_output_set(uint32 set_mask, uint32 clear_mask, uint32 enable_mask, uint32 disable_mask) {
+}
+
+//===== Timers, run by the loop in espconn.c
+
+static ETSTimer *timers;
+
+uint32_t hostMillis(void) {
+  static struct timespec start;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  if (start.tv_sec == 0 && start.tv_nsec == 0) start = ts;
+  return (ts.tv_sec - start.tv_sec) * 1000 + (ts.tv_nsec - start.tv_nsec) / 1000000;
+}
+
+uint32 system_get_time(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void ets_timer_disarm(ETSTimer *t) {
+  for (ETSTimer **p = &timers; *p != NULL; p = &(*p)->timer_next) {
+    if (*p == t) {
+      *p = t->timer_next;
+      break;
+    }
+  }
+  t->timer_next = NULL;
+}
+
+void ets_timer_setfn(ETSTimer *t, ETSTimerFunc *fn, void *parg) {
+  t->timer_func = fn;
+  t->timer_arg = parg;
+}
+
+void ets_timer_arm_new(ETSTimer *t, int time, int repeat, int isMstimer) {
+  if (!isMstimer) time /= 1000;
+  ets_timer_disarm(t);
+  t->timer_expire = hostMillis() + time;
+  t->timer_period = repeat ? time : 0;
+  t->timer_next = timers;
+  timers = t;
+}
+
+int hostRunTimers(void) {
+  uint32_t now = hostMillis();
+  ETSTimer *t;
+  for (t = timers; t != NULL; t = t->timer_next) {
+    if ((int32_t)(t->timer_expire - now) <= 0) {
+      // the callback may arm and disarm timers, so the search starts over afterwards
+      ets_timer_disarm(t);
+      if (t->timer_period > 0) {
+        t->timer_expire += t->timer_period;
+        if ((int32_t)(t->timer_expire - now) <= 0) t->timer_expire = now + t->timer_period;
+        t->timer_next = timers;
+        timers = t;
+      }
+      t->timer_func(t->timer_arg);
+      return 0;
+    }
+  }
+  int wait = -1;
+  for (t = timers; t != NULL; t = t->timer_next) {
+    int d = t->timer_expire - now;
+    if (wait < 0 || d < wait) wait = d;
+  }
+  return wait;
+}
+
+//===== System
+
+static struct rst_info rstInfo = { .reason = REASON_DEFAULT_RST };
+
+struct rst_info *system_get_rst_info(void) {
+  return &rstInfo;
+}
+
+uint32 system_get_chip_id(void) {
+  return 0x00c0ffee;
+}
+
+uint8 system_get_cpu_freq(void) {
+  return 80;
+}
+
+uint8 system_get_boot_version(void) {
+  return 31;
+}
+
+uint32 system_get_userbin_addr(void) {
+  return (uint32_t)(uintptr_t)hostIrom - 0x40200000 - 0x10;
+}
+
+enum flash_size_map system_get_flash_size_map(void) {
+  return FLASH_SIZE_32M_MAP_512_512;
+}
+
+void system_soft_wdt_feed(void) {
+}
+
+//The process exits its loop and main starts it again with the same flash
+void system_restart(void) {
+  hostRebootAddr = system_get_userbin_addr();
+  hostRebootRequested = 1;
+  hostStop();
+}
+
+bool system_restart_enhance(uint8 bin_type, uint32 bin_addr) {
+  hostRebootAddr = bin_addr;
+  hostRebootRequested = 1;
+  hostStop();
+  return true;
+}
+
+static uint8 upgradeFlag;
+
+void system_upgrade_flag_set(uint8 flag) {
+  upgradeFlag = flag;
+}
+
+uint8 system_upgrade_flag_check(void) {
+  return upgradeFlag;
+}
+
+void system_upgrade_reboot(void) {
+  system_restart_enhance(SYS_BOOT_NORMAL_BIN, system_get_userbin_addr() == 0x1000 ?
+      USER2_BIN_SPI_FLASH_ADDR : 0x1000);
+}
+
+//===== Flash
+
+//Opens the flash file, a new one is erased (0xff). Without a path the flash is kept in memory.
+int hostFlashOpen(const char *path, uint32_t size) {
+  if (size == 0) size = HOST_FLASH_SIZE;
+  flash = malloc(size);
+  flashSize = size;
+  memset(flash, 0xff, size);
+  if (path == NULL) return 0;
+  flashPath = strdup(path);
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) return 0;
+  size_t n = fread(flash, 1, size, f);
+  fclose(f);
+  return n > 0 ? 0 : -1;
+}
+
+void hostFlashSave(void) {
+  if (flashPath == NULL) return;
+  FILE *f = fopen(flashPath, "wb");
+  if (f == NULL) {
+    perror(flashPath);
+    return;
+  }
+  fwrite(flash, 1, flashSize, f);
+  fclose(f);
+}
+
+uint32 spi_flash_get_id(void) {
+  return 0x1640ef; // Winbond 25Q32
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec) {
+  if ((sec + 1) * SPI_FLASH_SEC_SIZE > flashSize) return SPI_FLASH_RESULT_ERR;
+  memset(flash + sec * SPI_FLASH_SEC_SIZE, 0xff, SPI_FLASH_SEC_SIZE);
+  return SPI_FLASH_RESULT_OK;
+}
+
+//Writing can only clear bits like on the real flash
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size) {
+  if ((des_addr & 3) || des_addr + size > flashSize) return SPI_FLASH_RESULT_ERR;
+  uint8_t *src = (uint8_t *)src_addr;
+  for (uint32 i = 0; i < size; i++) flash[des_addr + i] &= src[i];
+  return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size) {
+  if (src_addr + size > flashSize) return SPI_FLASH_RESULT_ERR;
+  memcpy(des_addr, flash + src_addr, size);
+  return SPI_FLASH_RESULT_OK;
+}
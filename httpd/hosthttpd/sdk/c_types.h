@@ -0,0 +1,37 @@
+// Host replacement of the SDK's c_types.h
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint8_t uint8;
+typedef int8_t sint8;
+typedef int8_t int8;
+typedef uint16_t uint16;
+typedef int16_t sint16;
+typedef int16_t int16;
+typedef uint32_t uint32;
+typedef int32_t sint32;
+typedef int32_t int32;
+typedef uint64_t uint64;
+typedef int64_t sint64;
+typedef unsigned char u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#define LOCAL static
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+#define STORE_ATTR __attribute__((aligned(4)))
+#define BIT(n) (1UL<<(n))
+
+typedef enum { OK = 0, FAIL, PENDING, BUSY, CANCEL } STATUS;
+
+#ifndef TRUE
+#define TRUE true
+#define FALSE false
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+// Host replacement of the SDK's ets_sys.h
+#ifndef _ETS_SYS_H
+#define _ETS_SYS_H
+
+#include "c_types.h"
+
+typedef void ETSTimerFunc(void *timer_arg);
+
+typedef struct _ETSTIMER_ {
+  struct _ETSTIMER_ *timer_next;
+  uint32 timer_expire;
+  uint32 timer_period;
+  ETSTimerFunc *timer_func;
+  void *timer_arg;
+} ETSTimer;
+
+typedef uint32 ETSSignal;
+typedef uint32 ETSParam;
+
+typedef struct ETSEventTag {
+  ETSSignal sig;
+  ETSParam par;
+} ETSEvent;
+
+typedef void (*ETSTask)(ETSEvent *e);
+
+#define ETS_INTR_LOCK()
+#define ETS_INTR_UNLOCK()
+#define ETS_UART_INTR_ENABLE()
+#define ETS_UART_INTR_DISABLE()
+
+#endif
@@ -0,0 +1,14 @@
+// Host replacement of the SDK's gpio.h, the pins do nothing
+#ifndef _GPIO_H_
+#define _GPIO_H_
+
+#include "eagle_soc.h"
+
+#define GPIO_OUTPUT_SET(gpio_no, bit_value)
+#define GPIO_DIS_OUTPUT(gpio_no)
+#define GPIO_INPUT_GET(gpio_no) 0
+
+void gpio_init(void);
+void gpio_output_set(uint32 set_mask, uint32 clear_mask, uint32 enable_mask, uint32 disable_mask);
+
+#endif
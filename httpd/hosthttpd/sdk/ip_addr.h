@@ -0,0 +1,27 @@
+// Host replacement of the SDK's ip_addr.h
+#ifndef __IP_ADDR_H__
+#define __IP_ADDR_H__
+
+#include "c_types.h"
+
+struct ip_addr {
+  uint32 addr;
+};
+typedef struct ip_addr ip_addr_t;
+
+struct ip_info {
+  struct ip_addr ip;
+  struct ip_addr netmask;
+  struct ip_addr gw;
+};
+
+#define IP4_ADDR(ipaddr, a, b, c, d) \
+  (ipaddr)->addr = ((uint32)(d) << 24) | ((uint32)(c) << 16) | ((uint32)(b) << 8) | (uint32)(a)
+#define ip4_addr1(ipaddr) (((uint8*)(ipaddr))[0])
+#define ip4_addr2(ipaddr) (((uint8*)(ipaddr))[1])
+#define ip4_addr3(ipaddr) (((uint8*)(ipaddr))[2])
+#define ip4_addr4(ipaddr) (((uint8*)(ipaddr))[3])
+#define IP2STR(ipaddr) ip4_addr1(ipaddr), ip4_addr2(ipaddr), ip4_addr3(ipaddr), ip4_addr4(ipaddr)
+#define IPSTR "%d.%d.%d.%d"
+
+#endif
@@ -0,0 +1,15 @@
+// Host replacement of the SDK's mem.h
+#ifndef __MEM_H__
+#define __MEM_H__
+
+#include <stddef.h>
+
+void *pvPortMalloc(size_t xWantedSize, char *file, int line);
+void *pvPortZalloc(size_t xWantedSize, char *file, int line);
+void vPortFree(void *ptr, char *file, int line);
+
+#define os_malloc(s) pvPortMalloc(s, "", __LINE__)
+#define os_zalloc(s) pvPortZalloc(s, "", __LINE__)
+#define os_free(s) vPortFree(s, "", __LINE__)
+
+#endif
@@ -0,0 +1,19 @@
+// Host replacement of the SDK's upgrade.h
+#ifndef __UPGRADE_H__
+#define __UPGRADE_H__
+
+#include "c_types.h"
+
+#define UPGRADE_FW_BIN1 0x00
+#define UPGRADE_FW_BIN2 0x01
+
+#define UPGRADE_FLAG_IDLE 0x00
+#define UPGRADE_FLAG_START 0x01
+#define UPGRADE_FLAG_FINISH 0x02
+
+uint8 system_upgrade_userbin_check(void);
+void system_upgrade_reboot(void);
+uint8 system_upgrade_flag_check(void);
+void system_upgrade_flag_set(uint8 flag);
+
+#endif
@@ -0,0 +1,60 @@
+// Host replacement of the SDK's user_interface.h, implemented by ../sdk.c
+#ifndef __USER_INTERFACE_H__
+#define __USER_INTERFACE_H__
+
+#include "os_type.h"
+#include "ip_addr.h"
+#include "spi_flash.h"
+
+#define STATION_IF 0
+#define SOFTAP_IF 1
+
+enum rst_reason {
+  REASON_DEFAULT_RST = 0,
+  REASON_WDT_RST,
+  REASON_EXCEPTION_RST,
+  REASON_SOFT_WDT_RST,
+  REASON_SOFT_RESTART,
+  REASON_DEEP_SLEEP_AWAKE,
+  REASON_EXT_SYS_RST
+};
+
+struct rst_info {
+  uint32 reason;
+  uint32 exccause;
+  uint32 epc1;
+  uint32 epc2;
+  uint32 epc3;
+  uint32 excvaddr;
+  uint32 depc;
+};
+
+enum flash_size_map {
+  FLASH_SIZE_4M_MAP_256_256 = 0,
+  FLASH_SIZE_2M,
+  FLASH_SIZE_8M_MAP_512_512,
+  FLASH_SIZE_16M_MAP_512_512,
+  FLASH_SIZE_32M_MAP_512_512,
+  FLASH_SIZE_16M_MAP_1024_1024,
+  FLASH_SIZE_32M_MAP_1024_1024
+};
+
+#define SYS_BOOT_ENHANCE_MODE 0
+#define SYS_BOOT_NORMAL_MODE 1
+#define SYS_BOOT_NORMAL_BIN 0
+#define SYS_BOOT_TEST_BIN 1
+
+struct rst_info *system_get_rst_info(void);
+uint32 system_get_free_heap_size(void);
+uint32 system_get_chip_id(void);
+uint32 system_get_time(void);
+uint8 system_get_cpu_freq(void);
+uint8 system_get_boot_version(void);
+uint32 system_get_userbin_addr(void);
+enum flash_size_map system_get_flash_size_map(void);
+void system_set_os_print(uint8 onoff);
+void system_restart(void);
+bool system_restart_enhance(uint8 bin_type, uint32 bin_addr);
+void system_soft_wdt_feed(void);
+
+#endif
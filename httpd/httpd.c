@@ -16,6 +16,10 @@ Esp8266 http server - core routines
 
 #include <esp8266.h>
 #include "httpd.h"
+#include "sha1.h"
+#include "base64.h"
+#include "mimetypes.h"
+#include "espfsformat.h"
 
 #ifdef HTTPD_DBG
 #define DBG(format, ...) do { os_printf(format, ## __VA_ARGS__); } while(0)
@@ -30,21 +34,115 @@ Esp8266 http server - core routines
 #define MAX_CONN 6
 //Max post buffer len
 #define MAX_POST 1024
+//Post buffer len of longer bodies, which are passed to the cgi in chunks (firmware uploads). One
+//flash sector, so a chunk needs one erase and one write.
+#define MAX_POST_CHUNK 4096
 //Max send buffer len
 #define MAX_SENDBUFF_LEN 2600
+//Amount of send buffers shared by all connections
+#define SENDBUFF_POOL_SIZE 2
+//Additional space in the send buffer for the chunk framing ("a28\r\n" data "\r\n" "0\r\n\r\n")
+#define CHUNK_OVERHEAD 12
+//Seconds until an idle keep-alive connection gets closed
+#define KEEPALIVE_TIMEOUT 10
+//Max amount of buffered bytes of pipelined requests
+#define MAX_PIPELINED MAX_HEAD_LEN
+//Max amount of WebSocket connections, so they can't use up the connection pool
+#define MAX_WS_CONN 2
+//Seconds until an idle WebSocket connection gets closed
+#define WS_TIMEOUT 600
+//Max amount of event stream connections, for the same reason as MAX_WS_CONN
+#define MAX_STREAM_CONN 2
+//Seconds until an idle event stream gets closed, the browser reconnects by itself
+#define STREAM_TIMEOUT 600
+//Space reserved in front of the payload of sent WebSocket frames (up to 65535 bytes)
+#define WS_HEADER_LEN 4
+
+//Connection state flags (HttpdPriv.flags)
+#define CONN_HTTP11     0x01 // the request line announced HTTP/1.1
+#define CONN_KEEPALIVE  0x02 // the connection stays open after the response
+#define CONN_LENGTH     0x04 // the response has a Content-Length or no body at all
+#define CONN_CHUNKED    0x08 // the response body is sent with chunked encoding
+#define CONN_RECEIVED   0x10 // the request is complete, further bytes belong to the next one
+#define CONN_WEBSOCKET  0x20 // the connection has been upgraded, the head buffer collects frames
+#define CONN_SENDING    0x40 // waiting for the sent callback, espconn_sent must not be called
+#define CONN_WS_PONG    0x80 // a ping arrived while sending, the pong is sent afterwards
+#define CONN_WS_CLOSING 0x100 // the close frame has been sent, disconnect after the sent callback
+#define CONN_ARGS       0x200 // the GET and form POST arguments have been indexed
+#define CONN_STREAM     0x400 // the response is an endless event stream, see httpdStreamStart
+#define CONN_SKIP       0x800 // the cgi is done, the rest of the request body is skipped
 
 
 //This gets set at init time.
 static HttpdBuiltInUrl *builtInUrls;
 
+//Send buffers, which are leased to a connection while one of its callbacks runs.
+//espconn_sent copies the data, so the buffer is returned at the end of the callback
+//and the idle connections don't tie up any memory.
+static char sendBuffPool[SENDBUFF_POOL_SIZE][MAX_SENDBUFF_LEN + CHUNK_OVERHEAD];
+static uint8 sendBuffLeased; // bit mask of the leased pool entries
+
+//Exact URLs of builtInUrls are looked up in an open addressing hash table, the wildcard
+//URLs (ending in '*') are kept in a separate list. Both are built by httpdInit and keep
+//the table order, so the first matching entry still wins.
+typedef struct {
+  uint16 hash;              // upper bits of the url hash, to skip most string compares
+  uint8 index;              // index into builtInUrls + 1, 0 if the slot is free
+} HttpdUrlSlot;
+
+typedef struct {
+  uint8 index;              // index into builtInUrls
+  uint8 prefixLen;          // length of the url without the '*'
+} HttpdWildcardUrl;
+
+static HttpdUrlSlot *urlSlots;
+static int urlSlotMask;
+static HttpdWildcardUrl *wildcardUrls;
+static int wildcardUrlCount;
+
+//An argument of the query string or of a form POST body. The line has been split up in place
+//at the '=' and '&', so name and value are zero-terminated.
+typedef struct {
+  char *name;
+  char *value;
+  short len;                // length of the value, the raw length until it has been decoded
+  short decoded;            // the value has been url-decoded in place
+} HttpdArg;
+
 //Private data for http connection
 struct HttpdPriv {
   char head[MAX_HEAD_LEN];  // buffer to accumulate header
   char from[24];            // source ip&port
   char *sendBuff;           // output buffer
+  char *pipelined;          // received bytes of the following requests
+  char *pong;               // payload of the deferred pong (CONN_WS_PONG)
   short headPos;            // offset into header
+  short lineStart;          // offset of the header line being received
+  short lineLen;            // received chars of the line (may be longer than the stored ones)
+  short headersStart;       // offset of the first header line after the request line
+  short headerValues[HTTPD_HEADER_COUNT]; // offsets of the parsed header values, 0 if missing
   short sendBuffLen;        // offset into output buffer
+  short chunkPos;           // offset of the chunk data into output buffer
+  short pipelinedLen;       // amount of bytes in pipelined
+  short pongLen;            // amount of bytes in pong
   short code;               // http response code (only for logging)
+  short argCount;           // entries in args
+  uint16 flags;             // CONN_* flags
+  HttpdArg *args;           // index of the GET and form POST arguments, see httpdGetArg
+  httpdWsRecvCallback wsRecv; // receiver of WebSocket messages
+};
+
+//Names of the headers, which are parsed while receiving (HttpdHeader order)
+static const char *knownHeaders[HTTPD_HEADER_COUNT] = {
+  "Content-Length",
+  "Content-Type",
+  "Accept-Encoding",
+  "Authorization",
+  "If-None-Match",
+  "Connection",
+  "Upgrade",
+  "Sec-WebSocket-Key",
+  "Last-Event-ID",
 };
 
 //Connection pool
@@ -56,27 +154,6 @@ static HttpdPostData connPostData[MAX_CONN];
 static struct espconn httpdConn;
 static esp_tcp httpdTcp;
 
-//Struct to keep extension->mime data in
-typedef struct {
-  const char *ext;
-  const char *mimetype;
-} MimeMap;
-
-//The mappings from file extensions to mime types. If you need an extra mime type,
-//add it here.
-static const MimeMap mimeTypes[] = {
-  { "htm", "text/htm" },
-  { "html", "text/html; charset=UTF-8" },
-  { "css", "text/css" },
-  { "js", "text/javascript" },
-  { "txt", "text/plain" },
-  { "jpg", "image/jpeg" },
-  { "jpeg", "image/jpeg" },
-  { "png", "image/png" },
-  { "tpl", "text/html; charset=UTF-8" },
-  { NULL, "text/html" }, //default value
-};
-
 //Returns a static char* to a mime type for a given url to a file.
 const char ICACHE_FLASH_ATTR *httpdGetMimetype(char *url) {
   int i = 0;
@@ -107,12 +184,8 @@ static void debugConn(void *arg, char *what) {
 #endif
 }
 
-// Retires a connection for re-use
-static void ICACHE_FLASH_ATTR httpdRetireConn(HttpdConnData *conn) {
-  if (conn->conn && conn->conn->reverse == conn)
-    conn->conn->reverse = NULL; // break reverse link
-
-  // log information about the request we handled
+// log information about the request we handled
+static void ICACHE_FLASH_ATTR httpdLogRequest(HttpdConnData *conn) {
   uint32 dt = conn->startTime;
   if (dt > 0) dt = (system_get_time() - dt) / 1000;
   if (conn->conn && conn->url)
@@ -125,12 +198,57 @@ static void ICACHE_FLASH_ATTR httpdRetireConn(HttpdConnData *conn) {
       conn->requestType == HTTPD_METHOD_GET ? "GET" : "POST", conn->url,
       conn->priv->code, dt, (unsigned long)system_get_free_heap_size());
 #endif
+}
+
+// Prepares a connection for receiving the next request
+static void ICACHE_FLASH_ATTR httpdResetConn(HttpdConnData *conn) {
+  if (conn->post->buff != NULL) os_free(conn->post->buff);
+  conn->post->buff = NULL;
+  conn->post->buffLen = 0;
+  conn->post->received = 0;
+  conn->post->len = -1;
+  conn->post->multipartBoundary = NULL;
+  conn->url = NULL;
+  conn->getArgs = NULL;
+  conn->cgi = NULL;
+  conn->cgiData = NULL;
+  conn->cgiPrivData = NULL;
+  conn->priv->headPos = 0;
+  conn->priv->lineStart = 0;
+  conn->priv->lineLen = 0;
+  conn->priv->headersStart = 0;
+  os_memset(conn->priv->headerValues, 0, sizeof(conn->priv->headerValues));
+  conn->priv->chunkPos = 0;
+  conn->priv->code = 0;
+  conn->priv->flags = 0;
+  if (conn->priv->args != NULL) os_free(conn->priv->args);
+  conn->priv->args = NULL;
+  conn->priv->argCount = 0;
+  conn->priv->wsRecv = NULL;
+  conn->startTime = system_get_time();
+}
+
+// Retires a connection for re-use
+static void ICACHE_FLASH_ATTR httpdRetireConn(HttpdConnData *conn) {
+  if (conn->conn && conn->conn->reverse == conn)
+    conn->conn->reverse = NULL; // break reverse link
+
+  httpdLogRequest(conn);
 
   conn->conn = NULL; // don't try to send anything, the SDK crashes...
   if (conn->cgi != NULL) conn->cgi(conn); // free cgi data
   if (conn->post->buff != NULL) os_free(conn->post->buff);
+  if (conn->priv->pipelined != NULL) os_free(conn->priv->pipelined);
+  if (conn->priv->pong != NULL) os_free(conn->priv->pong);
+  if (conn->priv->args != NULL) os_free(conn->priv->args);
   conn->cgi = NULL;
   conn->post->buff = NULL;
+  conn->priv->args = NULL;
+  conn->priv->argCount = 0;
+  conn->priv->pipelined = NULL;
+  conn->priv->pipelinedLen = 0;
+  conn->priv->pong = NULL;
+  conn->priv->pongLen = 0;
 }
 
 //Stupid li'l helper function that returns the value of a hex char.
@@ -198,32 +316,153 @@ int ICACHE_FLASH_ATTR httpdFindArg(char *line, char *arg, char *buff, int buffLe
   return -1; //not found
 }
 
+//Count the arguments in a string of get- or post-data, i.e. the upper bound of entries it adds
+//to the argument index
+static int ICACHE_FLASH_ATTR httpdCountArgs(char *line) {
+  if (line == NULL || *line == 0) return 0;
+  int n = 1;
+  for (char *p = line; *p != 0 && *p != '\r' && *p != '\n'; p++) {
+    if (*p == '&') n++;
+  }
+  return n;
+}
+
+//Split a string of get- or post-data in place and add its arguments to the index. Arguments
+//without '=' are skipped like httpdFindArg does. Returns the new number of entries.
+static int ICACHE_FLASH_ATTR httpdSplitArgs(char *line, HttpdArg *args, int count) {
+  char *p = line;
+  while (p != NULL && *p != 0 && *p != '\r' && *p != '\n') {
+    char *v = NULL;
+    char *e = p;
+    while (*e != 0 && *e != '&' && *e != '\r' && *e != '\n') {
+      if (*e == '=' && v == NULL) v = e + 1;
+      e++;
+    }
+    char end = *e;
+    *e = 0;
+    if (v != NULL) {
+      v[-1] = 0;
+      args[count].name = p;
+      args[count].value = v;
+      args[count].len = e - v;
+      args[count].decoded = 0;
+      count++;
+    }
+    p = end == '&' ? e + 1 : NULL;
+  }
+  return count;
+}
+
+//Build the argument index of the request from the query string and, for a form POST, which
+//has been received completely, the body
+static void ICACHE_FLASH_ATTR httpdIndexArgs(HttpdConnData *conn) {
+  char *body = NULL;
+  conn->priv->flags |= CONN_ARGS;
+  if (conn->requestType == HTTPD_METHOD_POST && conn->post->buff != NULL &&
+      conn->post->len <= MAX_POST && conn->post->received == conn->post->len) {
+    char *type = httpdGetHeaderValue(conn, HTTPD_HEADER_CONTENT_TYPE);
+    if (type != NULL && os_strstr(type, "application/x-www-form-urlencoded") != NULL) {
+      body = conn->post->buff;
+    }
+  }
+  int max = httpdCountArgs(conn->getArgs) + httpdCountArgs(body);
+  if (max == 0) return;
+  conn->priv->args = (HttpdArg *)os_malloc(max * sizeof(HttpdArg));
+  if (conn->priv->args == NULL) return;
+  int n = httpdSplitArgs(conn->getArgs, conn->priv->args, 0);
+  conn->priv->argCount = httpdSplitArgs(body, conn->priv->args, n);
+}
+
+//Get the value of an argument of the query string or of a form POST body. The arguments are
+//indexed on the first call and each value is url-decoded in place when it is looked up the
+//first time, so the query string and the POST body can't be passed to httpdFindArg afterwards.
+//Returns the zero-terminated value, which stays valid until the request is done, and stores
+//its length in len, if it isn't NULL. Returns NULL if the argument is missing.
+char ICACHE_FLASH_ATTR *httpdGetArg(HttpdConnData *conn, const char *name, int *len) {
+  if ((conn->priv->flags & CONN_ARGS) == 0) httpdIndexArgs(conn);
+  for (int i = 0; i<conn->priv->argCount; i++) {
+    HttpdArg *a = &conn->priv->args[i];
+    if (os_strcmp(a->name, name) != 0) continue;
+    if (!a->decoded) {
+      //Decoding never makes the value longer, so it can be done in place
+      a->len = httpdUrlDecode(a->value, a->len, a->value, a->len + 1);
+      a->decoded = 1;
+    }
+    if (len != NULL) *len = a->len;
+    return a->value;
+  }
+  return NULL;
+}
+
+//Compare the first len chars of name case-insensitively with the whole known header name
+static int ICACHE_FLASH_ATTR httpdHeaderNameEquals(const char *name, const char *known, int len) {
+  for (int i = 0; i<len; i++) {
+    char c = name[i];
+    if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    char k = known[i];
+    if (k >= 'A' && k <= 'Z') k += 'a' - 'A';
+    if (c != k) return 0;
+  }
+  return known[len] == 0;
+}
+
+//Returns 1, if the comma separated list of a header value contains the token.
+static int ICACHE_FLASH_ATTR httpdHeaderHasToken(const char *value, const char *token) {
+  int len = os_strlen(token);
+  const char *p = value;
+  while (*p != 0) {
+    while (*p == ' ' || *p == '\t' || *p == ',') p++;
+    const char *end = p;
+    while (*end != 0 && *end != ',') end++;
+    const char *last = end;
+    while (last > p && (last[-1] == ' ' || last[-1] == '\t')) last--;
+    if (last - p == len && httpdHeaderNameEquals(p, token, len)) return 1;
+    p = end;
+  }
+  return 0;
+}
+
+//Get the value of a header, which has been parsed while receiving. Returns NULL if missing.
+char ICACHE_FLASH_ATTR *httpdGetHeaderValue(HttpdConnData *conn, HttpdHeader header) {
+  if (header >= HTTPD_HEADER_COUNT || conn->priv->headerValues[header] == 0) return NULL;
+  return conn->priv->head + conn->priv->headerValues[header];
+}
+
 //Get the value of a certain header in the HTTP client head
 int ICACHE_FLASH_ATTR httpdGetHeader(HttpdConnData *conn, char *header, char *ret, int retLen) {
-  char *p = conn->priv->head;
-  p = p + strlen(p) + 1; //skip GET/POST part
-  p = p + strlen(p) + 1; //skip HTTP part
-  while (p<(conn->priv->head + conn->priv->headPos)) {
-    while (*p <= 32 && *p != 0) p++; //skip crap at start
-    //See if this is the header
-    if (os_strncmp(p, header, strlen(header)) == 0 && p[strlen(header)] == ':') {
-      //Skip 'key:' bit of header line
-      p = p + strlen(header) + 1;
-      //Skip past spaces after the colon
-      while (*p == ' ') p++;
-      //Copy from p to end
-      while (*p != 0 && *p != '\r' && *p != '\n' && retLen>1) {
-        *ret++ = *p++;
-        retLen--;
+  char *p = NULL;
+  int len = os_strlen(header);
+  int i;
+  //The headers in knownHeaders have already been found while receiving
+  for (i = 0; i<HTTPD_HEADER_COUNT; i++) {
+    if (httpdHeaderNameEquals(header, knownHeaders[i], len)) {
+      p = httpdGetHeaderValue(conn, i);
+      break;
+    }
+  }
+  //Search all other ones. The header lines are zero-terminated.
+  if (i == HTTPD_HEADER_COUNT) {
+    char *h = conn->priv->head + conn->priv->headersStart;
+    while (h<(conn->priv->head + conn->priv->headPos)) {
+      if (h[len] == ':' && httpdHeaderNameEquals(h, header, len)) {
+        p = h + len + 1;
+        //Skip past spaces after the colon
+        while (*p == ' ') p++;
+        break;
       }
-      //Zero-terminate string
-      *ret = 0;
-      //All done :)
-      return 1;
+      h += strlen(h) + 1; //Skip past end of string and \0 terminator
     }
-    p += strlen(p) + 1; //Skip past end of string and \0 terminator
   }
-  return 0;
+  if (p == NULL) return 0;
+
+  //Copy from p to end
+  while (*p != 0 && retLen>1) {
+    *ret++ = *p++;
+    retLen--;
+  }
+  //Zero-terminate string
+  *ret = 0;
+  return 1;
 }
 
 //Start the response headers.
@@ -232,8 +471,11 @@ void ICACHE_FLASH_ATTR httpdStartResponse(HttpdConnData *conn, int code) {
   int l;
   conn->priv->code = code;
   char *status = code < 400 ? "OK" : "ERROR";
-  l = os_sprintf(buff, "HTTP/1.0 %d %s\r\nServer: esp-link\r\nConnection: close\r\n", code, status);
+  l = os_sprintf(buff, "HTTP/1.1 %d %s\r\nServer: esp-link\r\n%s", code, status,
+      (conn->priv->flags & CONN_KEEPALIVE) ? "" : "Connection: close\r\n");
   httpdSend(conn, buff, l);
+  // responses without a body do not need any framing
+  if (code == 204 || code == 304) conn->priv->flags |= CONN_LENGTH;
 }
 
 //Send a http header.
@@ -243,22 +485,57 @@ void ICACHE_FLASH_ATTR httpdHeader(HttpdConnData *conn, const char *field, const
 
   l = os_sprintf(buff, "%s: %s\r\n", field, val);
   httpdSend(conn, buff, l);
+  if (os_strcmp(field, "Content-Length") == 0) conn->priv->flags |= CONN_LENGTH;
 }
 
 //Finish the headers.
+//Without a Content-Length the end of the body has to be marked for keep-alive connections.
 void ICACHE_FLASH_ATTR httpdEndHeaders(HttpdConnData *conn) {
+  HttpdPriv *priv = conn->priv;
+  if ((priv->flags & CONN_KEEPALIVE) && !(priv->flags & CONN_LENGTH)) {
+    if (priv->flags & CONN_HTTP11) {
+      // the body is sent in chunks, an empty chunk terminates it
+      httpdSend(conn, "Transfer-Encoding: chunked\r\n\r\n", -1);
+      priv->flags |= CONN_CHUNKED;
+      priv->chunkPos = priv->sendBuffLen;
+      return;
+    }
+    // HTTP/1.0 does not know chunks, so closing the connection ends the body
+    priv->flags &= ~CONN_KEEPALIVE;
+    httpdSend(conn, "Connection: close\r\n", -1);
+  } else if ((priv->flags & CONN_KEEPALIVE) && !(priv->flags & CONN_HTTP11)) {
+    // an HTTP/1.0 client closes the connection unless the keep-alive is confirmed
+    httpdSend(conn, "Connection: keep-alive\r\n", -1);
+  }
+  httpdSend(conn, "\r\n", -1);
+}
+
+//Finish a header block, which has been written into the send buffer as a whole (see
+//httpdSendBuffer). It has to start with the status line and contain a Content-Length.
+//Only the connection dependent headers and the empty line are added.
+void ICACHE_FLASH_ATTR httpdEndPrebakedHeaders(HttpdConnData *conn, int code, int len) {
+  conn->priv->code = code;
+  httpdSendCommit(conn, len);
+  conn->priv->flags |= CONN_LENGTH;
+  if (!(conn->priv->flags & CONN_KEEPALIVE)) httpdSend(conn, "Connection: close\r\n", -1);
+  else if (!(conn->priv->flags & CONN_HTTP11)) httpdSend(conn, "Connection: keep-alive\r\n", -1);
   httpdSend(conn, "\r\n", -1);
 }
 
 //ToDo: sprintf->snprintf everywhere... esp doesn't have snprintf tho' :/
 //Redirect to the given URL.
 void ICACHE_FLASH_ATTR httpdRedirect(HttpdConnData *conn, char *newUrl) {
-  char buff[1024];
-  int l;
-  conn->priv->code = 302;
-  l = os_sprintf(buff, "HTTP/1.0 302 Found\r\nServer: esp8266-link\r\nConnection: close\r\n"
-      "Location: %s\r\n\r\nRedirecting to %s\r\n", newUrl, newUrl);
-  httpdSend(conn, buff, l);
+  static const char msg[] = "Redirecting to ";
+  char lenBuff[8];
+  int l = sizeof(msg) - 1 + os_strlen(newUrl) + 2;
+  os_sprintf(lenBuff, "%d", l);
+  httpdStartResponse(conn, 302);
+  httpdHeader(conn, "Location", newUrl);
+  httpdHeader(conn, "Content-Length", lenBuff);
+  httpdEndHeaders(conn);
+  httpdSend(conn, msg, sizeof(msg) - 1);
+  httpdSend(conn, newUrl, -1);
+  httpdSend(conn, "\r\n", 2);
 }
 
 //Use this as a cgi function to redirect one url to another.
@@ -277,6 +554,7 @@ int ICACHE_FLASH_ATTR cgiRedirect(HttpdConnData *connData) {
 //Returns 1 for success, 0 for out-of-memory.
 int ICACHE_FLASH_ATTR httpdSend(HttpdConnData *conn, const char *data, int len) {
   if (len<0) len = strlen(data);
+  if (conn->priv->sendBuff == NULL) return 0;
   if (conn->priv->sendBuffLen + len>MAX_SENDBUFF_LEN) {
     DBG("%sERROR! httpdSend full (%d of %d)\n",
       connStr, conn->priv->sendBuffLen, MAX_SENDBUFF_LEN);
@@ -287,16 +565,412 @@ int ICACHE_FLASH_ATTR httpdSend(HttpdConnData *conn, const char *data, int len)
   return 1;
 }
 
+//Returns the free space of the send buffer, so a cgi can write its data in place instead of
+//preparing it in a buffer on the stack. len is set to the amount of free bytes.
+//The written bytes have to be added with httpdSendCommit.
+char ICACHE_FLASH_ATTR *httpdSendBuffer(HttpdConnData *conn, int *len) {
+  if (conn->priv->sendBuff == NULL) {
+    *len = 0;
+    return NULL;
+  }
+  *len = MAX_SENDBUFF_LEN - conn->priv->sendBuffLen;
+  return conn->priv->sendBuff + conn->priv->sendBuffLen;
+}
+
+//Adds len bytes, which have been written into the space returned by httpdSendBuffer.
+void ICACHE_FLASH_ATTR httpdSendCommit(HttpdConnData *conn, int len) {
+  if (conn->priv->sendBuff == NULL || len <= 0) return;
+  if (conn->priv->sendBuffLen + len > MAX_SENDBUFF_LEN) len = MAX_SENDBUFF_LEN - conn->priv->sendBuffLen;
+  conn->priv->sendBuffLen += len;
+}
+
+//Leases a send buffer of the pool to the connection.
+//Returns the pool index or -1, if all buffers are in use.
+static int ICACHE_FLASH_ATTR httpdLeaseSendBuff(HttpdConnData *conn) {
+  for (int i = 0; i < SENDBUFF_POOL_SIZE; i++) {
+    if (!(sendBuffLeased & (1 << i))) {
+      sendBuffLeased |= 1 << i;
+      conn->priv->sendBuff = sendBuffPool[i];
+      conn->priv->sendBuffLen = 0;
+      return i;
+    }
+  }
+  DBG("%sERROR! no free send buffer\n", connStr);
+  return -1;
+}
+
+//Returns the send buffer leased by httpdLeaseSendBuff.
+static void ICACHE_FLASH_ATTR httpdReturnSendBuff(HttpdConnData *conn, int lease) {
+  sendBuffLeased &= ~(1 << lease);
+  if (conn->priv->sendBuff == sendBuffPool[lease]) {
+    conn->priv->sendBuff = NULL;
+    conn->priv->sendBuffLen = 0;
+  }
+}
+
+static void ICACHE_FLASH_ATTR httpdParseData(HttpdConnData *conn, char *data, unsigned short len);
+
+//The response has been sent completely.
+//Keep-alive connections wait for the next request, all others get closed.
+static void ICACHE_FLASH_ATTR httpdResponseDone(HttpdConnData *conn) {
+  HttpdPriv *priv = conn->priv;
+  if (!(priv->flags & CONN_KEEPALIVE) || !(priv->flags & (CONN_LENGTH | CONN_CHUNKED))) {
+    //os_printf("Closing 0x%p/0x%p->0x%p\n", arg, conn->conn, conn);
+    espconn_disconnect(conn->conn); // we will get a disconnect callback
+    return;
+  }
+  // the cgi has answered early, the next request follows the rest of the body (CONN_SKIP)
+  if (!(priv->flags & CONN_RECEIVED)) return;
+
+  httpdLogRequest(conn);
+  httpdResetConn(conn);
+
+  // handle requests, which have been received while sending the response
+  if (priv->pipelined != NULL) {
+    char *data = priv->pipelined;
+    unsigned short len = priv->pipelinedLen;
+    priv->pipelined = NULL;
+    priv->pipelinedLen = 0;
+    httpdParseData(conn, data, len);
+    os_free(data);
+  }
+}
+
+//Wraps the body data in the send buffer into a chunk.
+//The terminating empty chunk is appended, if the cgi has finished (conn->cgi == NULL).
+//The send buffer has CHUNK_OVERHEAD bytes reserved for this.
+static void ICACHE_FLASH_ATTR httpdFrameChunk(HttpdConnData *conn) {
+  HttpdPriv *priv = conn->priv;
+  int len = priv->sendBuffLen - priv->chunkPos;
+  if (len > 0) {
+    char head[8];
+    int l = os_sprintf(head, "%x\r\n", len);
+    char *data = priv->sendBuff + priv->chunkPos;
+    os_memmove(data + l, data, len);
+    os_memcpy(data, head, l);
+    os_memcpy(data + l + len, "\r\n", 2);
+    priv->sendBuffLen += l + 2;
+  }
+  if (conn->cgi == NULL) {
+    os_memcpy(priv->sendBuff + priv->sendBuffLen, "0\r\n\r\n", 5);
+    priv->sendBuffLen += 5;
+  }
+  // the next send buffer only contains body data
+  priv->chunkPos = 0;
+}
+
 //Helper function to send any data in conn->priv->sendBuff
 static void ICACHE_FLASH_ATTR xmitSendBuff(HttpdConnData *conn) {
+  if (conn->priv->flags & CONN_CHUNKED) httpdFrameChunk(conn);
   if (conn->priv->sendBuffLen != 0) {
     sint8 status = espconn_sent(conn->conn, (uint8_t*)conn->priv->sendBuff, conn->priv->sendBuffLen);
     if (status != 0) {
       DBG("%sERROR! espconn_sent returned %d, trying to send %d to %s\n",
           connStr, status, conn->priv->sendBuffLen, conn->url);
     }
+    else {
+      conn->priv->flags |= CONN_SENDING;
+    }
     conn->priv->sendBuffLen = 0;
   }
+  else if (conn->cgi == NULL) {
+    // nothing was sent, so there will not be any sent callback to finish the response
+    httpdResponseDone(conn);
+  }
+}
+
+//Returns the free space of the send buffer for the payload of a WebSocket frame, see
+//httpdSendBuffer. The frame has to be finished with httpdWsFrameCommit.
+char ICACHE_FLASH_ATTR *httpdWsFrameBuffer(HttpdConnData *conn, int *len) {
+  char *buff = httpdSendBuffer(conn, len);
+  if (buff == NULL || *len <= WS_HEADER_LEN) {
+    *len = 0;
+    return NULL;
+  }
+  *len -= WS_HEADER_LEN;
+  return buff + WS_HEADER_LEN;
+}
+
+//Puts the frame header in front of the len bytes written into the space returned by
+//httpdWsFrameBuffer and adds the frame to the send buffer.
+void ICACHE_FLASH_ATTR httpdWsFrameCommit(HttpdConnData *conn, int opcode, int len) {
+  int space;
+  char *buff = httpdSendBuffer(conn, &space);
+  if (buff == NULL || len < 0 || len > space - WS_HEADER_LEN) return;
+  buff[0] = 0x80 | opcode; // final fragment
+  if (len < 126) {
+    //short frames have a two byte header
+    buff[1] = len;
+    os_memmove(buff + 2, buff + WS_HEADER_LEN, len);
+    httpdSendCommit(conn, len + 2);
+  }
+  else {
+    buff[1] = 126;
+    buff[2] = len >> 8;
+    buff[3] = len;
+    httpdSendCommit(conn, len + WS_HEADER_LEN);
+  }
+}
+
+//Add a WebSocket frame to the send buffer.
+//Returns 1 for success, 0 if it does not fit or the connection is still sending.
+int ICACHE_FLASH_ATTR httpdWsSend(HttpdConnData *conn, int opcode, const char *data, int len) {
+  int space;
+  char *buff = httpdWsFrameBuffer(conn, &space);
+  if (buff == NULL || len > space) return 0;
+  if (len > 0) os_memcpy(buff, data, len);
+  httpdWsFrameCommit(conn, opcode, len);
+  return 1;
+}
+
+//Start the closing handshake with the given status code (1000 = normal closure).
+//The connection gets closed after the close frame has been sent, received frames are ignored.
+void ICACHE_FLASH_ATTR httpdWsClose(HttpdConnData *conn, int status) {
+  char code[2] = { status >> 8, status };
+  if (conn->priv->flags & CONN_WS_CLOSING) return;
+  conn->priv->flags |= CONN_WS_CLOSING;
+  if (!httpdWsSend(conn, WS_OPCODE_CLOSE, code, sizeof(code))) {
+    //no send buffer, just drop the connection
+    espconn_disconnect(conn->conn);
+  }
+}
+
+//Handle a received frame, the payload has been unmasked already.
+static void ICACHE_FLASH_ATTR httpdWsFrame(HttpdConnData *conn, uint8 head, char *data, int len) {
+  int opcode = head & 0x0f;
+  if (!(head & 0x80) || opcode == WS_OPCODE_CONTINUATION) {
+    //fragmented messages are not supported, they would not fit into the head buffer anyway
+    httpdWsClose(conn, 1009);
+    return;
+  }
+  if ((opcode & 0x08) && len > 125) {
+    //control frames must not be longer
+    httpdWsClose(conn, 1002);
+    return;
+  }
+  switch (opcode) {
+  case WS_OPCODE_TEXT:
+  case WS_OPCODE_BINARY:
+    if (conn->priv->wsRecv != NULL) conn->priv->wsRecv(conn, opcode, data, len);
+    break;
+  case WS_OPCODE_PING:
+    if (!httpdWsSend(conn, WS_OPCODE_PONG, data, len)) {
+      //without a send buffer the pong follows the running send, it answers the last ping only
+      HttpdPriv *priv = conn->priv;
+      if (priv->pong != NULL) os_free(priv->pong);
+      priv->pong = len > 0 ? (char *)os_malloc(len) : NULL;
+      priv->pongLen = priv->pong != NULL ? len : 0;
+      if (priv->pongLen > 0) os_memcpy(priv->pong, data, len);
+      priv->flags |= CONN_WS_PONG;
+    }
+    break;
+  case WS_OPCODE_CLOSE:
+    //echo the status code of the client
+    httpdWsClose(conn, len >= 2 ? ((uint8)data[0] << 8) | (uint8)data[1] : 1000);
+    break;
+  case WS_OPCODE_PONG:
+    break;
+  default:
+    httpdWsClose(conn, 1002);
+    break;
+  }
+}
+
+//Collect the received bytes in the head buffer until a frame is complete. Frames of the
+//client are always masked. The payload of a frame is limited by the head buffer.
+static void ICACHE_FLASH_ATTR httpdWsParse(HttpdConnData *conn, char *data, unsigned short len) {
+  HttpdPriv *priv = conn->priv;
+  uint8 *h = (uint8 *)priv->head;
+  for (int x = 0; x < len; x++) {
+    if (priv->flags & CONN_WS_CLOSING) return;
+    h[priv->headPos++] = data[x];
+    if (priv->headPos < 2) continue;
+
+    int payloadLen = h[1] & 0x7f;
+    int headLen = 2;
+    if (payloadLen == 126) {
+      headLen = 4;
+      if (priv->headPos < headLen) continue;
+      payloadLen = (h[2] << 8) | h[3];
+    }
+    headLen += 4; // masking key
+    if (!(h[1] & 0x80) || payloadLen == 127) {
+      httpdWsClose(conn, 1002);
+      return;
+    }
+    if (headLen + payloadLen > MAX_HEAD_LEN) {
+      DBG("%sERROR! WebSocket frame of %d bytes too big\n", connStr, payloadLen);
+      httpdWsClose(conn, 1009);
+      return;
+    }
+    if (priv->headPos < headLen + payloadLen) {
+      //copy the rest of the payload at once
+      int n = headLen + payloadLen - priv->headPos;
+      if (priv->headPos < headLen) continue;
+      if (n > len - x - 1) n = len - x - 1;
+      os_memcpy(h + priv->headPos, data + x + 1, n);
+      priv->headPos += n;
+      x += n;
+      if (priv->headPos < headLen + payloadLen) continue;
+    }
+
+    char *payload = priv->head + headLen;
+    uint8 *mask = h + headLen - 4;
+    for (int i = 0; i < payloadLen; i++) payload[i] ^= mask[i & 3];
+    priv->headPos = 0;
+    httpdWsFrame(conn, h[0], payload, payloadLen);
+  }
+}
+
+//Receive data of an upgraded connection. A send buffer is only leased, if the connection
+//isn't sending already, so replies to the received frames may fail (see httpdWsSend).
+static void ICACHE_FLASH_ATTR httpdWsRecv(HttpdConnData *conn, char *data, unsigned short len) {
+  int lease = -1;
+  if (!(conn->priv->flags & CONN_SENDING)) lease = httpdLeaseSendBuff(conn);
+  httpdWsParse(conn, data, len);
+  if (lease >= 0) {
+    if (conn->priv->sendBuffLen > 0) xmitSendBuff(conn);
+    httpdReturnSendBuff(conn, lease);
+  }
+}
+
+//Answer the WebSocket handshake of the request. A cgi calls this on its first call and
+//returns HTTPD_CGI_MORE. Afterwards received messages are passed to recvCb and the cgi is
+//called, when it can send frames: after the sent callback and from httpdWsPoll. The
+//connection is closed, when the cgi returns HTTPD_CGI_DONE.
+//Returns 0, if the request is no handshake or MAX_WS_CONN connections are upgraded already.
+int ICACHE_FLASH_ATTR httpdWsUpgrade(HttpdConnData *conn, httpdWsRecvCallback recvCb) {
+  static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  char *upgrade = httpdGetHeaderValue(conn, HTTPD_HEADER_UPGRADE);
+  char *key = httpdGetHeaderValue(conn, HTTPD_HEADER_SEC_WEBSOCKET_KEY);
+  if (conn->requestType != HTTPD_METHOD_GET || upgrade == NULL || key == NULL ||
+      !httpdHeaderHasToken(upgrade, "websocket")) {
+    return 0;
+  }
+  int open = 0;
+  for (int i = 0; i < MAX_CONN; i++) {
+    if (connData[i].conn != NULL && (connData[i].priv->flags & CONN_WEBSOCKET)) open++;
+  }
+  if (open >= MAX_WS_CONN) {
+    DBG("%sERROR! too many WebSocket connections\n", connStr);
+    return 0;
+  }
+
+  sha1_ctx ctx;
+  uint8 digest[SHA1_DIGEST_LEN];
+  char accept[32];
+  sha1_init(&ctx);
+  sha1_update(&ctx, key, os_strlen(key));
+  sha1_update(&ctx, guid, sizeof(guid) - 1);
+  sha1_final(&ctx, digest);
+  base64_encode(sizeof(digest), digest, sizeof(accept), accept);
+
+  conn->priv->code = 101;
+  httpdSend(conn, "HTTP/1.1 101 Switching Protocols\r\nServer: esp-link\r\n"
+      "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ", -1);
+  httpdSend(conn, accept, -1);
+  httpdSend(conn, "\r\n\r\n", 4);
+
+  //The head buffer collects the received frames from now on, so the request is gone
+  httpdLogRequest(conn);
+  conn->url = NULL;
+  conn->getArgs = NULL;
+  if (conn->priv->args != NULL) os_free(conn->priv->args);
+  conn->priv->args = NULL;
+  conn->priv->argCount = 0;
+  conn->priv->headPos = 0;
+  conn->priv->flags = CONN_WEBSOCKET;
+  conn->priv->wsRecv = recvCb;
+  espconn_regist_time(conn->conn, WS_TIMEOUT, 1);
+  return 1;
+}
+
+//Call the cgi of the connections handled by cgi, which have the given flag and are not sending.
+//A NULL cgi matches all of them. Returns the amount of matching connections, sending or not.
+static int ICACHE_FLASH_ATTR httpdPollConns(cgiSendCallback cgi, int flag) {
+  int count = 0, noBuff = 0;
+  for (int i = 0; i < MAX_CONN; i++) {
+    HttpdConnData *conn = &connData[i];
+    if (conn->conn == NULL || conn->cgi == NULL || (cgi != NULL && conn->cgi != cgi) ||
+        !(conn->priv->flags & flag)) {
+      continue;
+    }
+    count++;
+    if (noBuff || (conn->priv->flags & (CONN_SENDING | CONN_WS_CLOSING))) continue;
+    int lease = httpdLeaseSendBuff(conn);
+    if (lease < 0) {
+      noBuff = 1;
+      continue;
+    }
+    if (conn->cgi(conn) == HTTPD_CGI_DONE) conn->cgi = NULL;
+    xmitSendBuff(conn);
+    httpdReturnSendBuff(conn, lease);
+  }
+  return count;
+}
+
+//Call the cgi of all upgraded connections handled by cgi, which are not sending, so it can
+//push new data. Without this the cgi is only called again after a sent callback.
+int ICACHE_FLASH_ATTR httpdWsPoll(cgiSendCallback cgi) {
+  return httpdPollConns(cgi, CONN_WEBSOCKET);
+}
+
+//Start an endless text/event-stream response (Server-Sent Events). The connection gets closed
+//after it, so the body needs no framing. Like for a WebSocket the cgi is called again after
+//each sent callback and from httpdStreamPoll, it adds its events with httpdSendEvent.
+//Returns 0, if MAX_STREAM_CONN streams are open already.
+int ICACHE_FLASH_ATTR httpdStreamStart(HttpdConnData *conn) {
+  int open = 0;
+  for (int i = 0; i < MAX_CONN; i++) {
+    if (connData[i].conn != NULL && (connData[i].priv->flags & CONN_STREAM)) open++;
+  }
+  if (open >= MAX_STREAM_CONN) {
+    DBG("%sERROR! too many event streams\n", connStr);
+    return 0;
+  }
+  conn->priv->flags &= ~CONN_KEEPALIVE;
+  httpdStartResponse(conn, 200);
+  httpdHeader(conn, "Content-Type", "text/event-stream");
+  httpdHeader(conn, "Cache-Control", "no-cache");
+  httpdEndHeaders(conn);
+  conn->priv->flags |= CONN_STREAM;
+  espconn_regist_time(conn->conn, STREAM_TIMEOUT, 1);
+  return 1;
+}
+
+//Add an event with the text to an event stream. Each line break of the text starts a new data
+//line, carriage returns are dropped. The id of the event is id plus the amount of used bytes,
+//the browser sends it back as Last-Event-ID header when it reconnects.
+//Returns the amount of bytes of text, which fit into the send buffer.
+int ICACHE_FLASH_ATTR httpdSendEvent(HttpdConnData *conn, int id, const char *text, int len) {
+  int space;
+  char *buff = httpdSendBuffer(conn, &space);
+  space -= 19; // "\nid: -2147483648\n\n" and the zero of os_sprintf
+  if (buff == NULL || space < 7) return 0;
+  os_memcpy(buff, "data: ", 6);
+  int n = 6, used = 0;
+  for (; used < len; used++) {
+    char c = text[used];
+    if (c == '\n') {
+      if (n + 7 > space) break;
+      os_memcpy(buff + n, "\ndata: ", 7);
+      n += 7;
+    } else if (c != '\r') {
+      if (n + 1 > space) break;
+      buff[n++] = c;
+    }
+  }
+  if (used == 0) return 0;
+  n += os_sprintf(buff + n, "\nid: %d\n\n", id + used);
+  httpdSendCommit(conn, n);
+  return used;
+}
+
+//Call the cgi of all event streams handled by cgi (any cgi if NULL), which are not sending,
+//so it can add new events. Returns the amount of these streams, a timer calling this can stop
+//when it is 0.
+int ICACHE_FLASH_ATTR httpdStreamPoll(cgiSendCallback cgi) {
+  return httpdPollConns(cgi, CONN_STREAM);
 }
 
 //Callback called when the data on a socket has been successfully sent.
@@ -306,29 +980,116 @@ static void ICACHE_FLASH_ATTR httpdSentCb(void *arg) {
   HttpdConnData *conn = (HttpdConnData *)pCon->reverse;
   if (conn == NULL) return; // aborted connection
 
-  char sendBuff[MAX_SENDBUFF_LEN];
-  conn->priv->sendBuff = sendBuff;
-  conn->priv->sendBuffLen = 0;
+  conn->priv->flags &= ~CONN_SENDING;
+  if (conn->priv->flags & CONN_WS_CLOSING) {
+    espconn_disconnect(conn->conn);
+    return;
+  }
+
+  int lease = httpdLeaseSendBuff(conn);
+  if (lease < 0) {
+    espconn_disconnect(conn->conn);
+    return;
+  }
+
+  if (conn->priv->flags & CONN_WS_PONG) {
+    httpdWsSend(conn, WS_OPCODE_PONG, conn->priv->pong, conn->priv->pongLen);
+    if (conn->priv->pong != NULL) os_free(conn->priv->pong);
+    conn->priv->pong = NULL;
+    conn->priv->pongLen = 0;
+    conn->priv->flags &= ~CONN_WS_PONG;
+  }
 
   if (conn->cgi == NULL) { //Marked for destruction?
-    //os_printf("Closing 0x%p/0x%p->0x%p\n", arg, conn->conn, conn);
-    espconn_disconnect(conn->conn); // we will get a disconnect callback
-    return; //No need to call xmitSendBuff.
+    httpdResponseDone(conn);
   }
+  else {
+    int r = conn->cgi(conn); //Execute cgi fn.
+    if (r == HTTPD_CGI_DONE) {
+      conn->cgi = NULL; //mark for destruction.
+      conn->priv->flags |= CONN_SKIP;
+    }
+    if (r == HTTPD_CGI_NOTFOUND || r == HTTPD_CGI_AUTHENTICATED) {
+      DBG("%sERROR! Bad CGI code %d\n", connStr, r);
+      conn->cgi = NULL; //mark for destruction.
+      conn->priv->flags |= CONN_SKIP;
+    }
+    xmitSendBuff(conn);
+  }
+
+  httpdReturnSendBuff(conn, lease);
+}
+
+static const char *httpNotFoundHeader = "HTTP/1.1 404 Not Found\r\nServer: esp-link\r\n"
+  "Content-Type: text/plain\r\nContent-Length: 12\r\n";
 
-  int r = conn->cgi(conn); //Execute cgi fn.
-  if (r == HTTPD_CGI_DONE) {
-    conn->cgi = NULL; //mark for destruction.
+//Build the url lookup tables for builtInUrls.
+static void ICACHE_FLASH_ATTR httpdIndexUrls(void) {
+  int count = 0, wildcards = 0, i;
+  while (builtInUrls[count].url != NULL) {
+    int len = os_strlen(builtInUrls[count].url);
+    if (len > 0 && builtInUrls[count].url[len - 1] == '*') wildcards++;
+    count++;
   }
-  if (r == HTTPD_CGI_NOTFOUND || r == HTTPD_CGI_AUTHENTICATED) {
-    DBG("%sERROR! Bad CGI code %d\n", connStr, r);
-    conn->cgi = NULL; //mark for destruction.
+  if (count > 255) {
+    os_printf("Httpd: only 255 built-in urls are supported, got %d\n", count);
+    count = 255;
   }
-  xmitSendBuff(conn);
+
+  //at most half of the slots are used, so the probe sequences stay short
+  int slots = 8;
+  while (slots < 2 * (count - wildcards)) slots <<= 1;
+  urlSlots = (HttpdUrlSlot *)os_zalloc(slots * sizeof(HttpdUrlSlot));
+  urlSlotMask = slots - 1;
+  wildcardUrls = (HttpdWildcardUrl *)os_zalloc((wildcards > 0 ? wildcards : 1) * sizeof(HttpdWildcardUrl));
+  wildcardUrlCount = 0;
+
+  for (i = 0; i < count; i++) {
+    const char *url = builtInUrls[i].url;
+    int len = os_strlen(url);
+    if (len > 0 && url[len - 1] == '*') {
+      wildcardUrls[wildcardUrlCount].index = i;
+      wildcardUrls[wildcardUrlCount].prefixLen = len - 1;
+      wildcardUrlCount++;
+      continue;
+    }
+    //duplicates are inserted in table order, so a probe finds them in that order too
+    uint32 hash = espFsNameHash(url);
+    int s = hash & urlSlotMask;
+    while (urlSlots[s].index != 0) s = (s + 1) & urlSlotMask;
+    urlSlots[s].hash = hash >> 16;
+    urlSlots[s].index = i + 1;
+  }
+  DBG("Httpd: %d urls, %d wildcards, %d hash slots\n", count, wildcardUrlCount, slots);
 }
 
-static const char *httpNotFoundHeader = "HTTP/1.0 404 Not Found\r\nConnection: close\r\n"
-  "Content-Type: text/plain\r\nContent-Length: 12\r\n\r\nNot Found.\r\n";
+//Find the first entry of builtInUrls at or after index start, which matches the url.
+//Returns the index or -1 if there is none.
+static int ICACHE_FLASH_ATTR httpdFindUrl(const char *url, int start) {
+  int found = -1, i;
+
+  //exact match: one hash and usually one string compare
+  uint32 hash = espFsNameHash(url);
+  int s = hash & urlSlotMask;
+  while (urlSlots[s].index != 0) {
+    int index = urlSlots[s].index - 1;
+    if (urlSlots[s].hash == (hash >> 16) && index >= start &&
+        os_strcmp(builtInUrls[index].url, url) == 0) {
+      found = index;
+      break;
+    }
+    s = (s + 1) & urlSlotMask;
+  }
+
+  //an earlier wildcard entry takes precedence
+  for (i = 0; i < wildcardUrlCount; i++) {
+    int index = wildcardUrls[i].index;
+    if (found >= 0 && index > found) break;
+    if (index < start) continue;
+    if (os_strncmp(builtInUrls[index].url, url, wildcardUrls[i].prefixLen) == 0) return index;
+  }
+  return found;
+}
 
 //This is called when the headers have been received and the connection is ready to send
 //the result headers and data.
@@ -345,32 +1106,24 @@ static void ICACHE_FLASH_ATTR httpdProcessRequest(HttpdConnData *conn) {
   while (1) {
     //Look up URL in the built-in URL table.
     if (conn->cgi == NULL) {
-      while (builtInUrls[i].url != NULL) {
-        int match = 0;
-        //See if there's a literal match
-        if (os_strcmp(builtInUrls[i].url, conn->url) == 0) match = 1;
-        //See if there's a wildcard match
-        if (builtInUrls[i].url[os_strlen(builtInUrls[i].url) - 1] == '*' &&
-          os_strncmp(builtInUrls[i].url, conn->url, os_strlen(builtInUrls[i].url) - 1) == 0) match = 1;
-        if (match) {
-          //os_printf("Is url index %d\n", i);
-          conn->cgiData = NULL;
-          conn->cgi = builtInUrls[i].cgiCb;
-          conn->cgiArg = builtInUrls[i].cgiArg;
-          break;
-        }
-        i++;
-      }
-      if (builtInUrls[i].url == NULL) {
+      i = httpdFindUrl(conn->url, i);
+      if (i < 0) {
         //Drat, we're at the end of the URL table. This usually shouldn't happen. Well, just
         //generate a built-in 404 to handle this.
         DBG("%s%s not found. 404!\n", connStr, conn->url);
+        conn->priv->code = 404;
+        conn->priv->flags |= CONN_LENGTH;
         httpdSend(conn, httpNotFoundHeader, -1);
-        xmitSendBuff(conn);
+        httpdEndHeaders(conn);
+        httpdSend(conn, "Not Found.\r\n", -1);
         conn->cgi = NULL; //mark for destruction.
-        if (conn->post) conn->post->len = 0; // skip any remaining receives
+        conn->priv->flags |= CONN_SKIP; // skip any remaining receives
+        xmitSendBuff(conn);
         return;
       }
+      conn->cgiData = NULL;
+      conn->cgi = builtInUrls[i].cgiCb;
+      conn->cgiArg = builtInUrls[i].cgiArg;
     }
 
     //Okay, we have a CGI function that matches the URL. See if it wants to handle the
@@ -383,9 +1136,9 @@ static void ICACHE_FLASH_ATTR httpdProcessRequest(HttpdConnData *conn) {
     }
     else if (r == HTTPD_CGI_DONE) {
       //Yep, it's happy to do so and already is done sending data.
-      xmitSendBuff(conn);
       conn->cgi = NULL; //mark for destruction.
-      if (conn->post) conn->post->len = 0; // skip any remaining receives
+      conn->priv->flags |= CONN_SKIP; // skip any remaining receives
+      xmitSendBuff(conn);
       return;
     }
     else {
@@ -400,60 +1153,114 @@ static void ICACHE_FLASH_ATTR httpdProcessRequest(HttpdConnData *conn) {
   }
 }
 
-//Parse a line of header data and modify the connection data accordingly.
-static void ICACHE_FLASH_ATTR httpdParseHeader(char *h, HttpdConnData *conn) {
+//Parse the request line and modify the connection data accordingly.
+static void ICACHE_FLASH_ATTR httpdParseRequestLine(char *h, HttpdConnData *conn) {
   int i;
-  char first_line = false;
 
   if (os_strncmp(h, "GET ", 4) == 0) {
     conn->requestType = HTTPD_METHOD_GET;
-    first_line = true;
   }
   else if (os_strncmp(h, "POST ", 5) == 0) {
     conn->requestType = HTTPD_METHOD_POST;
-    first_line = true;
+  }
+  else {
+    return;
+  }
+
+  char *e;
+
+  //Skip past the space after POST/GET
+  i = 0;
+  while (h[i] != ' ') i++;
+  conn->url = h + i + 1;
+
+  //Figure out end of url.
+  e = (char*)os_strstr(conn->url, " ");
+  if (e == NULL) return; //wtf?
+  *e = 0; //terminate url part
+
+  //HTTP/1.1 connections are persistent by default
+  if (os_strncmp(e + 1, "HTTP/1.1", 8) == 0) {
+    conn->priv->flags |= CONN_HTTP11 | CONN_KEEPALIVE;
   }
 
-  if (first_line) {
-    char *e;
+  // Count number of open connections
+  //esp_tcp *tcp = conn->conn->proto.tcp;
+  //DBG("%sHTTP %s %s from %s\n", connStr,
+  //  conn->requestType == HTTPD_METHOD_GET ? "GET" : "POST", conn->url, conn->priv->from);
+  //Parse out the URL part before the GET parameters.
+  conn->getArgs = (char*)os_strstr(conn->url, "?");
+  if (conn->getArgs != 0) {
+    *conn->getArgs = 0;
+    conn->getArgs++;
+    //DBG("%sargs = %s\n", connStr, conn->getArgs);
+  }
+  else {
+    conn->getArgs = NULL;
+  }
+}
 
-    //Skip past the space after POST/GET
-    i = 0;
-    while (h[i] != ' ') i++;
-    conn->url = h + i + 1;
+//Remember the value of a header line, if it is one of knownHeaders.
+static void ICACHE_FLASH_ATTR httpdParseHeaderLine(char *h, HttpdConnData *conn) {
+  int len = 0;
+  while (h[len] != ':') {
+    if (h[len] == 0) return; //no header
+    len++;
+  }
 
-    //Figure out end of url.
-    e = (char*)os_strstr(conn->url, " ");
-    if (e == NULL) return; //wtf?
-    *e = 0; //terminate url part
+  for (int i = 0; i<HTTPD_HEADER_COUNT; i++) {
+    if (httpdHeaderNameEquals(h, knownHeaders[i], len)) {
+      char *v = h + len + 1;
+      //Skip past spaces after the colon
+      while (*v == ' ' || *v == '\t') v++;
+      conn->priv->headerValues[i] = v - conn->priv->head;
+      return;
+    }
+  }
+}
+
+//All headers have been received. Prepare for receiving the POST data.
+static void ICACHE_FLASH_ATTR httpdHeadersDone(HttpdConnData *conn) {
+  char *v;
 
-    // Count number of open connections
-    //esp_tcp *tcp = conn->conn->proto.tcp;
-    //DBG("%sHTTP %s %s from %s\n", connStr,
-    //  conn->requestType == HTTPD_METHOD_GET ? "GET" : "POST", conn->url, conn->priv->from);
-    //Parse out the URL part before the GET parameters.
-    conn->getArgs = (char*)os_strstr(conn->url, "?");
-    if (conn->getArgs != 0) {
-      *conn->getArgs = 0;
-      conn->getArgs++;
-      //DBG("%sargs = %s\n", connStr, conn->getArgs);
+  //Indicate we're done with the headers.
+  conn->post->len = 0;
+
+  v = httpdGetHeaderValue(conn, HTTPD_HEADER_CONNECTION);
+  if (v != NULL) {
+    //The tokens are case-insensitive
+    for (char *c = v; *c != 0; c++) {
+      if (*c >= 'A' && *c <= 'Z') *c += 'a' - 'A';
     }
-    else {
-      conn->getArgs = NULL;
+    if (os_strstr(v, "close") != NULL) {
+      conn->priv->flags &= ~CONN_KEEPALIVE;
     }
+    else if (os_strstr(v, "keep-alive") != NULL) {
+      conn->priv->flags |= CONN_KEEPALIVE;
+    }
+  }
 
+  v = httpdGetHeaderValue(conn, HTTPD_HEADER_CONTENT_TYPE);
+  if (v != NULL && os_strstr(v, "multipart/form-data")) {
+    // It's multipart form data so let's pull out the boundary for future use
+    char *b;
+    if ((b = os_strstr(v, "boundary=")) != NULL) {
+      conn->post->multipartBoundary = b + 7; // move the pointer 2 chars before boundary then fill them with dashes
+      conn->post->multipartBoundary[0] = '-';
+      conn->post->multipartBoundary[1] = '-';
+      //DBG("boundary = %s\n", conn->post->multipartBoundary);
+    }
   }
-  else if (os_strncmp(h, "Content-Length:", 15) == 0) {
-    i = 15;
-    //Skip trailing spaces
-    while (h[i] == ' ') i++;
+
+  v = httpdGetHeaderValue(conn, HTTPD_HEADER_CONTENT_LENGTH);
+  if (v != NULL) {
     //Get POST data length
-    conn->post->len = atoi(h + i);
+    conn->post->len = atoi(v);
 
     // Allocate the buffer
     if (conn->post->len > MAX_POST) {
       // we'll stream this in in chunks
-      conn->post->buffSize = MAX_POST;
+      conn->post->buffSize = MAX_POST_CHUNK;
     }
     else {
       conn->post->buffSize = conn->post->len;
@@ -462,32 +1269,65 @@ static void ICACHE_FLASH_ATTR httpdParseHeader(char *h, HttpdConnData *conn) {
     conn->post->buff = (char*)os_malloc(conn->post->buffSize + 1);
     conn->post->buffLen = 0;
   }
-  else if (os_strncmp(h, "Content-Type: ", 14) == 0) {
-    if (os_strstr(h, "multipart/form-data")) {
-      // It's multipart form data so let's pull out the boundary for future use
-      char *b;
-      if ((b = os_strstr(h, "boundary=")) != NULL) {
-        conn->post->multipartBoundary = b + 7; // move the pointer 2 chars before boundary then fill them with dashes
-        conn->post->multipartBoundary[0] = '-';
-        conn->post->multipartBoundary[1] = '-';
-        //DBG("boundary = %s\n", conn->post->multipartBoundary);
-      }
-    }
-  }
 }
 
+//Receive one byte of the request head.
+//Each line is parsed as soon as it is complete, the empty line ends the head.
+//Returns true, if the head is complete.
+static bool ICACHE_FLASH_ATTR httpdHeadByte(HttpdConnData *conn, char c) {
+  HttpdPriv *priv = conn->priv;
+  if (c == '\r') return false; //the line ends with \n
+
+  if (c != '\n') {
+    //Too long lines get truncated, a zero terminator has to fit always
+    if (priv->headPos < MAX_HEAD_LEN - 1) priv->head[priv->headPos++] = c;
+    priv->lineLen++;
+    return false;
+  }
 
-//Callback called when there's data available on a socket.
-static void ICACHE_FLASH_ATTR httpdRecvCb(void *arg, char *data, unsigned short len) {
-  debugConn(arg, "httpdRecvCb");
-  struct espconn* pCon = (struct espconn *)arg;
-  HttpdConnData *conn = (HttpdConnData *)pCon->reverse;
-  if (conn == NULL) return; // aborted connection
+  char *line = priv->head + priv->lineStart;
+  priv->head[priv->headPos] = 0;
+  if (priv->lineLen == 0) {
+    //Empty lines in front of the request line are ignored
+    return (priv->lineStart != 0);
+  }
+  priv->lineLen = 0;
+
+  if (priv->lineStart == 0) {
+    httpdParseRequestLine(line, conn);
+    priv->headersStart = priv->headPos + 1;
+  }
+  else {
+    httpdParseHeaderLine(line, conn);
+  }
 
-  char sendBuff[MAX_SENDBUFF_LEN];
-  conn->priv->sendBuff = sendBuff;
-  conn->priv->sendBuffLen = 0;
+  //Keep the zero terminator of the line
+  if (priv->headPos < MAX_HEAD_LEN - 1) priv->headPos++;
+  priv->lineStart = priv->headPos;
+  return false;
+}
 
+//Buffer bytes of pipelined requests until the current response has been sent.
+static void ICACHE_FLASH_ATTR httpdPipeline(HttpdConnData *conn, char *data, unsigned short len) {
+  HttpdPriv *priv = conn->priv;
+  if (priv->pipelinedLen + len > MAX_PIPELINED) {
+    DBG("%sERROR! too many pipelined requests\n", connStr);
+    priv->flags &= ~CONN_KEEPALIVE; // close after the current response
+    return;
+  }
+  char *buff = (char*)os_malloc(priv->pipelinedLen + len);
+  if (buff == NULL) return;
+  if (priv->pipelined != NULL) {
+    os_memcpy(buff, priv->pipelined, priv->pipelinedLen);
+    os_free(priv->pipelined);
+  }
+  os_memcpy(buff + priv->pipelinedLen, data, len);
+  priv->pipelined = buff;
+  priv->pipelinedLen += len;
+}
+
+//Parse received request data. Requires conn->priv->sendBuff to be set.
+static void ICACHE_FLASH_ATTR httpdParseData(HttpdConnData *conn, char *data, unsigned short len) {
   //This is slightly evil/dirty: we abuse conn->post->len as a state variable for where in the http communications we are:
   //<0 (-1): Post len unknown because we're still receiving headers
   //==0: No post data
@@ -495,38 +1335,52 @@ static void ICACHE_FLASH_ATTR httpdRecvCb(void *arg, char *data, unsigned short
   //ToDo: See if we can use something more elegant for this.
 
   for (int x = 0; x<len; x++) {
+    if (conn->priv->flags & CONN_WEBSOCKET) {
+      //The request has been upgraded, the rest are WebSocket frames
+      httpdWsParse(conn, data + x, len - x);
+      return;
+    }
+    if (conn->priv->flags & CONN_RECEIVED) {
+      //The response is still being sent. Keep the following requests for later.
+      httpdPipeline(conn, data + x, len - x);
+      return;
+    }
     if (conn->post->len<0) {
       //This byte is a header byte.
-      if (conn->priv->headPos != MAX_HEAD_LEN) conn->priv->head[conn->priv->headPos++] = data[x];
-      conn->priv->head[conn->priv->headPos] = 0;
-      //Scan for /r/n/r/n. Receiving this indicate the headers end.
-      if (data[x] == '\n' && (char *)os_strstr(conn->priv->head, "\r\n\r\n") != NULL) {
-        //Indicate we're done with the headers.
-        conn->post->len = 0;
-        //Reset url data
-        conn->url = NULL;
-        //Iterate over all received headers and parse them.
-        char *p = conn->priv->head;
-        while (p<(&conn->priv->head[conn->priv->headPos - 4])) {
-          char *e = (char *)os_strstr(p, "\r\n"); //Find end of header line
-          if (e == NULL) break;     //Shouldn't happen.
-          e[0] = 0;           //Zero-terminate header
-          httpdParseHeader(p, conn);  //and parse it.
-          p = e + 2;            //Skip /r/n (now /0/n)
-        }
+      if (httpdHeadByte(conn, data[x])) {
+        httpdHeadersDone(conn);
         //If we don't need to receive post data, we can send the response now.
         if (conn->post->len == 0) {
+          conn->priv->flags |= CONN_RECEIVED;
           httpdProcessRequest(conn);
         }
       }
     }
+    else if (conn->priv->flags & CONN_SKIP) {
+      //The cgi is done, count the rest of the body without passing it on.
+      int n = len - x;
+      if (n > conn->post->len - conn->post->received) n = conn->post->len - conn->post->received;
+      conn->post->received += n;
+      x += n - 1;
+      if (conn->post->received == conn->post->len) {
+        conn->priv->flags |= CONN_RECEIVED;
+        //The response may have been sent completely already
+        if (conn->cgi == NULL && !(conn->priv->flags & CONN_SENDING)) httpdResponseDone(conn);
+      }
+    }
     else if (conn->post->len != 0) {
-      //This byte is a POST byte.
-      conn->post->buff[conn->post->buffLen++] = data[x];
-      conn->post->received++;
+      //These bytes are POST bytes, copy as many as fit into the buffer at once.
+      int n = len - x;
+      if (n > conn->post->buffSize - conn->post->buffLen) n = conn->post->buffSize - conn->post->buffLen;
+      if (n > conn->post->len - conn->post->received) n = conn->post->len - conn->post->received;
+      os_memcpy(conn->post->buff + conn->post->buffLen, data + x, n);
+      conn->post->buffLen += n;
+      conn->post->received += n;
+      x += n - 1;
       if (conn->post->buffLen >= conn->post->buffSize || conn->post->received == conn->post->len) {
         //Received a chunk of post data
         conn->post->buff[conn->post->buffLen] = 0; //zero-terminate, in case the cgi handler knows it can use strings
+        if (conn->post->received == conn->post->len) conn->priv->flags |= CONN_RECEIVED;
         //Send the response.
         httpdProcessRequest(conn);
         conn->post->buffLen = 0;
@@ -535,6 +1389,29 @@ static void ICACHE_FLASH_ATTR httpdRecvCb(void *arg, char *data, unsigned short
   }
 }
 
+//Callback called when there's data available on a socket.
+static void ICACHE_FLASH_ATTR httpdRecvCb(void *arg, char *data, unsigned short len) {
+  debugConn(arg, "httpdRecvCb");
+  struct espconn* pCon = (struct espconn *)arg;
+  HttpdConnData *conn = (HttpdConnData *)pCon->reverse;
+  if (conn == NULL) return; // aborted connection
+
+  if (conn->priv->flags & CONN_WEBSOCKET) {
+    httpdWsRecv(conn, data, len);
+    return;
+  }
+
+  int lease = httpdLeaseSendBuff(conn);
+  if (lease < 0) {
+    espconn_disconnect(conn->conn);
+    return;
+  }
+
+  httpdParseData(conn, data, len);
+
+  httpdReturnSendBuff(conn, lease);
+}
+
 static void ICACHE_FLASH_ATTR httpdDisconCb(void *arg) {
   debugConn(arg, "httpdDisconCb");
   struct espconn* pCon = (struct espconn *)arg;
@@ -562,6 +1439,18 @@ static void ICACHE_FLASH_ATTR httpdConnectCb(void *arg) {
   // Find empty conndata in pool
   int i;
   for (i = 0; i<MAX_CONN; i++) if (connData[i].conn == NULL) break;
+  // Otherwise close an idle keep-alive connection, which is waiting for its next request
+  if (i == MAX_CONN) {
+    for (i = 0; i<MAX_CONN; i++) {
+      if (connData[i].cgi == NULL && connData[i].post->len < 0 && connData[i].priv->headPos == 0 &&
+          connData[i].priv->pipelined == NULL) {
+        DBG("%sHTTP: closing idle connection\n", connStr);
+        espconn_disconnect(connData[i].conn);
+        httpdRetireConn(&connData[i]);
+        break;
+      }
+    }
+  }
   //DBG("Con req, conn=%p, pool slot %d\n", conn, i);
   if (i == MAX_CONN) {
     DBG("%sHTTP: conn pool overflow!\n", connStr);
@@ -578,17 +1467,17 @@ static void ICACHE_FLASH_ATTR httpdConnectCb(void *arg) {
   connData[i].priv = &connPrivData[i];
   connData[i].conn = conn;
   conn->reverse = connData+i;
-  connData[i].priv->headPos = 0;
+  connData[i].priv->pipelined = NULL;
+  connData[i].priv->pipelinedLen = 0;
+  connData[i].priv->pong = NULL;
+  connData[i].priv->pongLen = 0;
 
   esp_tcp *tcp = conn->proto.tcp;
   os_sprintf(connData[i].priv->from, "%d.%d.%d.%d:%d", tcp->remote_ip[0], tcp->remote_ip[1],
       tcp->remote_ip[2], tcp->remote_ip[3], tcp->remote_port);
   connData[i].post = &connPostData[i];
   connData[i].post->buff = NULL;
-  connData[i].post->buffLen = 0;
-  connData[i].post->received = 0;
-  connData[i].post->len = -1;
-  connData[i].startTime = system_get_time();
+  httpdResetConn(&connData[i]);
 
   espconn_regist_recvcb(conn, httpdRecvCb);
   espconn_regist_reconcb(conn, httpdReconCb);
@@ -596,6 +1485,8 @@ static void ICACHE_FLASH_ATTR httpdConnectCb(void *arg) {
   espconn_regist_sentcb(conn, httpdSentCb);
 
   espconn_set_opt(conn, ESPCONN_REUSEADDR | ESPCONN_NODELAY);
+  // idle keep-alive connections get closed after this time
+  espconn_regist_time(conn, KEEPALIVE_TIMEOUT, 1);
 }
 
 //Httpd initialization routine. Call this to kick off webserver functionality.
@@ -610,8 +1501,10 @@ void ICACHE_FLASH_ATTR httpdInit(HttpdBuiltInUrl *fixedUrls, int port) {
   httpdTcp.local_port = port;
   httpdConn.proto.tcp = &httpdTcp;
   builtInUrls = fixedUrls;
+  httpdIndexUrls();
   DBG("Httpd init, conn=%p\n", &httpdConn);
   espconn_regist_connectcb(&httpdConn, httpdConnectCb);
   espconn_accept(&httpdConn);
-  espconn_tcp_set_max_con_allow(&httpdConn, MAX_CONN);
+  // one more than the pool, so that a new connection can close an idle keep-alive one
+  espconn_tcp_set_max_con_allow(&httpdConn, MAX_CONN + 1);
 }
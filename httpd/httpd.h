@@ -12,12 +12,38 @@
 #define HTTPD_METHOD_POST 2
 
 
+//Request headers, which are parsed while receiving the request
+typedef enum {
+	HTTPD_HEADER_CONTENT_LENGTH,
+	HTTPD_HEADER_CONTENT_TYPE,
+	HTTPD_HEADER_ACCEPT_ENCODING,
+	HTTPD_HEADER_AUTHORIZATION,
+	HTTPD_HEADER_IF_NONE_MATCH,
+	HTTPD_HEADER_CONNECTION,
+	HTTPD_HEADER_UPGRADE,
+	HTTPD_HEADER_SEC_WEBSOCKET_KEY,
+	HTTPD_HEADER_LAST_EVENT_ID,
+	HTTPD_HEADER_COUNT
+} HttpdHeader;
+
 typedef struct HttpdPriv HttpdPriv;
 typedef struct HttpdConnData HttpdConnData;
 typedef struct HttpdPostData HttpdPostData;
 
 typedef int (* cgiSendCallback)(HttpdConnData *connData);
 
+//WebSocket frame opcodes
+#define WS_OPCODE_CONTINUATION 0x0
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+
+//Called for each received WebSocket text or binary message. Replies can be sent with
+//httpdWsSend, which fails while an earlier frame is still being sent.
+typedef void (* httpdWsRecvCallback)(HttpdConnData *connData, int opcode, char *data, int len);
+
 //A struct describing a http connection. This gets passed to cgi functions.
 struct HttpdConnData {
 	struct espconn *conn;
@@ -57,12 +83,26 @@ int ICACHE_FLASH_ATTR cgiRedirect(HttpdConnData *connData);
 void ICACHE_FLASH_ATTR httpdRedirect(HttpdConnData *conn, char *newUrl);
 int httpdUrlDecode(char *val, int valLen, char *ret, int retLen);
 int ICACHE_FLASH_ATTR httpdFindArg(char *line, char *arg, char *buff, int buffLen);
+char ICACHE_FLASH_ATTR *httpdGetArg(HttpdConnData *conn, const char *name, int *len);
 void ICACHE_FLASH_ATTR httpdInit(HttpdBuiltInUrl *fixedUrls, int port);
 const char *httpdGetMimetype(char *url);
 void ICACHE_FLASH_ATTR httpdStartResponse(HttpdConnData *conn, int code);
 void ICACHE_FLASH_ATTR httpdHeader(HttpdConnData *conn, const char *field, const char *val);
 void ICACHE_FLASH_ATTR httpdEndHeaders(HttpdConnData *conn);
+void ICACHE_FLASH_ATTR httpdEndPrebakedHeaders(HttpdConnData *conn, int code, int len);
 int ICACHE_FLASH_ATTR httpdGetHeader(HttpdConnData *conn, char *header, char *ret, int retLen);
+char ICACHE_FLASH_ATTR *httpdGetHeaderValue(HttpdConnData *conn, HttpdHeader header);
 int ICACHE_FLASH_ATTR httpdSend(HttpdConnData *conn, const char *data, int len);
+char ICACHE_FLASH_ATTR *httpdSendBuffer(HttpdConnData *conn, int *len);
+void ICACHE_FLASH_ATTR httpdSendCommit(HttpdConnData *conn, int len);
+int ICACHE_FLASH_ATTR httpdWsUpgrade(HttpdConnData *conn, httpdWsRecvCallback recvCb);
+char ICACHE_FLASH_ATTR *httpdWsFrameBuffer(HttpdConnData *conn, int *len);
+void ICACHE_FLASH_ATTR httpdWsFrameCommit(HttpdConnData *conn, int opcode, int len);
+int ICACHE_FLASH_ATTR httpdWsSend(HttpdConnData *conn, int opcode, const char *data, int len);
+void ICACHE_FLASH_ATTR httpdWsClose(HttpdConnData *conn, int status);
+int ICACHE_FLASH_ATTR httpdWsPoll(cgiSendCallback cgi);
+int ICACHE_FLASH_ATTR httpdStreamStart(HttpdConnData *conn);
+int ICACHE_FLASH_ATTR httpdSendEvent(HttpdConnData *conn, int id, const char *text, int len);
+int ICACHE_FLASH_ATTR httpdStreamPoll(cgiSendCallback cgi);
 
 #endif
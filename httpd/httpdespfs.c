@@ -16,7 +16,7 @@ Connector to let httpd use the espfs filesystem to serve the files in it.
 
 // The static files marked with FLAG_GZIP are compressed and will be served with GZIP compression.
 // If the client does not advertise that he accepts GZIP send following warning message (telnet users for e.g.)
-static const char *gzipNonSupportedMessage = "HTTP/1.0 501 Not implemented\r\nServer: esp8266-httpd/"HTTPDVER"\r\nConnection: close\r\nContent-Type: text/plain\r\nContent-Length: 52\r\n\r\nYour browser does not accept gzip-compressed data.\r\n";
+static const char *gzipNonSupportedMessage = "Your browser does not accept gzip-compressed data.\r\n";
 
 
 //This is a catch-all cgi function. It takes the url passed to it, looks up the corresponding
@@ -26,8 +26,6 @@ int ICACHE_FLASH_ATTR
 cgiEspFsHook(HttpdConnData *connData) {
 	EspFsFile *file=connData->cgiData;
 	int len;
-	char buff[1024];
-	char acceptEncodingBuffer[64];
 	int isGzip;
 
 	//os_printf("cgiEspFsHook conn=%p conn->conn=%p file=%p\n", connData, connData->conn, file);
@@ -55,29 +53,83 @@ cgiEspFsHook(HttpdConnData *connData) {
 		if (isGzip) {
 			// Check the browser's "Accept-Encoding" header. If the client does not
 			// advertise that he accepts GZIP send a warning message (telnet users for e.g.)
-			httpdGetHeader(connData, "Accept-Encoding", acceptEncodingBuffer, 64);
-			if (os_strstr(acceptEncodingBuffer, "gzip") == NULL) {
+			const char *acceptEncoding = httpdGetHeaderValue(connData, HTTPD_HEADER_ACCEPT_ENCODING);
+			if (acceptEncoding == NULL || os_strstr(acceptEncoding, "gzip") == NULL) {
 				//No Accept-Encoding: gzip header present
+				char lenBuff[8];
+				os_sprintf(lenBuff, "%d", (int)os_strlen(gzipNonSupportedMessage));
+				httpdStartResponse(connData, 501);
+				httpdHeader(connData, "Content-Type", "text/plain");
+				httpdHeader(connData, "Content-Length", lenBuff);
+				httpdEndHeaders(connData);
 				httpdSend(connData, gzipNonSupportedMessage, -1);
 				espFsClose(file);
 				return HTTPD_CGI_DONE;
 			}
 		}
 
+		//The hash of the stored data is a strong validator, so a cached copy
+		//can be revalidated without sending the file again.
+		uint8_t hash[ESPFS_HASH_LEN];
+		char etag[2*ESPFS_HASH_LEN+3];
+		bool hasEtag=espFsHash(file, hash);
+		if (hasEtag) {
+			char *p=etag;
+			*p++='"';
+			for (int i=ESPFS_HASH_LEN-1; i>=0; i--) p+=os_sprintf(p, "%02x", hash[i]);
+			*p++='"';
+			*p=0;
+
+			const char *ifNoneMatch=httpdGetHeaderValue(connData, HTTPD_HEADER_IF_NONE_MATCH);
+			if (ifNoneMatch!=NULL && (os_strstr(ifNoneMatch, etag)!=NULL || os_strcmp(ifNoneMatch, "*")==0)) {
+				httpdStartResponse(connData, 304);
+				httpdHeader(connData, "ETag", etag);
+				httpdHeader(connData, "Cache-Control", "max-age=3600, must-revalidate");
+				httpdEndHeaders(connData);
+				espFsClose(file);
+				return HTTPD_CGI_DONE;
+			}
+		}
+
 		connData->cgiData=file;
+
+		//Images built with prebaked headers need just a copy of them
+		int space;
+		char *buff=httpdSendBuffer(connData, &space);
+		int headersLen=espFsHeaders(file, buff, space);
+		if (headersLen>0) {
+			httpdEndPrebakedHeaders(connData, 200, headersLen);
+			return HTTPD_CGI_MORE;
+		}
+
 		httpdStartResponse(connData, 200);
 		httpdHeader(connData, "Content-Type", httpdGetMimetype(connData->url));
 		if (isGzip) {
 			httpdHeader(connData, "Content-Encoding", "gzip");
 		}
 		httpdHeader(connData, "Cache-Control", "max-age=3600, must-revalidate");
+		if (hasEtag) {
+			httpdHeader(connData, "ETag", etag);
+		}
+		//The length allows to keep the connection open without chunked encoding
+		char lenBuff[12];
+		os_sprintf(lenBuff, "%d", espFsSize(file));
+		httpdHeader(connData, "Content-Length", lenBuff);
 		httpdEndHeaders(connData);
 		return HTTPD_CGI_MORE;
 	}
 
-	len=espFsRead(file, buff, 1024);
-	if (len>0) espconn_sent(connData->conn, (uint8 *)buff, len);
-	if (len!=1024) {
+	//Read straight into the send buffer
+	int space;
+	char *buff=httpdSendBuffer(connData, &space);
+	if (buff==NULL) {
+		espFsClose(file);
+		return HTTPD_CGI_DONE;
+	}
+	if (space>1024) space=1024;
+	len=espFsRead(file, buff, space);
+	if (len>0) httpdSendCommit(connData, len);
+	if (len!=space) {
 		//We're done.
 		espFsClose(file);
 		return HTTPD_CGI_DONE;
@@ -0,0 +1,190 @@
+/*
+Streaming JSON writer for cgi responses, see jsonwriter.h
+*/
+
+#include <esp8266.h>
+#include "httpd.h"
+#include "jsonwriter.h"
+
+#ifdef HTTPD_DBG
+#define DBG(format, ...) do { os_printf(format, ## __VA_ARGS__); } while(0)
+#else
+#define DBG(format, ...) do { } while(0)
+#endif
+
+//Escape of the chars up to '\\', 0 means the char is copied, 'u' is written as \u00XX and all
+//others as a backslash followed by the table entry. Chars above '\\' don't need escaping.
+static const uint8_t jsonEscTab[] = {
+  'u','u','u','u','u','u','u','u','b','t','n','u','f','r','u','u',
+  'u','u','u','u','u','u','u','u','u','u','u','u','u','u','u','u',
+    0,  0,'"',  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,'\\',
+};
+
+static const char hexDigits[] = "0123456789abcdef";
+
+//Starts the output of the cgi. The send buffer may hold the headers already. state is the
+//value returned by jsonEnd of the previous call, 0 for the first call.
+void ICACHE_FLASH_ATTR jsonStart(JsonWriter *w, HttpdConnData *conn, int state) {
+  os_memset(w, 0, sizeof(JsonWriter));
+  w->conn = conn;
+  w->buff = httpdSendBuffer(conn, &w->space);
+  w->done = state > 0 ? state - 1 : 0;
+  if (w->buff == NULL) w->full = true;
+}
+
+//Commits the written items to the send buffer. Returns 0, if the output is complete, otherwise
+//the state to be passed to jsonStart by the next call: the number of items sent so far plus
+//one, so it isn't 0 even if no item fitted into the send buffer yet.
+int ICACHE_FLASH_ATTR jsonEnd(JsonWriter *w) {
+  if (w->buff == NULL) return 0;
+  httpdSendCommit(w->conn, w->len);
+  return w->full ? w->done + 1 : 0;
+}
+
+static void ICACHE_FLASH_ATTR jsonItemStart(JsonWriter *w) {
+  w->mark = w->len;
+  w->over = false;
+  w->write = !w->full && w->item >= w->done;
+}
+
+static void ICACHE_FLASH_ATTR jsonItemEnd(JsonWriter *w) {
+  if (w->write) {
+    if (!w->over) {
+      w->done = w->item + 1;
+    } else {
+      // cut the output before this item, the next call starts with it in an empty send
+      // buffer, which holds any item (JSON_ITEM_MAX)
+      w->len = w->mark;
+      w->full = true;
+    }
+  }
+  w->item++;
+}
+
+static void ICACHE_FLASH_ATTR jsonPut(JsonWriter *w, const char *data, int len) {
+  if (!w->write || w->over) return;
+  if (w->len + len > w->space) {
+    w->over = true;
+    return;
+  }
+  os_memcpy(w->buff + w->len, data, len);
+  w->len += len;
+}
+
+//Writes the chars escaped as required by JSON, chars of 0x80 and above (UTF-8) are copied.
+static void ICACHE_FLASH_ATTR jsonPutEscaped(JsonWriter *w, const char *data, int len) {
+  if (!w->write || w->over) return;
+  char *b = w->buff + w->len;
+  char *end = w->buff + w->space;
+  for (int i = 0; i < len; i++) {
+    uint8_t c = data[i];
+    uint8_t e = c < sizeof(jsonEscTab) ? jsonEscTab[c] : 0;
+    if (e == 0) {
+      if (b >= end) goto full;
+      *b++ = c;
+    } else if (e != 'u') {
+      if (b + 2 > end) goto full;
+      *b++ = '\\';
+      *b++ = e;
+    } else {
+      if (b + 6 > end) goto full;
+      os_memcpy(b, "\\u00", 4);
+      b[4] = hexDigits[c >> 4];
+      b[5] = hexDigits[c & 0xf];
+      b += 6;
+    }
+  }
+  w->len = b - w->buff;
+  return;
+full:
+  w->over = true;
+}
+
+//Writes the separator and the key of the next value, key is NULL for array elements and the
+//top level value.
+static void ICACHE_FLASH_ATTR jsonKey(JsonWriter *w, const char *key) {
+  if (w->sep) jsonPut(w, ",", 1);
+  w->sep = true;
+  if (key == NULL) return;
+  int len = os_strlen(key);
+  if (len > JSON_SEGMENT_LEN) len = JSON_SEGMENT_LEN;
+  jsonPut(w, "\"", 1);
+  jsonPutEscaped(w, key, len);
+  jsonPut(w, "\":", 2);
+}
+
+static void ICACHE_FLASH_ATTR jsonOpen(JsonWriter *w, const char *key, const char *brace) {
+  jsonItemStart(w);
+  jsonKey(w, key);
+  jsonPut(w, brace, 1);
+  jsonItemEnd(w);
+  w->sep = false;
+}
+
+static void ICACHE_FLASH_ATTR jsonClose(JsonWriter *w, const char *brace) {
+  jsonItemStart(w);
+  jsonPut(w, brace, 1);
+  jsonItemEnd(w);
+  w->sep = true;
+}
+
+void ICACHE_FLASH_ATTR jsonObjectOpen(JsonWriter *w, const char *key) {
+  jsonOpen(w, key, "{");
+}
+
+void ICACHE_FLASH_ATTR jsonObjectClose(JsonWriter *w) {
+  jsonClose(w, "}");
+}
+
+void ICACHE_FLASH_ATTR jsonArrayOpen(JsonWriter *w, const char *key) {
+  jsonOpen(w, key, "[");
+}
+
+void ICACHE_FLASH_ATTR jsonArrayClose(JsonWriter *w) {
+  jsonClose(w, "]");
+}
+
+//Starts a string value, its text is added with jsonStringAppend.
+void ICACHE_FLASH_ATTR jsonStringOpen(JsonWriter *w, const char *key) {
+  jsonItemStart(w);
+  jsonKey(w, key);
+  jsonPut(w, "\"", 1);
+  jsonItemEnd(w);
+}
+
+//Adds text to the string value, which is split into pieces of JSON_SEGMENT_LEN chars, so long
+//texts can be spread over several send buffers. Calls have to pass the same pieces of text on
+//every call of the cgi.
+void ICACHE_FLASH_ATTR jsonStringAppend(JsonWriter *w, const char *data, int len) {
+  while (len > 0) {
+    int n = len < JSON_SEGMENT_LEN ? len : JSON_SEGMENT_LEN;
+    jsonItemStart(w);
+    jsonPutEscaped(w, data, n);
+    jsonItemEnd(w);
+    data += n;
+    len -= n;
+  }
+}
+
+void ICACHE_FLASH_ATTR jsonStringClose(JsonWriter *w) {
+  jsonItemStart(w);
+  jsonPut(w, "\"", 1);
+  jsonItemEnd(w);
+}
+
+void ICACHE_FLASH_ATTR jsonString(JsonWriter *w, const char *key, const char *value) {
+  jsonStringOpen(w, key);
+  jsonStringAppend(w, value, os_strlen(value));
+  jsonStringClose(w);
+}
+
+void ICACHE_FLASH_ATTR jsonInt(JsonWriter *w, const char *key, int value) {
+  char buff[12];
+  jsonItemStart(w);
+  jsonKey(w, key);
+  jsonPut(w, buff, os_sprintf(buff, "%d", value));
+  jsonItemEnd(w);
+}
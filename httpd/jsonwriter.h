@@ -0,0 +1,50 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include "httpd.h"
+
+//Streaming JSON writer, which writes a cgi response straight into the send buffer.
+//The output is made of items: a key with a scalar value, the opening and the closing of an
+//object, array or string and pieces of string values of up to JSON_SEGMENT_LEN chars. An item
+//is written completely or not at all. When the send buffer is full, the cgi returns
+//HTTPD_CGI_MORE and writes the same document again on its next call: the items sent by the
+//previous calls are skipped, so the document has to have the same structure on every call.
+//With a response without Content-Length the body goes out in chunks (see httpdEndHeaders).
+
+//Max length of a piece of a string value, escaped it takes up to 6 times that. Keys are cut
+//to this length as well.
+#define JSON_SEGMENT_LEN 32
+//Max size of an item: separator, escaped key, brace or int. It fits into any empty send
+//buffer, so an item, which doesn't fit, always goes out with the next call.
+#define JSON_ITEM_MAX (6 * JSON_SEGMENT_LEN + 16)
+
+typedef struct {
+  HttpdConnData *conn;
+  char *buff;       // free space of the send buffer
+  int space;        // size of buff
+  int len;          // bytes written into buff
+  int item;         // index of the current item
+  int done;         // number of items, which have been sent by the previous calls
+  int mark;         // len before the current item
+  bool write;       // the current item is written (not skipped)
+  bool over;        // the current item didn't fit
+  bool full;        // the send buffer is full, all further items are skipped
+  bool sep;         // a ',' has to precede the next value
+} JsonWriter;
+
+void jsonStart(JsonWriter *w, HttpdConnData *conn, int done);
+int jsonEnd(JsonWriter *w);
+
+void jsonObjectOpen(JsonWriter *w, const char *key);
+void jsonObjectClose(JsonWriter *w);
+void jsonArrayOpen(JsonWriter *w, const char *key);
+void jsonArrayClose(JsonWriter *w);
+
+void jsonString(JsonWriter *w, const char *key, const char *value);
+void jsonStringOpen(JsonWriter *w, const char *key);
+void jsonStringAppend(JsonWriter *w, const char *data, int len);
+void jsonStringClose(JsonWriter *w);
+
+void jsonInt(JsonWriter *w, const char *key, int value);
+
+#endif
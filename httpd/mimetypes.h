@@ -0,0 +1,27 @@
+#ifndef MIMETYPES_H
+#define MIMETYPES_H
+
+//The mappings from file extensions to mime types, used by httpdGetMimetype and by
+//mkespfsimage for the Content-Type of the prebuilt headers in the espfs image.
+//If you need an extra mime type, add it here.
+
+//Struct to keep extension->mime data in
+typedef struct {
+  const char *ext;
+  const char *mimetype;
+} MimeMap;
+
+static const MimeMap mimeTypes[] = {
+  { "htm", "text/htm" },
+  { "html", "text/html; charset=UTF-8" },
+  { "css", "text/css" },
+  { "js", "text/javascript" },
+  { "txt", "text/plain" },
+  { "jpg", "image/jpeg" },
+  { "jpeg", "image/jpeg" },
+  { "png", "image/png" },
+  { "tpl", "text/html; charset=UTF-8" },
+  { NULL, "text/html" }, //default value
+};
+
+#endif
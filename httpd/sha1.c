@@ -0,0 +1,74 @@
+/* sha1.c : SHA-1 (FIPS 180-1), small and slow. Only used for the WebSocket handshake. */
+#include <esp8266.h>
+#include "sha1.h"
+
+#define ROL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+static void ICACHE_FLASH_ATTR sha1_block(sha1_ctx *ctx, const uint8_t *p) {
+	uint32_t w[16], a, b, c, d, e, f, k, t;
+	int i;
+
+	for (i=0; i<16; i++) {
+		w[i]=((uint32_t)p[4*i]<<24)|((uint32_t)p[4*i+1]<<16)|((uint32_t)p[4*i+2]<<8)|p[4*i+3];
+	}
+	a=ctx->state[0]; b=ctx->state[1]; c=ctx->state[2]; d=ctx->state[3]; e=ctx->state[4];
+	for (i=0; i<80; i++) {
+		/* the message schedule is kept in a 16 word ring */
+		if (i>=16) {
+			t=w[(i+13)&15]^w[(i+8)&15]^w[(i+2)&15]^w[i&15];
+			w[i&15]=ROL(t, 1);
+		}
+		if (i<20) {
+			f=(b&c)|(~b&d);
+			k=0x5A827999;
+		} else if (i<40) {
+			f=b^c^d;
+			k=0x6ED9EBA1;
+		} else if (i<60) {
+			f=(b&c)|(b&d)|(c&d);
+			k=0x8F1BBCDC;
+		} else {
+			f=b^c^d;
+			k=0xCA62C1D6;
+		}
+		t=ROL(a, 5)+f+e+k+w[i&15];
+		e=d; d=c; c=ROL(b, 30); b=a; a=t;
+	}
+	ctx->state[0]+=a; ctx->state[1]+=b; ctx->state[2]+=c; ctx->state[3]+=d; ctx->state[4]+=e;
+}
+
+void ICACHE_FLASH_ATTR sha1_init(sha1_ctx *ctx) {
+	ctx->state[0]=0x67452301;
+	ctx->state[1]=0xEFCDAB89;
+	ctx->state[2]=0x98BADCFE;
+	ctx->state[3]=0x10325476;
+	ctx->state[4]=0xC3D2E1F0;
+	ctx->count=0;
+}
+
+void ICACHE_FLASH_ATTR sha1_update(sha1_ctx *ctx, const void *data, size_t len) {
+	const uint8_t *p=data;
+	while (len--) {
+		ctx->buffer[ctx->count++&63]=*p++;
+		if ((ctx->count&63)==0) sha1_block(ctx, ctx->buffer);
+	}
+}
+
+void ICACHE_FLASH_ATTR sha1_final(sha1_ctx *ctx, uint8_t digest[SHA1_DIGEST_LEN]) {
+	uint32_t bits=ctx->count<<3; /* messages are shorter than 512MB */
+	int i;
+
+	ctx->buffer[ctx->count++&63]=0x80;
+	if ((ctx->count&63)==0) sha1_block(ctx, ctx->buffer);
+	while ((ctx->count&63)!=56) {
+		ctx->buffer[ctx->count++&63]=0;
+		if ((ctx->count&63)==0) sha1_block(ctx, ctx->buffer);
+	}
+	for (i=0; i<8; i++) {
+		ctx->buffer[ctx->count++&63]=i<4 ? 0 : bits>>(8*(7-i));
+	}
+	sha1_block(ctx, ctx->buffer);
+	for (i=0; i<SHA1_DIGEST_LEN; i++) {
+		digest[i]=ctx->state[i>>2]>>(8*(3-(i&3)));
+	}
+}
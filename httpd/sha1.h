@@ -0,0 +1,16 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#define SHA1_DIGEST_LEN 20
+
+typedef struct {
+	uint32_t state[5];
+	uint32_t count;
+	uint8_t buffer[64];
+} sha1_ctx;
+
+void sha1_init(sha1_ctx *ctx);
+void sha1_update(sha1_ctx *ctx, const void *data, size_t len);
+void sha1_final(sha1_ctx *ctx, uint8_t digest[SHA1_DIGEST_LEN]);
+
+#endif
@@ -66,7 +66,13 @@
 #undef OPTIBOOT_DBG
 #undef SYSLOG_DBG
 #undef CGISERVICES_DBG
+#undef CGIWS_DBG
 #define ARTNET_DBG
+#undef DMX_DBG
+#undef WS2812_DBG
+#undef PCA9685_DBG
+#undef SHIFTPWM_DBG
+#undef OUTPUT_DBG
 #define ZCD_DBG
 
 // If defined, the default hostname for DHCP will include the chip ID to make it unique
@@ -15,9 +15,16 @@
  *   along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include <esp8266.h>
-#include "pwm.h"
+#include "output.h"
 #include "artnet.h"
+#include "failsafe.h"
 #include "config.h"
+#ifdef DMXOUT
+#include "dmx.h"
+#endif
+#ifdef WS2812OUT
+#include "ws2812.h"
+#endif
 
 // ----------------------------------------------------------------------------
 // op-codes
@@ -85,6 +92,20 @@ const uint8_t artnet_net = 0;
 static struct espconn artnetconn;
 static esp_udp artnetudp;
 
+/* last received slots of the configured universe */
+static uint8_t artnet_frame[MAX_CHANNELS];
+static uint16_t artnet_frameLen = 0;
+static Failsafe artnet_failsafe;
+
+#ifdef WS2812OUT
+#define ARTNET_PIXEL_UNIVERSE_LEN	(WS2812_PIXELS_PER_UNIVERSE * 3)
+/* last received slots of the pixel universes (RGB, the configured universe and the following).
+ * The strip keeps the pixels not sent in a short universe, so these are kept too.
+ */
+static uint8_t artnet_pixels[WS2812_PIXELS * 3];
+static Failsafe artnet_pixelFailsafe;
+#endif
+
 
 // ----------------------------------------------------------------------------
 // packet formats
@@ -310,48 +331,120 @@ void processIpProgPacket (struct espconn *conn, struct artnet_ipprog *ipprog, un
 	//artnet_sendIpProgReply(ip->IP_Srcaddr);
 }
 
+// ----------------------------------------------------------------------------
+// write the received (or faded) frame to the outputs
+static void ICACHE_FLASH_ATTR artnet_output(void)
+{
+	/* the outputs use consecutive slots starting at artnet_pwmstart */
+	const uint16 dmxStart = flashConfig.artnet_pwmstart - 1;
+	if (dmxStart >= artnet_frameLen) {
+		return;
+	}
+
+	/* only the channels available in the received package are used */
+	uint16 channels = artnet_frameLen - dmxStart;
+	if (channels > output_channels()) {
+		channels = output_channels();
+	}
+
+	output_beginFrame();
+	for (uint16 i=0; i<channels; i++) {
+		output_setSlot(i, artnet_frame[dmxStart + i]);
+	}
+	/* only backends with changed values are updated */
+	output_commit();
+}
+
+#ifdef WS2812OUT
+// ----------------------------------------------------------------------------
+// write the (faded) pixel universes to the strip
+static void ICACHE_FLASH_ATTR artnet_outputPixels(void)
+{
+	for (uint8 u=0; u<WS2812_UNIVERSES; u++) {
+		ws2812_setUniverse(u, &artnet_pixels[u * ARTNET_PIXEL_UNIVERSE_LEN], ARTNET_PIXEL_UNIVERSE_LEN);
+	}
+	ws2812_commit();
+}
+#endif
+
 // ----------------------------------------------------------------------------
 // Art-Net DMX packet
 static void ICACHE_FLASH_ATTR artnet_recv_opoutput(unsigned char *data, unsigned short packetlen)
 {
 	const struct artnet_dmx* const dmx = (struct artnet_dmx*)data;
     //DBG("Received artnet output packet for universe %u\r\n", dmx->universe);
-	
-	if (dmx->universe == ((flashConfig.artnet_subnet << 4) | flashConfig.artnet_universe))
+
+	if (packetlen < sizeof(struct artnet_dmx)) {
+		return;
+	}
+
+	/* universes following the configured one are only used by the pixel output */
+	const uint8 universeOffset = dmx->universe - ((flashConfig.artnet_subnet << 4) | flashConfig.artnet_universe);
+#ifdef WS2812OUT
+	if (universeOffset >= WS2812_UNIVERSES)
+#else
+	if (universeOffset != 0)
+#endif
 	{
-		uint16 dmxChannelCount = (dmx->lengthHi << 8) | dmx->length;
+		return;
+	}
 
-		/* overwrite chanel count, if bigger than package */
-		const uint16 maxChannels = packetlen - sizeof(struct artnet_dmx);
-		if(dmxChannelCount > maxChannels) {
-            DBG("Wrong Channel count in Art Net package. (length %d, max %d)\n", dmxChannelCount, maxChannels);
-			dmxChannelCount = maxChannels;
-		}
+	uint16 dmxChannelCount = (dmx->lengthHi << 8) | dmx->length;
 
-		/*
-		 * calulate the count of available channels
-		 * in the received package
-		 * which should be used for the pwm output
-		 */
-		sint16 availablePwmChannels = dmxChannelCount - flashConfig.artnet_pwmstart + 1;
-		if (availablePwmChannels > PWM_CHANNEL) {
-			availablePwmChannels = PWM_CHANNEL;
-		}
+	/* overwrite chanel count, if bigger than package */
+	const uint16 maxChannels = packetlen - sizeof(struct artnet_dmx);
+	if(dmxChannelCount > maxChannels) {
+        DBG("Wrong Channel count in Art Net package. (length %d, max %d)\n", dmxChannelCount, maxChannels);
+		dmxChannelCount = maxChannels;
+	}
+	if (dmxChannelCount > MAX_CHANNELS) {
+		dmxChannelCount = MAX_CHANNELS;
+	}
 
-		bool dataChanged = false;
-		for (uint8 i=0; i<availablePwmChannels; i++) {
-			/* pwm_start has to be called, if the values have changed */
-			const uint16 dmxIndex = flashConfig.artnet_pwmstart - 1 + i;
-			if ( pwm_set_duty(dmx->data[dmxIndex], i) ) {
-                DBG("%d: %d\n", i, dmx->data[dmxIndex]);
-				dataChanged = true;
-			}
-		}
+#ifdef WS2812OUT
+	const uint16 pixelStart = universeOffset * ARTNET_PIXEL_UNIVERSE_LEN;
+	uint16 pixelLen = dmxChannelCount;
+	if (pixelLen > ARTNET_PIXEL_UNIVERSE_LEN) {
+		pixelLen = ARTNET_PIXEL_UNIVERSE_LEN;
+	}
+	if (pixelLen > sizeof(artnet_pixels) - pixelStart) {
+		pixelLen = sizeof(artnet_pixels) - pixelStart;
+	}
+	os_memcpy(&artnet_pixels[pixelStart], dmx->data, pixelLen);
+
+	ws2812_setUniverse(universeOffset, dmx->data, dmxChannelCount);
+	/* send the strip, when its last universe was received.
+	 * The failsafe of the pixels watches the same universe
+	 */
+	if (universeOffset == WS2812_UNIVERSES - 1) {
+		ws2812_commit();
+		failsafe_feed(&artnet_pixelFailsafe, sizeof(artnet_pixels));
+	}
+#endif
 
-		/* only call pwm_start if the art net data has really changed */
-		if (dataChanged) {
-			pwm_start();
+	if (universeOffset == 0)
+	{
+		os_memcpy(artnet_frame, dmx->data, dmxChannelCount);
+		/* slots not sent any more are zero (e.g. for the DMX output) */
+		if (dmxChannelCount < artnet_frameLen) {
+			os_memset(&artnet_frame[dmxChannelCount], 0, artnet_frameLen - dmxChannelCount);
 		}
+		artnet_frameLen = dmxChannelCount;
+
+		/* a valid frame stops a running fade and restarts the data loss timeout */
+		failsafe_feed(&artnet_failsafe, artnet_frameLen);
+
+		artnet_output();
+	}
+}
+
+// ----------------------------------------------------------------------------
+// store the current output values as failsafe scene
+void ICACHE_FLASH_ATTR artnet_storeScene(uint8_t* const scene, const uint16_t len)
+{
+	for (uint16_t i=0; i<len; i++) {
+		const uint16_t dmxIndex = flashConfig.artnet_pwmstart - 1 + i;
+		scene[i] = (dmxIndex < artnet_frameLen) ? artnet_frame[dmxIndex] : 0;
 	}
 }
 
@@ -418,6 +511,16 @@ void ICACHE_FLASH_ATTR artnet_init()
 	artnetconn.proto.udp = &artnetudp;
 	artnetudp.local_port=ARTNET_PORT;
 	artnetconn.reverse = NULL;
+
+	failsafe_init(&artnet_failsafe, artnet_frame, MAX_CHANNELS, artnet_output);
+#ifdef DMXOUT
+	/* the DMX output continuously sends the same frame as used for the PWM outputs */
+	dmx_init(artnet_frame);
+#endif
+#ifdef WS2812OUT
+	ws2812_init();
+	failsafe_init(&artnet_pixelFailsafe, artnet_pixels, ARTNET_PIXEL_UNIVERSE_LEN, artnet_outputPixels);
+#endif
 	
 	espconn_regist_recvcb(&artnetconn, artnet_get);
 	espconn_create(&artnetconn);
@@ -17,8 +17,11 @@
 #ifndef ARTNET_H_
 #define ARTNET_H_
 
+#include <c_types.h>
+
 #define MAX_CHANNELS 			512
 
 void artnet_init();
+void artnet_storeScene(uint8_t* const scene, const uint16_t len);
 
 #endif
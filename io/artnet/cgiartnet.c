@@ -3,6 +3,8 @@
 #include "cgi.h"
 #include "config.h"
 #include "cgiartnet.h"
+#include "artnet.h"
+#include "failsafe.h"
 
 #ifdef ARTNET_DBG
 #define DBG(format, ...) do { os_printf(format, ## __VA_ARGS__); } while(0)
@@ -11,53 +13,25 @@
 #endif
 
 
-// Cgi to return MQTT settings
+// Cgi to return the Art-Net settings, the failsafe timeout is the one in effect
 int ICACHE_FLASH_ATTR cgiArtNetGet(HttpdConnData *connData) {
-//  char buff[1024];
-//  int len;
-
-//  if (connData->conn==NULL) return HTTPD_CGI_DONE;
-
-//  // get the current status topic for display
-//  char status_buf1[128], *sb1=status_buf1;
-//  char status_buf2[128], *sb2=status_buf2;
-
-//  // quote all " for the json, sigh...
-//  for (int i=0; i<127 && *sb1; i++) {
-//    if (*sb1 == '"') {
-//      *sb2++ = '\\';
-//      i++;
-//    }
-//    *sb2++ = *sb1++;
-//  }
-//  *sb2 = 0;
-
-//  len = os_sprintf(buff, "{ "
-//      "\"slip-enable\":%d, "
-//      "\"mqtt-enable\":%d, "
-//      "\"mqtt-state\":\"%s\", "
-//      "\"mqtt-status-enable\":%d, "
-//      "\"mqtt-clean-session\":%d, "
-//      "\"mqtt-port\":%d, "
-//      "\"mqtt-timeout\":%d, "
-//      "\"mqtt-keepalive\":%d, "
-//      "\"mqtt-host\":\"%s\", "
-//      "\"mqtt-client-id\":\"%s\", "
-//      "\"mqtt-username\":\"%s\", "
-//      "\"mqtt-password\":\"%s\", "
-//      "\"mqtt-status-topic\":\"%s\", "
-//      "\"mqtt-status-value\":\"%s\" }",
-//      flashConfig.slip_enable, flashConfig.mqtt_enable,
-//      mqtt_states[mqttClient.connState], flashConfig.mqtt_status_enable,
-//      flashConfig.mqtt_clean_session, flashConfig.mqtt_port,
-//      flashConfig.mqtt_timeout, flashConfig.mqtt_keepalive,
-//      flashConfig.mqtt_host, flashConfig.mqtt_clientid,
-//      flashConfig.mqtt_username, flashConfig.mqtt_password,
-//      flashConfig.mqtt_status_topic, status_buf2);
-
-//  jsonHeader(connData, 200);
-//  httpdSend(connData, buff, len);
-  return HTTPD_CGI_DONE;
+  JsonWriter w;
+
+  if (connData->conn == NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
+  if (connData->cgiData == NULL) jsonHeader(connData, 200);
+
+  jsonStart(&w, connData, (int)connData->cgiData);
+  jsonObjectOpen(&w, NULL);
+  jsonInt(&w, "artnet-subnet", flashConfig.artnet_subnet);
+  jsonInt(&w, "artnet-universe", flashConfig.artnet_universe);
+  jsonInt(&w, "artnet-pwmstart", flashConfig.artnet_pwmstart);
+  jsonInt(&w, "artnet-failsafe", flashConfig.artnet_failsafe);
+  jsonInt(&w, "artnet-failsafe-timeout", flashConfig.artnet_failsafe_timeout ?
+      flashConfig.artnet_failsafe_timeout : FAILSAFE_TIMEOUT_DEFAULT);
+  jsonInt(&w, "artnet-failsafe-fade", flashConfig.artnet_failsafe_fade);
+  jsonObjectClose(&w);
+  connData->cgiData = (void *)jsonEnd(&w);
+  return connData->cgiData ? HTTPD_CGI_MORE : HTTPD_CGI_DONE;
 }
 
 // Cgi to change choice of pin assignments
@@ -65,25 +39,58 @@ int ICACHE_FLASH_ATTR cgiArtNetSet(HttpdConnData *connData) {
   if (connData->conn==NULL) return HTTPD_CGI_DONE;
 
   // handle Art-Net settings
-  char buffer[4];
-  if (httpdFindArg(connData->post->buff, "artnet-subnet", buffer, sizeof(buffer)) < 0) {
+  char *arg = httpdGetArg(connData, "artnet-subnet", NULL);
+  if (arg == NULL) {
 	return HTTPD_CGI_DONE;
   }
-  flashConfig.artnet_subnet = atoi(buffer);
+  flashConfig.artnet_subnet = atoi(arg);
   // TODO
 //  errorResponse(connData, 400, "Invalid MQTT port");
 //  return HTTPD_CGI_DONE;
 
-  if (httpdFindArg(connData->post->buff, "artnet-universe", buffer, sizeof(buffer)) < 0) {
+  arg = httpdGetArg(connData, "artnet-universe", NULL);
+  if (arg == NULL) {
 	  return HTTPD_CGI_DONE;
   }
-  flashConfig.artnet_universe = atoi(buffer);
+  flashConfig.artnet_universe = atoi(arg);
 
 
-  if (httpdFindArg(connData->post->buff, "artnet-pwmstart", buffer, sizeof(buffer)) < 0) {
+  arg = httpdGetArg(connData, "artnet-pwmstart", NULL);
+  if (arg == NULL) {
 	  return HTTPD_CGI_DONE;
   }
-  flashConfig.artnet_pwmstart = atoi(buffer);
+  flashConfig.artnet_pwmstart = atoi(arg);
+
+  // the failsafe settings are optional
+  char *value;
+  if ((value = httpdGetArg(connData, "artnet-failsafe", NULL)) != NULL && *value != 0) {
+    const int mode = atoi(value);
+    if (mode < 0 || mode > FAILSAFE_SCENE) {
+      errorResponse(connData, 400, "Invalid failsafe mode");
+      return HTTPD_CGI_DONE;
+    }
+    flashConfig.artnet_failsafe = mode;
+  }
+  if ((value = httpdGetArg(connData, "artnet-failsafe-timeout", NULL)) != NULL && *value != 0) {
+    const int timeout = atoi(value);
+    if (timeout < 0 || timeout > 0xffff) {
+      errorResponse(connData, 400, "Invalid failsafe timeout");
+      return HTTPD_CGI_DONE;
+    }
+    flashConfig.artnet_failsafe_timeout = timeout;
+  }
+  if ((value = httpdGetArg(connData, "artnet-failsafe-fade", NULL)) != NULL && *value != 0) {
+    const int fade = atoi(value);
+    if (fade < 0 || fade > 0xff) {
+      errorResponse(connData, 400, "Invalid failsafe fade time");
+      return HTTPD_CGI_DONE;
+    }
+    flashConfig.artnet_failsafe_fade = fade;
+  }
+  // checkboxes are only sent if checked
+  if ((value = httpdGetArg(connData, "artnet-scene-store", NULL)) != NULL && *value != 0) {
+    artnet_storeScene(flashConfig.artnet_scene, sizeof(flashConfig.artnet_scene));
+  }
 
 
   DBG("Saving config (sub %u univ %u pwm %u)\n", flashConfig.artnet_subnet, flashConfig.artnet_universe, flashConfig.artnet_pwmstart);
@@ -0,0 +1,126 @@
+#include <esp8266.h>
+#include "config.h"
+#include "failsafe.h"
+
+#ifdef ARTNET_DBG
+#define DBG(format, ...) do { os_printf(format "\n", ## __VA_ARGS__); } while(0)
+#else
+#define DBG(format, ...) do { } while(0)
+#endif
+
+
+static uint8_t ICACHE_FLASH_ATTR failsafe_target(const Failsafe* const fs, const uint16_t slot)
+{
+	if (flashConfig.artnet_failsafe != FAILSAFE_SCENE || slot >= fs->sceneEnd) {
+		return 0;
+	}
+
+	/* the scene covers the slots used by this node only */
+	const sint32 sceneSlot = (sint32)slot - (flashConfig.artnet_pwmstart - 1);
+	if (sceneSlot < 0 || sceneSlot >= FAILSAFE_SCENE_SLOTS) {
+		return 0;
+	}
+
+	return flashConfig.artnet_scene[sceneSlot];
+}
+
+
+static void ICACHE_FLASH_ATTR failsafe_fade(void* arg)
+{
+	Failsafe* const fs = arg;
+	if (fs->fadeSteps == 0) {
+		os_timer_disarm(&fs->timer);
+		return;
+	}
+
+	/* linear fade without remembering the start values.
+	 * Each step covers the remaining difference divided by the left steps.
+	 * Rounding away from zero guarantees reaching the target
+	 * in the last step at the latest.
+	 */
+	for (uint16_t i=0; i<fs->frameLen; i++) {
+		const sint16 diff = failsafe_target(fs, i) - fs->frame[i];
+		sint16 step = diff / fs->fadeSteps;
+		if (diff % fs->fadeSteps > 0) {
+			step++;
+		} else if (diff % fs->fadeSteps < 0) {
+			step--;
+		}
+		fs->frame[i] += step;
+	}
+
+	fs->fadeSteps--;
+	if (fs->fadeSteps == 0) {
+		os_timer_disarm(&fs->timer);
+		DBG("Failsafe fade finished");
+	}
+
+	fs->output();
+}
+
+
+static void ICACHE_FLASH_ATTR failsafe_timeout(void* arg)
+{
+	Failsafe* const fs = arg;
+
+	DBG("No Art-Net data since %ums. Failsafe %u", flashConfig.artnet_failsafe_timeout, flashConfig.artnet_failsafe);
+
+	fs->fadeSteps = (flashConfig.artnet_failsafe_fade * 1000) / FAILSAFE_FADE_INTERVAL;
+	if (fs->fadeSteps == 0) {
+		/* no fade time configured. Jump to the target in one step */
+		fs->fadeSteps = 1;
+		failsafe_fade(fs);
+		return;
+	}
+
+	os_timer_setfn(&fs->timer, failsafe_fade, fs);
+	os_timer_arm(&fs->timer, FAILSAFE_FADE_INTERVAL, 1);
+}
+
+
+/******************************************************************************
+* FunctionName : failsafe_feed
+* Description  : has to be called for each received frame of the universe.
+*				 Stops a running fade and restarts the inter-frame timeout.
+* Parameters   : frameLen : count of valid slots in the frame
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR failsafe_feed(Failsafe* const fs, const uint16_t frameLen)
+{
+	os_timer_disarm(&fs->timer);
+	fs->fadeSteps = 0;
+	fs->frameLen = frameLen;
+
+	/* the last values are held without any timer */
+	if (flashConfig.artnet_failsafe == FAILSAFE_HOLD) {
+		return;
+	}
+
+	uint16_t timeout = flashConfig.artnet_failsafe_timeout;
+	if (timeout == 0) {
+		timeout = FAILSAFE_TIMEOUT_DEFAULT;
+	}
+
+	os_timer_setfn(&fs->timer, failsafe_timeout, fs);
+	os_timer_arm(&fs->timer, timeout, 0);
+}
+
+
+/******************************************************************************
+* FunctionName : failsafe_init
+* Description  : sets up the failsafe of a frame, which may hold several universes.
+*				 The scene only covers the configured universe at the start of the frame.
+* Parameters   : frame : slots faded in place
+*				 sceneEnd : slots of the configured universe in frame
+*				 output : called after each fade step
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR failsafe_init(Failsafe* const fs, uint8_t* const frame, const uint16_t sceneEnd, const FailsafeOutputCb output)
+{
+	os_timer_disarm(&fs->timer);
+	fs->frame = frame;
+	fs->frameLen = 0;
+	fs->sceneEnd = sceneEnd;
+	fs->fadeSteps = 0;
+	fs->output = output;
+}
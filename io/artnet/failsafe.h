@@ -0,0 +1,39 @@
+#ifndef FAILSAFE_H
+#define FAILSAFE_H
+
+#include <esp8266.h>
+
+/* data loss policies of an Art-Net universe.
+ * The values are stored in the flash config (artnet_failsafe),
+ * so do not reorder them.
+ */
+typedef enum {
+	FAILSAFE_HOLD = 0,	/* keep the last received values forever */
+	FAILSAFE_BLACK,		/* fade all slots to zero */
+	FAILSAFE_SCENE,		/* fade to the scene stored in the flash config */
+} FailsafeMode;
+
+/* inter-frame timeout (in ms), if artnet_failsafe_timeout is not set */
+#define FAILSAFE_TIMEOUT_DEFAULT	2500
+/* interval between two fade steps (in ms) */
+#define FAILSAFE_FADE_INTERVAL		25
+/* count of slots stored for FAILSAFE_SCENE (starting at artnet_pwmstart) */
+#define FAILSAFE_SCENE_SLOTS		32
+
+/* called after the failsafe has changed the frame */
+typedef void (*FailsafeOutputCb)(void);
+
+/* failsafe state of one universe */
+typedef struct {
+	ETSTimer timer;
+	uint8_t *frame;			/* slots of the universes, faded in place */
+	uint16_t frameLen;		/* count of valid slots in frame */
+	uint16_t sceneEnd;		/* slots from here on are not part of the configured universe */
+	uint16_t fadeSteps;		/* left fade steps, 0 if not fading */
+	FailsafeOutputCb output;
+} Failsafe;
+
+void failsafe_init(Failsafe* const fs, uint8_t* const frame, const uint16_t sceneEnd, const FailsafeOutputCb output);
+void failsafe_feed(Failsafe* const fs, const uint16_t frameLen);
+
+#endif // FAILSAFE_H
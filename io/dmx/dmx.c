@@ -0,0 +1,101 @@
+#include <esp8266.h>
+#include "uart.h"
+#include "dmx.h"
+
+#ifdef DMX_DBG
+#define DBG(format, ...) do { os_printf(format "\n", ## __VA_ARGS__); } while(0)
+#else
+#define DBG(format, ...) do { } while(0)
+#endif
+
+#define UART_TX_FIFO_SIZE		128
+/* refill the fifo, if less than this bytes are left (~2.8ms at 250kbaud) */
+#define DMX_TX_EMPTY_THRESHOLD	64
+
+/* 8 data bits, no parity, 2 stop bits.
+ * CALC_UARTMODE can not be used, because TWO_STOP_BIT of uart_hw.h
+ * does not match the register value.
+ */
+#define DMX_UART_CONF0			((EIGHT_BITS << UART_BIT_NUM_S) | (0x3 << UART_STOP_BIT_NUM_S))
+
+static const uint8_t* dmx_slots = NULL;
+/* next slot to be written into the fifo. 0 is the start code */
+static volatile uint16_t dmx_pos = DMX_SLOTS + 1;
+
+static ETSTimer dmx_timer;
+
+
+static inline uint8_t dmx_tx_fifo_count(void)
+{
+	return (READ_PERI_REG(UART_STATUS(UART1)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT;
+}
+
+
+/* called from the uart interrupt, so it must not use ICACHE_FLASH_ATTR */
+static void dmx_fill_fifo(void)
+{
+	uint8_t count = dmx_tx_fifo_count();
+	while (count < UART_TX_FIFO_SIZE && dmx_pos <= DMX_SLOTS) {
+		const uint8_t value = (dmx_pos == 0) ? DMX_START_CODE : dmx_slots[dmx_pos - 1];
+		WRITE_PERI_REG(UART_FIFO(UART1), value);
+		dmx_pos++;
+		count++;
+	}
+
+	/* all slots are in the fifo. Wait for the next packet start */
+	if (dmx_pos > DMX_SLOTS) {
+		CLEAR_PERI_REG_MASK(UART_INT_ENA(UART1), UART_TXFIFO_EMPTY_INT_ENA);
+	}
+}
+
+
+static void ICACHE_FLASH_ATTR dmx_packet_start(void* arg)
+{
+	/* the last packet is still sending (e.g. delayed by the uart0 receive task).
+	 * Retry shortly instead of waiting a whole refresh interval
+	 */
+	if (dmx_pos <= DMX_SLOTS || dmx_tx_fifo_count() > 0) {
+		os_timer_arm(&dmx_timer, 1, 0);
+		return;
+	}
+	os_timer_arm(&dmx_timer, DMX_REFRESH_MS, 0);
+
+	/* the fifo is empty, but the last slot may still be in the shift register */
+	os_delay_us(DMX_SLOT_US);
+
+	/* break and mark after break */
+	SET_PERI_REG_MASK(UART_CONF0(UART1), UART_TXD_BRK);
+	os_delay_us(DMX_BREAK_US);
+	CLEAR_PERI_REG_MASK(UART_CONF0(UART1), UART_TXD_BRK);
+	os_delay_us(DMX_MAB_US);
+
+	/* the remaining slots will be written by the fifo empty interrupt */
+	ETS_UART_INTR_DISABLE();
+	dmx_pos = 0;
+	dmx_fill_fifo();
+	WRITE_PERI_REG(UART_INT_CLR(UART1), UART_TXFIFO_EMPTY_INT_CLR);
+	SET_PERI_REG_MASK(UART_INT_ENA(UART1), UART_TXFIFO_EMPTY_INT_ENA);
+	ETS_UART_INTR_ENABLE();
+}
+
+
+/******************************************************************************
+* FunctionName : dmx_init
+* Description  : start the continuous DMX512 output on UART1
+* Parameters   : slots : DMX_SLOTS values, which will be sent in each packet.
+*				 The buffer is read while sending,
+*				 so changes are sent with the next packet.
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR dmx_init(const uint8_t* const slots)
+{
+	DBG("DMX output init (%u slots every %ums)", DMX_SLOTS, DMX_REFRESH_MS);
+
+	dmx_slots = slots;
+	dmx_pos = DMX_SLOTS + 1;
+	uart1_claim(DMX_BAUD_RATE, DMX_UART_CONF0, DMX_TX_EMPTY_THRESHOLD, dmx_fill_fifo);
+
+	os_timer_disarm(&dmx_timer);
+	os_timer_setfn(&dmx_timer, dmx_packet_start, NULL);
+	os_timer_arm(&dmx_timer, DMX_REFRESH_MS, 0);
+}
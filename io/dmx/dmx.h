@@ -0,0 +1,31 @@
+#ifndef DMX_H
+#define DMX_H
+
+#include <c_types.h>
+
+/* DMX512 output on UART1 (TXD on GPIO2).
+ * Note: On ESP02 GPIO2 is also used by PWM channel 1.
+ * Build with -DPWM_CHANNEL=1 or for ESP03, if both are used.
+ */
+
+#define DMX_BAUD_RATE		250000
+#define DMX_SLOTS			512
+#define DMX_START_CODE		0x00
+
+/* timing of the packet start (in µs).
+ * The standard requires at least 88µs break and 8µs mark after break (MAB).
+ * Use some more to also support slow receivers.
+ */
+#define DMX_BREAK_US		120
+#define DMX_MAB_US			16
+/* one slot (start bit, 8 data bits, 2 stop bits) takes 44µs */
+#define DMX_SLOT_US			44
+
+/* interval between two packet starts (in ms).
+ * A full packet with 512 slots takes 22.7ms, so this is the maximum refresh of ~44Hz
+ */
+#define DMX_REFRESH_MS		23
+
+void dmx_init(const uint8_t* const slots);
+
+#endif // DMX_H
@@ -0,0 +1,108 @@
+/*
+Host test of the DMX512 output (io/dmx/dmx.c). The UART1 registers are emulated by the fake UART
+of test/host/hosttest.c, which records the line: break, mark after break and every byte with its
+start time.
+
+The recorded line is checked byte for byte against the slots and for the DMX512 timing: break
+of at least 88µs, mark after break of at least 8µs, no break while a byte is still being sent,
+and the packet refresh interval. A stalled UART delays the next packet instead of breaking into
+the last one.
+
+Usage: make -C io/dmx/dmxtest
+*/
+
+#include "hosttest.h"
+#include "dmx.h"
+
+//Check the packets recorded from event first on against the slots, returns the event after
+//the last complete packet and the start time of the last packet
+static int checkPackets(int first, const uint8 *slots, int *packets, uint64_t *lastStart) {
+	int i = first;
+	uint64_t lineFree = 0, prevStart = 0;
+	const WireEvent *wire = fakeWire;
+	*packets = 0;
+	while (i < fakeWireLen) {
+		//a packet starts with break and mark after break
+		CHECK(wire[i].type == EV_BREAK, "event %d: packet doesn't start with a break", i);
+		CHECK(wire[i].t >= lineFree, "break at %lluus while a byte is sent until %lluus",
+			(unsigned long long)(wire[i].t / TICKS_US), (unsigned long long)(lineFree / TICKS_US));
+		CHECK(i + 1 < fakeWireLen && wire[i + 1].type == EV_MARK, "break without mark");
+		uint64_t breakUs = (wire[i + 1].t - wire[i].t) / TICKS_US;
+		CHECK(breakUs >= 88, "break of %lluus is shorter than 88us", (unsigned long long)breakUs);
+		if (*packets > 0) {
+			uint64_t interval = (wire[i].t - prevStart) / TICKS_US;
+			CHECK(interval >= DMX_REFRESH_MS * 1000, "packet interval of %lluus",
+				(unsigned long long)interval);
+		}
+		prevStart = wire[i].t;
+
+		int n = 0, j = i + 2;
+		for (; j < fakeWireLen && wire[j].type == EV_BYTE; j++, n++) {
+			if (n == 0) {
+				uint64_t mabUs = (wire[j].t - wire[i + 1].t) / TICKS_US;
+				CHECK(mabUs >= 8, "mark after break of %lluus is shorter than 8us",
+					(unsigned long long)mabUs);
+				CHECK(wire[j].value == DMX_START_CODE, "start code 0x%02x", wire[j].value);
+			} else {
+				CHECK(n <= DMX_SLOTS, "more than %d slots", DMX_SLOTS);
+				CHECK(wire[j].value == slots[n - 1], "slot %d is 0x%02x instead of 0x%02x",
+					n, wire[j].value, slots[n - 1]);
+			}
+			lineFree = wire[j].t + fakeCharTicks();
+		}
+		if (j == fakeWireLen && n < DMX_SLOTS + 1) break; //still sending
+		CHECK(n == DMX_SLOTS + 1, "packet with %d bytes", n);
+		(*packets)++;
+		i = j;
+	}
+	*lastStart = prevStart;
+	return i;
+}
+
+int main(void) {
+	static uint8 slots[DMX_SLOTS];
+	for (int i = 0; i < DMX_SLOTS; i++) slots[i] = i * 7 + 3;
+
+	dmx_init(slots);
+	CHECK(fakeBaud == DMX_BAUD_RATE, "baud rate %u", fakeBaud);
+	CHECK(fakeDataBits() == 8, "not 8 data bits");
+	CHECK(((fakeConf0 >> UART_STOP_BIT_NUM_S) & 3) == 3, "not 2 stop bits");
+	CHECK((fakeConf0 & UART_PARITY_EN) == 0, "parity enabled");
+	CHECK(fakeCharTicks() == DMX_SLOT_US * TICKS_US, "a slot takes %uus",
+		fakeCharTicks() / TICKS_US);
+
+	//a few packets of the same slots, the first one starts after DMX_REFRESH_MS
+	fakeRunUntil((5 * DMX_REFRESH_MS * 1000 - 100) * TICKS_US);
+	int packets;
+	uint64_t lastStart;
+	int end = checkPackets(0, slots, &packets, &lastStart);
+	CHECK(packets == 4, "%d packets instead of 4", packets);
+	CHECK(end == fakeWireLen, "incomplete packet");
+	int total = packets;
+
+	//changed slots go out with the next packet
+	slots[0] = 0xaa;
+	slots[DMX_SLOTS - 1] = 0x55;
+	int first = fakeWireLen;
+	fakeRunUntil(fakeNow + 3 * DMX_REFRESH_MS * 1000 * TICKS_US);
+	end = checkPackets(first, slots, &packets, &lastStart);
+	CHECK(packets == 3, "%d packets after the change", packets);
+	total += packets;
+
+	//a stalled UART delays the next packet until the last one is out
+	fakeRunUntil(lastStart + 2000 * TICKS_US);
+	fakeStalled = 1;
+	fakeRunUntil(fakeNow + 3 * DMX_REFRESH_MS * 1000 * TICKS_US);
+	fakeStalled = 0;
+	//the retry timer fires just when the last byte has left the fifo, but not the shift register
+	while (fakeFifoCount > 0) fakeRunUntil(fakeNow + TICKS_US);
+	CHECK(fakeTimerCount == 1 && fakeTimers[0]->expire != 0, "no retry of the packet start");
+	fakeTimers[0]->expire = fakeNow;
+	fakeRunUntil(fakeNow + 3 * DMX_REFRESH_MS * 1000 * TICKS_US);
+	end = checkPackets(end, slots, &packets, &lastStart);
+	CHECK(packets >= 2, "%d packets after the stall", packets);
+	total += packets;
+
+	printf("dmxtest: %d packets of %d slots ok\n", total, DMX_SLOTS);
+	return 0;
+}
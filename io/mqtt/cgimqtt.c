@@ -121,11 +121,11 @@ int ICACHE_FLASH_ATTR cgiMqttSet(HttpdConnData *connData) {
   int8_t mqtt_en_chg = getBoolArg(connData, "mqtt-enable",
       (bool*)&flashConfig.mqtt_enable);
 
-  char buff[16];
+  char *arg;
 
   // handle mqtt port
-  if (httpdFindArg(connData->getArgs, "mqtt-port", buff, sizeof(buff)) > 0) {
-    int32_t port = atoi(buff);
+  if ((arg = httpdGetArg(connData, "mqtt-port", NULL)) != NULL && *arg != 0) {
+    int32_t port = atoi(arg);
     if (port > 0 && port < 65536) {
       flashConfig.mqtt_port = port;
       mqtt_server |= 1;
@@ -136,14 +136,14 @@ int ICACHE_FLASH_ATTR cgiMqttSet(HttpdConnData *connData) {
   }
 
   // handle mqtt timeout
-  if (httpdFindArg(connData->getArgs, "mqtt-timeout", buff, sizeof(buff)) > 0) {
-    int32_t timeout = atoi(buff);
+  if ((arg = httpdGetArg(connData, "mqtt-timeout", NULL)) != NULL && *arg != 0) {
+    int32_t timeout = atoi(arg);
     flashConfig.mqtt_timeout = timeout;
   }
 
   // handle mqtt keepalive
-  if (httpdFindArg(connData->getArgs, "mqtt-keepalive", buff, sizeof(buff)) > 0) {
-    int32_t keepalive = atoi(buff);
+  if ((arg = httpdGetArg(connData, "mqtt-keepalive", NULL)) != NULL && *arg != 0) {
+    int32_t keepalive = atoi(arg);
     flashConfig.mqtt_keepalive = keepalive;
   }
 
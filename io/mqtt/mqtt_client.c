@@ -3,7 +3,7 @@
 #include "cgiwifi.h"
 #include "config.h"
 #include "mqtt.h"
-#include "pwm.h"
+#include "output.h"
 
 #ifdef HEATER
 #include "heater.h"
@@ -97,10 +97,12 @@ mqttPwmData(const char* const topic, const uint32_t topic_len, const char* const
 
     /* from percent to uint8_t (0..255) */
     const uint16_t duty = data_value * 255 / 100;
-    if ( pwm_set_duty(duty, channel) ) {
-        /* only update, if value has realy changed */
-        pwm_start();
-    }
+    /* the PWM channels are the first slots of the output frame.
+     * Only backends with changed values are updated.
+     */
+    output_beginFrame();
+    output_setSlot(channel, duty);
+    output_commit();
 
     DBG("PWM output %u changed to %u", channel, duty);
 
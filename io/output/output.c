@@ -0,0 +1,190 @@
+#include <esp8266.h>
+#include "output.h"
+#ifdef PWMOUT
+#include "pwm.h"
+#endif
+#ifdef PCA9685OUT
+#include "pca9685.h"
+#endif
+#ifdef SHIFTPWMOUT
+#include "shiftpwm.h"
+#endif
+
+#ifdef OUTPUT_DBG
+#define DBG(format, ...) do { os_printf(format "\n", ## __VA_ARGS__); } while(0)
+#else
+#define DBG(format, ...) do { } while(0)
+#endif
+
+#define OUTPUT_PWM_FREQ		100
+
+
+#ifdef PWMOUT
+static void ICACHE_FLASH_ATTR output_pwmInit(void)
+{
+	uint8_t duty[PWM_CHANNEL];
+	os_memset(duty, 0, sizeof(duty));
+	pwm_init(OUTPUT_PWM_FREQ, duty);
+}
+
+
+static bool ICACHE_FLASH_ATTR output_pwmSetSlot(const uint16_t channel, const uint8_t value)
+{
+	return pwm_set_duty(value, channel);
+}
+#endif
+
+
+#ifdef PCA9685OUT
+static bool ICACHE_FLASH_ATTR output_pca9685SetSlot(const uint16_t channel, const uint8_t value)
+{
+	/* scale 8 bit to 12 bit (0xFF -> 0xFFF) */
+	return pca9685_set(channel, (value << 4) | (value >> 4));
+}
+#endif
+
+
+/* the order of the table defines the order of the slots */
+static const OutputBackend output_backends[] = {
+#ifdef PWMOUT
+	{"pwm", PWM_CHANNEL, 8, OUTPUT_PWM_FREQ, output_pwmInit, NULL, output_pwmSetSlot, pwm_start},
+#endif
+#ifdef PCA9685OUT
+	{"pca9685", PCA9685_CHANNELS, 12, PCA9685_FREQ, pca9685_init, NULL, output_pca9685SetSlot, pca9685_commit},
+#endif
+#ifdef SHIFTPWMOUT
+	{"shiftpwm", SHIFTPWM_CHANNELS, 8, SHIFTPWM_FREQ, shiftpwm_init, NULL, shiftpwm_set, shiftpwm_commit},
+#endif
+};
+
+#define OUTPUT_BACKENDS		(sizeof(output_backends) / sizeof(output_backends[0]))
+
+#ifdef PWMOUT
+#define OUTPUT_PWM_CHANNELS			+ PWM_CHANNEL
+#else
+#define OUTPUT_PWM_CHANNELS
+#endif
+#ifdef PCA9685OUT
+#define OUTPUT_PCA9685_CHANNELS		+ PCA9685_CHANNELS
+#else
+#define OUTPUT_PCA9685_CHANNELS
+#endif
+#ifdef SHIFTPWMOUT
+#define OUTPUT_SHIFTPWM_CHANNELS	+ SHIFTPWM_CHANNELS
+#else
+#define OUTPUT_SHIFTPWM_CHANNELS
+#endif
+#define OUTPUT_CHANNELS		(0 OUTPUT_PWM_CHANNELS OUTPUT_PCA9685_CHANNELS OUTPUT_SHIFTPWM_CHANNELS)
+
+/* the last written values of all backends.
+ * One additional byte avoids a zero sized array without any backend.
+ */
+static uint8_t output_frame[OUTPUT_CHANNELS + 1];
+/* backends with changed slots since the last commit (bit n is backend n) */
+static uint32_t output_dirty = 0;
+
+
+/******************************************************************************
+* FunctionName : output_setSlot
+* Description  : set one slot of the frame.
+*				 Unchanged values do not reach the backend.
+* Parameters   : slot : 0 ~ output_channels()-1
+*				 value : 0 ~ 255
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR output_setSlot(const uint16_t slot, const uint8_t value)
+{
+	if (slot >= OUTPUT_CHANNELS || output_frame[slot] == value) {
+		return;
+	}
+	output_frame[slot] = value;
+
+	uint16_t channel = slot;
+	for (uint8_t i=0; i<OUTPUT_BACKENDS; i++) {
+		const OutputBackend* const backend = &output_backends[i];
+		if (channel < backend->channels) {
+			if (backend->setSlot(channel, value)) {
+				output_dirty |= (1UL << i);
+			}
+			return;
+		}
+		channel -= backend->channels;
+	}
+}
+
+
+uint8_t ICACHE_FLASH_ATTR output_getSlot(const uint16_t slot)
+{
+	if (slot >= OUTPUT_CHANNELS) {
+		return 0;
+	}
+	return output_frame[slot];
+}
+
+
+/******************************************************************************
+* FunctionName : output_beginFrame
+* Description  : has to be called before the slots of a new frame are set
+* Parameters   : NONE
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR output_beginFrame(void)
+{
+	for (uint8_t i=0; i<OUTPUT_BACKENDS; i++) {
+		if (output_backends[i].beginFrame != NULL) {
+			output_backends[i].beginFrame();
+		}
+	}
+}
+
+
+/******************************************************************************
+* FunctionName : output_commit
+* Description  : send the frame to all backends with changed slots
+* Parameters   : NONE
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR output_commit(void)
+{
+	for (uint8_t i=0; i<OUTPUT_BACKENDS && output_dirty != 0; i++) {
+		if (output_dirty & (1UL << i)) {
+			output_backends[i].commit();
+			output_dirty &= ~(1UL << i);
+		}
+	}
+}
+
+
+uint16_t ICACHE_FLASH_ATTR output_channels(void)
+{
+	return OUTPUT_CHANNELS;
+}
+
+
+uint8_t ICACHE_FLASH_ATTR output_backendCount(void)
+{
+	return OUTPUT_BACKENDS;
+}
+
+
+const OutputBackend* ICACHE_FLASH_ATTR output_backend(const uint8_t index)
+{
+	if (index >= OUTPUT_BACKENDS) {
+		return NULL;
+	}
+	return &output_backends[index];
+}
+
+
+void ICACHE_FLASH_ATTR output_init(void)
+{
+	os_memset(output_frame, 0, sizeof(output_frame));
+	output_dirty = 0;
+
+	for (uint8_t i=0; i<OUTPUT_BACKENDS; i++) {
+		const OutputBackend* const backend = &output_backends[i];
+		DBG("Output %s: %u channels, %u bit, %uHz", backend->name,
+				backend->channels, backend->bits, backend->refreshRate);
+		backend->init();
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <c_types.h>
+
+/* common frame for all channel based outputs (soft PWM, PCA9685, shift registers).
+ * The slots of the frame are assigned to the enabled backends one after another.
+ * Producers (Art-Net, MQTT) write slots between output_beginFrame and output_commit.
+ */
+
+typedef bool (*OutputSetSlot)(const uint16_t channel, const uint8_t value);
+
+/* operations and capabilities of an output device */
+typedef struct {
+	const char* name;
+	uint16_t channels;			/* count of used frame slots */
+	uint8_t bits;				/* resolution of the hardware */
+	uint16_t refreshRate;		/* in Hz */
+	void (*init)(void);
+	void (*beginFrame)(void);	/* optional */
+	OutputSetSlot setSlot;		/* has to return true if the value has changed */
+	void (*commit)(void);		/* only called if a slot has changed */
+} OutputBackend;
+
+void output_init(void);
+uint16_t output_channels(void);
+uint8_t output_backendCount(void);
+const OutputBackend* output_backend(const uint8_t index);
+
+void output_beginFrame(void);
+void output_setSlot(const uint16_t slot, const uint8_t value);
+uint8_t output_getSlot(const uint16_t slot);
+void output_commit(void);
+
+#endif // OUTPUT_H
@@ -0,0 +1,102 @@
+#include <esp8266.h>
+#include "gpio.h"
+#include "i2c.h"
+
+#define I2C_SDA		(1 << I2C_SDA_IO_NUM)
+#define I2C_SCL		(1 << I2C_SCL_IO_NUM)
+
+
+/* open drain: 1 releases the line, 0 pulls it low */
+static inline void i2c_sda(const bool level)
+{
+	GPIO_REG_WRITE(level ? GPIO_OUT_W1TS_ADDRESS : GPIO_OUT_W1TC_ADDRESS, I2C_SDA);
+}
+
+
+static inline void i2c_scl(const bool level)
+{
+	GPIO_REG_WRITE(level ? GPIO_OUT_W1TS_ADDRESS : GPIO_OUT_W1TC_ADDRESS, I2C_SCL);
+	os_delay_us(I2C_DELAY_US);
+}
+
+
+static void ICACHE_FLASH_ATTR i2c_openDrain(const uint8_t pin)
+{
+	const uint32 reg = GPIO_PIN_ADDR(GPIO_ID_PIN(pin));
+	GPIO_REG_WRITE(reg, GPIO_REG_READ(reg) | GPIO_PIN_PAD_DRIVER_SET(GPIO_PAD_DRIVER_ENABLE));
+}
+
+
+/******************************************************************************
+* FunctionName : i2c_start
+* Description  : generate a (repeated) start condition
+* Parameters   : NONE
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR i2c_start(void)
+{
+	i2c_sda(1);
+	i2c_scl(1);
+	i2c_sda(0);
+	os_delay_us(I2C_DELAY_US);
+	i2c_scl(0);
+}
+
+
+/******************************************************************************
+* FunctionName : i2c_stop
+* Description  : generate a stop condition. Releases the bus.
+* Parameters   : NONE
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR i2c_stop(void)
+{
+	i2c_sda(0);
+	i2c_scl(1);
+	i2c_sda(1);
+	os_delay_us(I2C_DELAY_US);
+}
+
+
+/******************************************************************************
+* FunctionName : i2c_writeByte
+* Description  : send one byte (MSB first) and read the acknowledge bit
+* Parameters   : data : byte to be sent
+* Returns      : true if the slave has acknowledged the byte
+*******************************************************************************/
+bool ICACHE_FLASH_ATTR i2c_writeByte(const uint8_t data)
+{
+	for (uint8_t mask=0x80; mask!=0; mask>>=1) {
+		i2c_sda(data & mask);
+		i2c_scl(1);
+		i2c_scl(0);
+	}
+
+	/* release SDA for the acknowledge of the slave */
+	i2c_sda(1);
+	i2c_scl(1);
+	const bool ack = (GPIO_INPUT_GET(I2C_SDA_IO_NUM) == 0);
+	i2c_scl(0);
+
+	return ack;
+}
+
+
+void ICACHE_FLASH_ATTR i2c_init(void)
+{
+	PIN_FUNC_SELECT(I2C_SDA_IO_MUX, I2C_SDA_IO_FUNC);
+	PIN_FUNC_SELECT(I2C_SCL_IO_MUX, I2C_SCL_IO_FUNC);
+
+	i2c_openDrain(I2C_SDA_IO_NUM);
+	i2c_openDrain(I2C_SCL_IO_NUM);
+
+	/* released lines are high */
+	gpio_output_set(I2C_SDA | I2C_SCL, 0, I2C_SDA | I2C_SCL, 0);
+
+	/* finish a transfer, which was interrupted by a reset */
+	for (uint8_t i=0; i<9; i++) {
+		i2c_scl(1);
+		i2c_scl(0);
+	}
+	i2c_stop();
+}
@@ -0,0 +1,30 @@
+#ifndef I2C_H
+#define I2C_H
+
+#include <c_types.h>
+
+/* bit-banged I2C master with open drain outputs.
+ * Default pin out is the ESP02 one (SDA on GPIO0, SCL on GPIO2).
+ * Both lines need pull up resistors.
+ */
+#ifndef I2C_SDA_IO_NUM
+#define I2C_SDA_IO_MUX		PERIPHS_IO_MUX_GPIO0_U
+#define I2C_SDA_IO_NUM		0
+#define I2C_SDA_IO_FUNC		FUNC_GPIO0
+#endif
+
+#ifndef I2C_SCL_IO_NUM
+#define I2C_SCL_IO_MUX		PERIPHS_IO_MUX_GPIO2_U
+#define I2C_SCL_IO_NUM		2
+#define I2C_SCL_IO_FUNC		FUNC_GPIO2
+#endif
+
+/* half clock period. 1µs results in about 400kHz */
+#define I2C_DELAY_US		1
+
+void i2c_init(void);
+void i2c_start(void);
+void i2c_stop(void);
+bool i2c_writeByte(const uint8_t data);
+
+#endif // I2C_H
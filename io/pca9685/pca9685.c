@@ -0,0 +1,199 @@
+#include <esp8266.h>
+#include "i2c.h"
+#include "pca9685.h"
+
+#if defined(PWMOUT) && !defined(ESP03)
+#error "GPIO0 and GPIO2 are used by the soft PWM of the ESP02 pin out. Build with -DESP03"
+#endif
+
+#if (defined(DMXOUT) || defined(WS2812OUT)) && (I2C_SCL_IO_NUM == 2 || I2C_SDA_IO_NUM == 2)
+#error "GPIO2 (PCA9685 SCL by default) is the UART1 TX pin used by io/dmx and io/ws2812"
+#endif
+
+#ifdef PCA9685_DBG
+#define DBG(format, ...) do { os_printf(format "\n", ## __VA_ARGS__); } while(0)
+#else
+#define DBG(format, ...) do { } while(0)
+#endif
+
+#define PCA9685_MODE1				0x00
+#define PCA9685_MODE2				0x01
+#define PCA9685_LED0_ON_L			0x06
+#define PCA9685_PRE_SCALE			0xFE
+
+#define PCA9685_MODE1_AI			0x20	/* register auto increment */
+#define PCA9685_MODE1_SLEEP			0x10
+#define PCA9685_MODE2_OUTDRV		0x04	/* totem pole outputs */
+#define PCA9685_MODE2_INVRT			0x10
+/* bit 4 of LEDn_ON_H and LEDn_OFF_H */
+#define PCA9685_FULL				0x10
+
+#define PCA9685_OSC_FREQ			25000000
+#define PCA9685_PRESCALE			((PCA9685_OSC_FREQ + 2048 * PCA9685_FREQ) / (4096 * PCA9685_FREQ) - 1)
+
+/* the oscillator needs 500µs after leaving the sleep mode */
+#define PCA9685_WAKEUP_US			500
+
+#ifdef PWM_INVERTED
+#define PCA9685_MODE2_VALUE			(PCA9685_MODE2_OUTDRV | PCA9685_MODE2_INVRT)
+#else
+#define PCA9685_MODE2_VALUE			PCA9685_MODE2_OUTDRV
+#endif
+
+/* values to be written */
+static uint16_t pca9685_values[PCA9685_CHANNELS];
+/* channels, which differ from the chip registers */
+static uint8_t pca9685_dirty[(PCA9685_CHANNELS + 7) / 8];
+
+
+static inline bool pca9685_isDirty(const uint16_t channel)
+{
+	return (pca9685_dirty[channel >> 3] & (1 << (channel & 0x7))) != 0;
+}
+
+
+/* address the register of a chip. On failure the bus is already released */
+static bool ICACHE_FLASH_ATTR pca9685_writeStart(const uint8_t chip, const uint8_t reg)
+{
+	i2c_start();
+	if (!i2c_writeByte((PCA9685_ADDRESS + chip) << 1)) {
+		DBG("PCA9685 %u does not respond", chip);
+		i2c_stop();
+		return false;
+	}
+	if (!i2c_writeByte(reg)) {
+		DBG("PCA9685 %u does not accept register 0x%02x", chip, reg);
+		i2c_stop();
+		return false;
+	}
+	return true;
+}
+
+
+static bool ICACHE_FLASH_ATTR pca9685_writeRegister(const uint8_t chip, const uint8_t reg, const uint8_t value)
+{
+	if (!pca9685_writeStart(chip, reg)) {
+		return false;
+	}
+	const bool ack = i2c_writeByte(value);
+	i2c_stop();
+	return ack;
+}
+
+
+/* write the channels [first, last] of one chip in one auto increment burst */
+static bool ICACHE_FLASH_ATTR pca9685_writeChannels(const uint16_t first, const uint16_t last)
+{
+	const uint8_t chip = first / PCA9685_CHIP_CHANNELS;
+	const uint8_t reg = PCA9685_LED0_ON_L + 4 * (first % PCA9685_CHIP_CHANNELS);
+	if (!pca9685_writeStart(chip, reg)) {
+		return false;
+	}
+
+	bool ack = true;
+	for (uint16_t i=first; i<=last && ack; i++) {
+		const uint16_t value = pca9685_values[i];
+		/* ON is always at 0, so OFF is the duty cycle */
+		uint8_t regs[4] = {0, 0, value & 0xFF, value >> 8};
+		if (value == 0) {
+			regs[2] = 0;
+			regs[3] = PCA9685_FULL;
+		} else if (value >= PCA9685_DEPTH) {
+			regs[1] = PCA9685_FULL;
+			regs[2] = 0;
+			regs[3] = 0;
+		}
+		for (uint8_t j=0; j<sizeof(regs) && ack; j++) {
+			ack = i2c_writeByte(regs[j]);
+		}
+	}
+	i2c_stop();
+
+	return ack;
+}
+
+
+/******************************************************************************
+* FunctionName : pca9685_set
+* Description  : set the duty cycle of a channel.
+*				 It is written to the chip with the next pca9685_commit.
+* Parameters   : channel : 0 ~ PCA9685_CHANNELS-1
+*				 value : 0 ~ PCA9685_DEPTH
+* Returns      : true if the value was changed and
+*				 pca9685_commit has to be called
+*******************************************************************************/
+bool ICACHE_FLASH_ATTR pca9685_set(const uint16_t channel, const uint16_t value)
+{
+	if (channel >= PCA9685_CHANNELS) {
+		return false;
+	}
+
+	const uint16_t limited = (value > PCA9685_DEPTH) ? PCA9685_DEPTH : value;
+	if (pca9685_values[channel] == limited) {
+		return false;
+	}
+
+	pca9685_values[channel] = limited;
+	pca9685_dirty[channel >> 3] |= (1 << (channel & 0x7));
+	return true;
+}
+
+
+/******************************************************************************
+* FunctionName : pca9685_commit
+* Description  : write all changed channels to the chips.
+*				 Consecutive changed channels are written in one burst.
+*				 Channels of failed transfers are retried with the next commit.
+* Parameters   : NONE
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR pca9685_commit(void)
+{
+	uint16_t channel = 0;
+	while (channel < PCA9685_CHANNELS) {
+		if (!pca9685_isDirty(channel)) {
+			channel++;
+			continue;
+		}
+
+		/* a burst ends at the last changed channel of the chip */
+		const uint16_t first = channel;
+		const uint16_t chipEnd = (first / PCA9685_CHIP_CHANNELS + 1) * PCA9685_CHIP_CHANNELS;
+		while (channel + 1 < chipEnd && pca9685_isDirty(channel + 1)) {
+			channel++;
+		}
+		const uint16_t last = channel;
+		channel++;
+
+		if (!pca9685_writeChannels(first, last)) {
+			continue;
+		}
+		for (uint16_t i=first; i<=last; i++) {
+			pca9685_dirty[i >> 3] &= ~(1 << (i & 0x7));
+		}
+	}
+}
+
+
+void ICACHE_FLASH_ATTR pca9685_init(void)
+{
+	DBG("PCA9685 init (%u chips, prescale %u)", PCA9685_CHIPS, PCA9685_PRESCALE);
+
+	i2c_init();
+
+	for (uint8_t chip=0; chip<PCA9685_CHIPS; chip++) {
+		/* the prescaler can only be written in sleep mode */
+		pca9685_writeRegister(chip, PCA9685_MODE1, PCA9685_MODE1_AI | PCA9685_MODE1_SLEEP);
+		pca9685_writeRegister(chip, PCA9685_PRE_SCALE, PCA9685_PRESCALE);
+		pca9685_writeRegister(chip, PCA9685_MODE2, PCA9685_MODE2_VALUE);
+		pca9685_writeRegister(chip, PCA9685_MODE1, PCA9685_MODE1_AI);
+	}
+	os_delay_us(PCA9685_WAKEUP_US);
+
+	/* the power on state of the chips is full off. Write it anyway,
+	 * because only the ESP8266 may have been reset
+	 */
+	os_memset(pca9685_values, 0, sizeof(pca9685_values));
+	os_memset(pca9685_dirty, 0xFF, sizeof(pca9685_dirty));
+	pca9685_commit();
+}
@@ -0,0 +1,32 @@
+#ifndef PCA9685_H
+#define PCA9685_H
+
+#include <c_types.h>
+
+/* PCA9685 16 channel 12 bit PWM expander on the bit-banged I2C bus */
+
+#ifndef PCA9685_CHIPS
+/* count of chained chips.
+ * Change it with e.g. make DEFINES="-DPCA9685_CHIPS=2"
+ */
+#define PCA9685_CHIPS			1
+#endif
+
+/* I2C address of the first chip (A0-A5 low).
+ * The following chips have to use the following addresses.
+ */
+#define PCA9685_ADDRESS			0x40
+#define PCA9685_CHIP_CHANNELS	16
+#define PCA9685_CHANNELS		(PCA9685_CHIPS * PCA9685_CHIP_CHANNELS)
+#define PCA9685_DEPTH			4095
+
+#ifndef PCA9685_FREQ
+/* PWM frequency in Hz (24 - 1526) */
+#define PCA9685_FREQ			1000
+#endif
+
+void pca9685_init(void);
+bool pca9685_set(const uint16_t channel, const uint16_t value);
+void pca9685_commit(void);
+
+#endif // PCA9685_H
@@ -0,0 +1,224 @@
+/*
+Host test of the PCA9685 output (io/pca9685/pca9685.c). The bit-banged I2C bus of i2c.c is
+replaced by fake chips, which decode the transactions like a PCA9685: address byte, register
+pointer and data bytes with auto increment. Every transaction is counted and a chip can be told
+not to respond or to refuse the register or a data byte.
+
+The test checks the init sequence, the register values of the duty cycles, that consecutive
+changed channels of a chip go out in one burst, that every start is followed by a stop even
+after a NACK, and that the channels of failed transfers are retried with the next commit.
+
+Usage: make -C io/pca9685/pca9685test
+*/
+
+#include "hosttest.h"
+#include "i2c.h"
+#include "pca9685.h"
+
+#define MODE1			0x00
+#define MODE2			0x01
+#define LED0_ON_L		0x06
+#define PRE_SCALE		0xFE
+#define MODE1_AI		0x20
+#define MODE1_SLEEP		0x10
+#define MODE2_OUTDRV	0x04
+#define FULL			0x10
+
+enum { BUS_IDLE, BUS_ADDRESS, BUS_REGISTER, BUS_DATA, BUS_NACKED };
+
+typedef struct {
+	uint8 regs[256];
+	int missing;			//doesn't acknowledge its address
+	int nackRegister;		//refuses the next register pointer
+	int nackData;			//refuses the data byte after this many, -1 never
+	uint64_t wakeup;		//ticks of the fake clock when the sleep mode was left
+} FakeChip;
+
+static FakeChip chips[PCA9685_CHIPS];
+static int bus = BUS_IDLE;
+static FakeChip *selected;
+static uint8 pointer;
+static int transactions;
+
+void i2c_init(void) {
+}
+
+void i2c_start(void) {
+	CHECK(bus == BUS_IDLE, "start while the last transaction wasn't stopped");
+	bus = BUS_ADDRESS;
+	selected = NULL;
+	transactions++;
+}
+
+void i2c_stop(void) {
+	CHECK(bus != BUS_IDLE, "stop without start");
+	bus = BUS_IDLE;
+}
+
+bool i2c_writeByte(const uint8_t data) {
+	fakeDelay(25);	//9 clocks of 2 * I2C_DELAY_US and the overhead
+	switch (bus) {
+	case BUS_ADDRESS: {
+		int chip = (data >> 1) - PCA9685_ADDRESS;
+		CHECK((data & 1) == 0, "read transaction");
+		if (chip < 0 || chip >= PCA9685_CHIPS || chips[chip].missing) {
+			bus = BUS_NACKED;
+			return false;
+		}
+		selected = &chips[chip];
+		bus = BUS_REGISTER;
+		return true;
+	}
+	case BUS_REGISTER:
+		if (selected->nackRegister) {
+			selected->nackRegister = 0;
+			bus = BUS_NACKED;
+			return false;
+		}
+		pointer = data;
+		bus = BUS_DATA;
+		return true;
+	case BUS_DATA:
+		if (selected->nackData == 0) {
+			selected->nackData = -1;
+			bus = BUS_NACKED;
+			return false;
+		}
+		if (selected->nackData > 0) selected->nackData--;
+		if (pointer >= LED0_ON_L && pointer < PRE_SCALE) {
+			CHECK(!(selected->regs[MODE1] & MODE1_SLEEP), "LED register written in sleep mode");
+			CHECK(fakeNow - selected->wakeup >= 500 * TICKS_US,
+				"LED register written %lluus after the wake up",
+				(unsigned long long)((fakeNow - selected->wakeup) / TICKS_US));
+		}
+		if (pointer == PRE_SCALE) {
+			CHECK(selected->regs[MODE1] & MODE1_SLEEP, "prescaler written outside the sleep mode");
+		}
+		if (pointer == MODE1 && (selected->regs[MODE1] & MODE1_SLEEP) && !(data & MODE1_SLEEP)) {
+			selected->wakeup = fakeNow;
+		}
+		selected->regs[pointer] = data;
+		if (selected->regs[MODE1] & MODE1_AI) pointer++;
+		return true;
+	default:
+		CHECK(0, "byte written after a NACK");
+		return false;
+	}
+}
+
+//Expected register values of a duty cycle
+static void expectChannel(int channel, uint16 value) {
+	const uint8 *regs = &chips[channel / PCA9685_CHIP_CHANNELS]
+		.regs[LED0_ON_L + 4 * (channel % PCA9685_CHIP_CHANNELS)];
+	uint8 expected[4] = {0, 0, value & 0xFF, value >> 8};
+	if (value == 0) {
+		expected[3] = FULL;
+	} else if (value >= PCA9685_DEPTH) {
+		expected[1] = FULL;
+		expected[2] = 0;
+		expected[3] = 0;
+	}
+	CHECK(memcmp(regs, expected, 4) == 0,
+		"channel %d is %02x %02x %02x %02x instead of %02x %02x %02x %02x for %u", channel,
+		regs[0], regs[1], regs[2], regs[3],
+		expected[0], expected[1], expected[2], expected[3], value);
+}
+
+//Commit and return the count of transactions
+static int commit(void) {
+	int before = transactions;
+	pca9685_commit();
+	CHECK(bus == BUS_IDLE, "bus not released after the commit");
+	return transactions - before;
+}
+
+int main(void) {
+	static uint16 values[PCA9685_CHANNELS];
+	int n, total = 0;
+
+	for (int i = 0; i < PCA9685_CHIPS; i++) {
+		//power on state is sleep mode, fill the LED registers to see that they are written
+		memset(chips[i].regs, 0xAA, sizeof(chips[i].regs));
+		chips[i].regs[MODE1] = MODE1_SLEEP;
+		chips[i].nackData = -1;
+	}
+
+	//4 register writes per chip and a burst of all channels
+	pca9685_init();
+	CHECK(bus == BUS_IDLE, "bus not released after the init");
+	CHECK(transactions == 5 * PCA9685_CHIPS, "%d transactions in the init", transactions);
+	for (int i = 0; i < PCA9685_CHIPS; i++) {
+		CHECK(chips[i].regs[MODE1] == MODE1_AI, "chip %d MODE1 0x%02x", i, chips[i].regs[MODE1]);
+		CHECK(chips[i].regs[MODE2] == MODE2_OUTDRV, "chip %d MODE2 0x%02x", i, chips[i].regs[MODE2]);
+		//25MHz / (4096 * 1000Hz) - 1, rounded
+		CHECK(chips[i].regs[PRE_SCALE] == 5, "chip %d PRE_SCALE %u", i, chips[i].regs[PRE_SCALE]);
+	}
+	for (int i = 0; i < PCA9685_CHANNELS; i++) expectChannel(i, 0);
+	total += transactions;
+
+	n = commit();
+	CHECK(n == 0, "%d transactions without a change", n);
+
+	//one burst per run of changed channels, a run ends at the chip boundary
+	static const struct { int channel; uint16 value; } changes[] = {
+		{0, 1}, {1, 2048}, {2, PCA9685_DEPTH},
+		{5, 1000},
+		{15, 4000}, {16, 5000}, {17, 7},
+		{PCA9685_CHANNELS - 1, 300},
+	};
+	for (int i = 0; i < (int)(sizeof(changes) / sizeof(changes[0])); i++) {
+		CHECK(pca9685_set(changes[i].channel, changes[i].value), "channel %d unchanged",
+			changes[i].channel);
+		values[changes[i].channel] =
+			changes[i].value > PCA9685_DEPTH ? PCA9685_DEPTH : changes[i].value;
+	}
+	CHECK(!pca9685_set(5, 1000), "same value reported as changed");
+	CHECK(!pca9685_set(16, PCA9685_DEPTH + 1), "limited value reported as changed");
+	CHECK(!pca9685_set(PCA9685_CHANNELS, 1), "channel out of range accepted");
+	n = commit();
+	CHECK(n == 5, "%d transactions for 5 runs", n);
+	for (int i = 0; i < PCA9685_CHANNELS; i++) expectChannel(i, values[i]);
+	total += n;
+
+	//a missing chip is retried with every commit, the other chip isn't affected
+	chips[1].missing = 1;
+	pca9685_set(3, values[3] = 10);
+	pca9685_set(20, values[20] = 20);
+	n = commit();
+	CHECK(n == 2, "%d transactions with a missing chip", n);
+	expectChannel(3, values[3]);
+	n = commit();
+	CHECK(n == 1, "%d transactions for the retry", n);
+	chips[1].missing = 0;
+	n = commit();
+	CHECK(n == 1, "%d transactions after the chip is back", n);
+	for (int i = 0; i < PCA9685_CHANNELS; i++) expectChannel(i, values[i]);
+	total += 4;
+
+	//a refused register pointer releases the bus and is retried
+	chips[0].nackRegister = 1;
+	pca9685_set(7, values[7] = 77);
+	n = commit();
+	CHECK(n == 1, "%d transactions with a refused register", n);
+	CHECK(commit() == 1, "refused register not retried");
+	expectChannel(7, values[7]);
+	CHECK(commit() == 0, "channel still changed after the retry");
+	total += 2;
+
+	//a refused data byte within a burst retries the whole run
+	chips[0].nackData = 5;
+	pca9685_set(8, values[8] = 800);
+	pca9685_set(9, values[9] = 900);
+	pca9685_set(10, values[10] = 1000);
+	n = commit();
+	CHECK(n == 1, "%d transactions with a refused data byte", n);
+	n = commit();
+	CHECK(n == 1, "%d transactions for the retry of the run", n);
+	for (int i = 0; i < PCA9685_CHANNELS; i++) expectChannel(i, values[i]);
+	CHECK(commit() == 0, "channels still changed after the retry");
+	total += 2;
+
+	CHECK(total == transactions, "%d of %d transactions counted", total, transactions);
+	printf("pca9685test: %d transactions to %d chips ok\n", transactions, PCA9685_CHIPS);
+	return 0;
+}
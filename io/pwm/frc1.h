@@ -0,0 +1,30 @@
+#ifndef __FRC1_H__
+#define __FRC1_H__
+
+/* FRC1 hardware timer definitions shared by the timer interrupt based outputs.
+ * Only one of them can own the timer.
+ */
+
+//XXX: 0xffffffff/(80000000/16)=35A
+#define US_TO_RTC_TIMER_TICKS(t)          \
+    ((t) ?                                   \
+     (((t) > 0x35A) ?                   \
+      (((t)>>2) * ((APB_CLK_FREQ>>4)/250000) + ((t)&0x3) * ((APB_CLK_FREQ>>4)/1000000))  :    \
+      (((t) *(APB_CLK_FREQ>>4)) / 1000000)) :    \
+     0)
+
+#define FRC1_ENABLE_TIMER  BIT7
+
+//TIMER PREDIVED MODE
+typedef enum {
+    DIVDED_BY_1 = 0,		//timer clock
+    DIVDED_BY_16 = 4,	//divided by 16
+    DIVDED_BY_256 = 8,	//divided by 256
+} TIMER_PREDIVED_MODE;
+
+typedef enum {			//timer interrupt mode
+    TM_LEVEL_INT = 1,	// level interrupt
+    TM_EDGE_INT   = 0,	//edge interrupt
+} TIMER_INT_MODE;
+
+#endif
@@ -16,6 +16,7 @@
 #include "user_interface.h"
 #include "espmissingincludes.h"
 #include "pwm.h"
+#include "io/pwm/frc1.h"
 #include "io/pwm/zcd/zcd.h"
 
 LOCAL struct pwm_param pwm;
@@ -46,28 +47,6 @@ LOCAL uint8 pwm_out_io_num[PWM_CHANNEL] = {PWM_0_OUT_IO_NUM
 LOCAL uint8 pwm_current_channel = 0;							//current pwm channel in pwm_tim1_intr_handler
 LOCAL uint16 pwm_gpio = 0;									//all pwm gpio bits
 
-//XXX: 0xffffffff/(80000000/16)=35A
-#define US_TO_RTC_TIMER_TICKS(t)          \
-    ((t) ?                                   \
-     (((t) > 0x35A) ?                   \
-      (((t)>>2) * ((APB_CLK_FREQ>>4)/250000) + ((t)&0x3) * ((APB_CLK_FREQ>>4)/1000000))  :    \
-      (((t) *(APB_CLK_FREQ>>4)) / 1000000)) :    \
-     0)
-
-#define FRC1_ENABLE_TIMER  BIT7
-
-//TIMER PREDIVED MODE
-typedef enum {
-    DIVDED_BY_1 = 0,		//timer clock
-    DIVDED_BY_16 = 4,	//divided by 16
-    DIVDED_BY_256 = 8,	//divided by 256
-} TIMER_PREDIVED_MODE;
-
-typedef enum {			//timer interrupt mode
-    TM_LEVEL_INT = 1,	// level interrupt
-    TM_EDGE_INT   = 0,	//edge interrupt
-} TIMER_INT_MODE;
-
 // sort all channels' h_time,small to big
 LOCAL void ICACHE_FLASH_ATTR
 pwm_insert_sort(struct pwm_single_param pwm[], uint8 n)
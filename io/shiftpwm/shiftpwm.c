@@ -0,0 +1,219 @@
+#include <esp8266.h>
+#include "io/pwm/frc1.h"
+#include "shiftpwm.h"
+
+#ifdef PWMOUT
+#error "io/pwm and io/shiftpwm can not be used together, because both need the FRC1 timer"
+#endif
+
+#if SHIFTPWM_REGISTERS > 64
+#error "The HSPI can only send 64 bytes at once"
+#endif
+
+#ifdef SHIFTPWM_DBG
+#define DBG(format, ...) do { os_printf(format "\n", ## __VA_ARGS__); } while(0)
+#else
+#define DBG(format, ...) do { } while(0)
+#endif
+
+/* HSPI registers (spi_register.h is not part of the SDK include path) */
+#define HSPI					1
+#define REG_SPI_BASE(i)			(0x60000200 - (i) * 0x100)
+#define SPI_CMD(i)				(REG_SPI_BASE(i) + 0x0)
+#define SPI_USR					BIT18
+#define SPI_CLOCK(i)			(REG_SPI_BASE(i) + 0x18)
+#define SPI_CLKDIV_PRE_S		18
+#define SPI_CLKCNT_N_S			12
+#define SPI_CLKCNT_H_S			6
+#define SPI_CLKCNT_L_S			0
+#define SPI_USER(i)				(REG_SPI_BASE(i) + 0x1C)
+#define SPI_USR_COMMAND			BIT31
+#define SPI_USR_ADDR			BIT30
+#define SPI_USR_DUMMY			BIT29
+#define SPI_USR_MISO			BIT28
+#define SPI_USR_MOSI			BIT27
+#define SPI_CS_SETUP			BIT5
+#define SPI_CS_HOLD				BIT4
+#define SPI_FLASH_MODE			BIT2
+#define SPI_USER1(i)			(REG_SPI_BASE(i) + 0x20)
+#define SPI_USR_MOSI_BITLEN_S	17
+#define SPI_W0(i)				(REG_SPI_BASE(i) + 0x40)
+/* HSPI clock is derived from the system clock */
+#define SPI_CLK_EQU_SYSCLK_HSPI	BIT9
+
+/* 80MHz / 2 / 4 = 10MHz */
+#define SHIFTPWM_SPI_PREDIV		2
+#define SHIFTPWM_SPI_CNTDIV		4
+
+/* duration of the transfer of all registers in ns (0.8µs per register) */
+#define SHIFTPWM_TRANSFER_NS	(SHIFTPWM_REGISTERS * 8 * SHIFTPWM_SPI_PREDIV * SHIFTPWM_SPI_CNTDIV * 1000 / (APB_CLK_FREQ / 1000000))
+/* interrupt entry and writing the data registers until the transfer starts */
+#define SHIFTPWM_INTR_NS		5000
+/* display time of the least significant bit plane in ns */
+#define SHIFTPWM_LSB_NS			(1000000000 / (SHIFTPWM_FREQ * 255))
+
+/* the next interrupt waits for the transfer, which would stretch the short planes.
+ * At 200Hz this allows 18 registers, 64 registers need 69Hz or less.
+ */
+#if SHIFTPWM_INTR_NS + SHIFTPWM_TRANSFER_NS > SHIFTPWM_LSB_NS
+#error "The shortest bit plane has to be longer than the interrupt and the HSPI transfer. Use less SHIFTPWM_REGISTERS or a lower SHIFTPWM_FREQ"
+#endif
+
+#define SHIFTPWM_PLANES			8
+#define SHIFTPWM_WORDS			((SHIFTPWM_REGISTERS + 3) / 4)
+/* display time of the least significant bit plane in FRC1 ticks (divided by 16).
+ * All planes together last 255 of these.
+ */
+#define SHIFTPWM_BASE_TICKS		((APB_CLK_FREQ >> 4) / (SHIFTPWM_FREQ * 255))
+
+/* bit planes in the order of the HSPI data registers.
+ * The interrupt sends the active buffer,
+ * shiftpwm_commit calculates the other one.
+ */
+static uint32 shiftpwm_planes[2][SHIFTPWM_PLANES][SHIFTPWM_WORDS];
+static volatile uint8_t shiftpwm_active = 0;
+/* the other buffer is ready and has to be activated with the next period */
+static volatile bool shiftpwm_update = false;
+/* bit plane to be sent by the next interrupt */
+static uint8_t shiftpwm_plane = 0;
+
+static uint8_t shiftpwm_values[SHIFTPWM_CHANNELS];
+
+
+/* FRC1 interrupt, so it must not use ICACHE_FLASH_ATTR */
+static void shiftpwm_tim1_intr_handler(void)
+{
+	RTC_CLR_REG_MASK(FRC1_INT_ADDRESS, FRC1_INT_CLR_MASK);
+
+	/* only switch the buffers between two periods */
+	if (shiftpwm_plane == 0 && shiftpwm_update) {
+		shiftpwm_active ^= 1;
+		shiftpwm_update = false;
+	}
+
+	/* the previous transfer is finished long ago, but be sure */
+	while (READ_PERI_REG(SPI_CMD(HSPI)) & SPI_USR) {
+	}
+
+	const uint32* const words = shiftpwm_planes[shiftpwm_active][shiftpwm_plane];
+	for (uint8_t i=0; i<SHIFTPWM_WORDS; i++) {
+		WRITE_PERI_REG(SPI_W0(HSPI) + i * 4, words[i]);
+	}
+	SET_PERI_REG_MASK(SPI_CMD(HSPI), SPI_USR);
+
+	/* bit n is displayed for 2^n base times */
+	RTC_REG_WRITE(FRC1_LOAD_ADDRESS, SHIFTPWM_BASE_TICKS << shiftpwm_plane);
+	shiftpwm_plane = (shiftpwm_plane + 1) % SHIFTPWM_PLANES;
+}
+
+
+static void ICACHE_FLASH_ATTR shiftpwm_hspi_init(void)
+{
+	CLEAR_PERI_REG_MASK(PERIPHS_IO_MUX, SPI_CLK_EQU_SYSCLK_HSPI);
+	PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTCK_U, FUNC_HSPID_MOSI);
+	PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTMS_U, FUNC_HSPI_CLK);
+	PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTDO_U, FUNC_HSPI_CS0);
+
+	WRITE_PERI_REG(SPI_CLOCK(HSPI),
+			((SHIFTPWM_SPI_PREDIV - 1) << SPI_CLKDIV_PRE_S) |
+			((SHIFTPWM_SPI_CNTDIV - 1) << SPI_CLKCNT_N_S) |
+			((SHIFTPWM_SPI_CNTDIV / 2 - 1) << SPI_CLKCNT_H_S) |
+			((SHIFTPWM_SPI_CNTDIV - 1) << SPI_CLKCNT_L_S));
+
+	/* write only, MSB first */
+	SET_PERI_REG_MASK(SPI_USER(HSPI), SPI_CS_SETUP | SPI_CS_HOLD | SPI_USR_MOSI);
+	CLEAR_PERI_REG_MASK(SPI_USER(HSPI), SPI_FLASH_MODE | SPI_USR_MISO | SPI_USR_ADDR | SPI_USR_COMMAND | SPI_USR_DUMMY);
+
+	/* all transfers have the same length */
+	WRITE_PERI_REG(SPI_USER1(HSPI), (SHIFTPWM_CHANNELS - 1) << SPI_USR_MOSI_BITLEN_S);
+}
+
+
+/******************************************************************************
+* FunctionName : shiftpwm_set
+* Description  : set the brightness of a channel.
+*				 It is used after the next shiftpwm_commit.
+* Parameters   : channel : 0 ~ SHIFTPWM_CHANNELS-1
+*				 value : 0 ~ 255
+* Returns      : true if the value was changed and
+*				 shiftpwm_commit has to be called
+*******************************************************************************/
+bool ICACHE_FLASH_ATTR shiftpwm_set(const uint16_t channel, const uint8_t value)
+{
+	if (channel >= SHIFTPWM_CHANNELS || shiftpwm_values[channel] == value) {
+		return false;
+	}
+
+	shiftpwm_values[channel] = value;
+	return true;
+}
+
+
+/******************************************************************************
+* FunctionName : shiftpwm_commit
+* Description  : calculate the bit planes of all channels.
+*				 They are displayed from the next period on.
+* Parameters   : NONE
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR shiftpwm_commit(void)
+{
+	/* the interrupt does not switch the buffers any more,
+	 * so the inactive one can be written
+	 */
+	shiftpwm_update = false;
+	uint32 (* const planes)[SHIFTPWM_WORDS] = shiftpwm_planes[shiftpwm_active ^ 1];
+	os_memset(planes, 0, sizeof(shiftpwm_planes[0]));
+
+	for (uint16_t channel=0; channel<SHIFTPWM_CHANNELS; channel++) {
+		const uint8_t value = shiftpwm_values[channel];
+		if (value == 0) {
+			continue;
+		}
+
+		/* the first sent byte is shifted to the last register.
+		 * The HSPI sends the bytes of a word LSB first and the bits MSB first,
+		 * so Qn of a register is bit n of its byte.
+		 */
+		const uint8_t byte = SHIFTPWM_REGISTERS - 1 - channel / 8;
+		const uint32 mask = 1UL << ((byte % 4) * 8 + channel % 8);
+		for (uint8_t plane=0; plane<SHIFTPWM_PLANES; plane++) {
+			if (value & (1 << plane)) {
+				planes[plane][byte / 4] |= mask;
+			}
+		}
+	}
+
+#ifdef PWM_INVERTED
+	for (uint8_t plane=0; plane<SHIFTPWM_PLANES; plane++) {
+		for (uint8_t i=0; i<SHIFTPWM_WORDS; i++) {
+			planes[plane][i] = ~planes[plane][i];
+		}
+	}
+#endif
+
+	shiftpwm_update = true;
+}
+
+
+void ICACHE_FLASH_ATTR shiftpwm_init(void)
+{
+	DBG("Shift register PWM init (%u channels, %u ticks)", SHIFTPWM_CHANNELS, SHIFTPWM_BASE_TICKS);
+
+	shiftpwm_hspi_init();
+
+	/* all channels off */
+	os_memset(shiftpwm_values, 0, sizeof(shiftpwm_values));
+	shiftpwm_commit();
+
+	RTC_REG_WRITE(FRC1_CTRL_ADDRESS,
+				  DIVDED_BY_16
+				  | FRC1_ENABLE_TIMER
+				  | TM_EDGE_INT);
+
+	ETS_FRC_TIMER1_INTR_ATTACH(shiftpwm_tim1_intr_handler, NULL);
+	TM1_EDGE_INT_ENABLE();
+	ETS_FRC1_INTR_ENABLE();
+
+	RTC_REG_WRITE(FRC1_LOAD_ADDRESS, SHIFTPWM_BASE_TICKS);
+}
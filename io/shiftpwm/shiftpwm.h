@@ -0,0 +1,33 @@
+#ifndef SHIFTPWM_H
+#define SHIFTPWM_H
+
+#include <c_types.h>
+
+/* bit angle modulation on chained 74HC595 shift registers.
+ * The registers are written by the HSPI:
+ * GPIO13 (MOSI) -> SER, GPIO14 (CLK) -> SRCLK, GPIO15 (CS) -> RCLK
+ * The rising CS edge at the end of each transfer latches the outputs.
+ * The first channel is Q0 of the register next to the ESP8266.
+ */
+
+#ifndef SHIFTPWM_REGISTERS
+/* count of chained registers (8 channels each, 64 at most).
+ * The transfer of all registers has to fit into the shortest bit plane,
+ * so at the default SHIFTPWM_FREQ only 18 registers can be used.
+ * Change it with e.g. make DEFINES="-DSHIFTPWM_REGISTERS=8"
+ */
+#define SHIFTPWM_REGISTERS		4
+#endif
+
+#define SHIFTPWM_CHANNELS		(SHIFTPWM_REGISTERS * 8)
+
+#ifndef SHIFTPWM_FREQ
+/* refresh rate of all 8 bit planes in Hz */
+#define SHIFTPWM_FREQ			200
+#endif
+
+void shiftpwm_init(void);
+bool shiftpwm_set(const uint16_t channel, const uint8_t value);
+void shiftpwm_commit(void);
+
+#endif // SHIFTPWM_H
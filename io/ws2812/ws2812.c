@@ -0,0 +1,179 @@
+#include <esp8266.h>
+#include "uart.h"
+#include "ws2812.h"
+
+#ifdef DMXOUT
+#error "io/dmx and io/ws2812 can not be used together, because both need UART1"
+#endif
+
+#ifdef WS2812_DBG
+#define DBG(format, ...) do { os_printf(format "\n", ## __VA_ARGS__); } while(0)
+#else
+#define DBG(format, ...) do { } while(0)
+#endif
+
+#define UART_TX_FIFO_SIZE			128
+/* refill the fifo, if less than this characters are left (160µs) */
+#define WS2812_TX_EMPTY_THRESHOLD	64
+
+/* not defined in uart_hw.h */
+#define UART_TXD_INV				BIT(22)
+/* 6 data bits, no parity, 1 stop bit, inverted TX */
+#define WS2812_UART_CONF0			((SIX_BITS << UART_BIT_NUM_S) | (0x1 << UART_STOP_BIT_NUM_S) | UART_TXD_INV)
+
+#define WS2812_FRAME_LEN			(WS2812_PIXELS * 3)
+
+/* UART characters for two WS2812 bits (MSB first).
+ * With inverted TX the start bit is the high part of the first WS2812 bit
+ * and the stop bit is the low part of the second one.
+ * A zero is 1 high and 3 low UART bits, a one is 3 high and 1 low UART bits.
+ * The data bits are sent LSB first and inverted.
+ */
+static const uint8_t ws2812_bitPatterns[4] = {
+	0x37,	/* 0b110111 -> 0, 0 */
+	0x07,	/* 0b000111 -> 0, 1 */
+	0x34,	/* 0b110100 -> 1, 0 */
+	0x04,	/* 0b000100 -> 1, 1 */
+};
+
+/* double buffered frame in the WS2812 color order (GRB).
+ * The uart interrupt sends the front buffer,
+ * received Art-Net data is written into the back buffer.
+ */
+static uint8_t ws2812_buffers[2][WS2812_FRAME_LEN];
+static uint8_t* ws2812_front = ws2812_buffers[0];
+static uint8_t* ws2812_back = ws2812_buffers[1];
+
+/* next byte of the front buffer to be written into the fifo */
+static volatile uint16_t ws2812_pos = WS2812_FRAME_LEN;
+/* end of the last transmission including the latch time (system_get_time) */
+static uint32 ws2812_busyUntil = 0;
+/* a committed frame is waiting for the end of the last transmission */
+static bool ws2812_pending = false;
+
+static ETSTimer ws2812_timer;
+
+
+static inline uint8_t ws2812_tx_fifo_count(void)
+{
+	return (READ_PERI_REG(UART_STATUS(UART1)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT;
+}
+
+
+/* called from the uart interrupt, so it must not use ICACHE_FLASH_ATTR */
+static void ws2812_fill_fifo(void)
+{
+	uint8_t count = ws2812_tx_fifo_count();
+	while (count <= (UART_TX_FIFO_SIZE - 4) && ws2812_pos < WS2812_FRAME_LEN) {
+		const uint8_t value = ws2812_front[ws2812_pos++];
+		WRITE_PERI_REG(UART_FIFO(UART1), ws2812_bitPatterns[(value >> 6) & 0x3]);
+		WRITE_PERI_REG(UART_FIFO(UART1), ws2812_bitPatterns[(value >> 4) & 0x3]);
+		WRITE_PERI_REG(UART_FIFO(UART1), ws2812_bitPatterns[(value >> 2) & 0x3]);
+		WRITE_PERI_REG(UART_FIFO(UART1), ws2812_bitPatterns[value & 0x3]);
+		count += 4;
+	}
+
+	if (ws2812_pos >= WS2812_FRAME_LEN) {
+		CLEAR_PERI_REG_MASK(UART_INT_ENA(UART1), UART_TXFIFO_EMPTY_INT_ENA);
+	}
+}
+
+
+static void ICACHE_FLASH_ATTR ws2812_start(void* arg)
+{
+	/* never touch the front buffer while it is sent
+	 * and keep the line low for the latch time
+	 */
+	const sint32 wait = ws2812_busyUntil - system_get_time();
+	if (ws2812_pos < WS2812_FRAME_LEN || ws2812_tx_fifo_count() > 0 || wait > 0) {
+		os_timer_arm(&ws2812_timer, 1, 0);
+		return;
+	}
+	ws2812_pending = false;
+
+	uint8_t* const next = ws2812_back;
+	ws2812_back = ws2812_front;
+	ws2812_front = next;
+	/* the back buffer has to contain the newest frame,
+	 * because the next frame may only update some universes
+	 */
+	os_memcpy(ws2812_back, ws2812_front, WS2812_FRAME_LEN);
+
+	ws2812_busyUntil = system_get_time() + WS2812_FRAME_LEN * WS2812_BYTE_US + WS2812_LATCH_US;
+
+	ETS_UART_INTR_DISABLE();
+	ws2812_pos = 0;
+	ws2812_fill_fifo();
+	WRITE_PERI_REG(UART_INT_CLR(UART1), UART_TXFIFO_EMPTY_INT_CLR);
+	SET_PERI_REG_MASK(UART_INT_ENA(UART1), UART_TXFIFO_EMPTY_INT_ENA);
+	ETS_UART_INTR_ENABLE();
+}
+
+
+/******************************************************************************
+* FunctionName : ws2812_setUniverse
+* Description  : write the RGB slots of an Art-Net universe into the back buffer
+* Parameters   : universe : index of the universe relative to the first pixel
+*				 data : RGB values of WS2812_PIXELS_PER_UNIVERSE pixels at most
+*				 len : count of slots in data
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR ws2812_setUniverse(const uint8_t universe, const uint8_t* const data, const uint16_t len)
+{
+	const uint16_t firstPixel = universe * WS2812_PIXELS_PER_UNIVERSE;
+	if (firstPixel >= WS2812_PIXELS) {
+		return;
+	}
+
+	uint16_t pixels = len / 3;
+	if (pixels > WS2812_PIXELS_PER_UNIVERSE) {
+		pixels = WS2812_PIXELS_PER_UNIVERSE;
+	}
+	if (pixels > WS2812_PIXELS - firstPixel) {
+		pixels = WS2812_PIXELS - firstPixel;
+	}
+
+	uint8_t* dest = &ws2812_back[firstPixel * 3];
+	const uint8_t* src = data;
+	for (uint16_t i=0; i<pixels; i++) {
+		/* RGB -> GRB */
+		dest[0] = src[1];
+		dest[1] = src[0];
+		dest[2] = src[2];
+		dest += 3;
+		src += 3;
+	}
+}
+
+
+/******************************************************************************
+* FunctionName : ws2812_commit
+* Description  : send the back buffer as soon as the running transmission
+*				 and the latch time has finished
+* Parameters   : NONE
+* Returns      : NONE
+*******************************************************************************/
+void ICACHE_FLASH_ATTR ws2812_commit(void)
+{
+	/* the waiting transmission will also send the newest data */
+	if (ws2812_pending) {
+		return;
+	}
+
+	ws2812_pending = true;
+	ws2812_start(NULL);
+}
+
+
+void ICACHE_FLASH_ATTR ws2812_init(void)
+{
+	DBG("WS2812 init (%u pixels, %u universes)", WS2812_PIXELS, WS2812_UNIVERSES);
+
+	uart1_claim(WS2812_BAUD_RATE, WS2812_UART_CONF0, WS2812_TX_EMPTY_THRESHOLD, ws2812_fill_fifo);
+
+	os_timer_disarm(&ws2812_timer);
+	os_timer_setfn(&ws2812_timer, ws2812_start, NULL);
+
+	/* switch all pixels off */
+	ws2812_commit();
+}
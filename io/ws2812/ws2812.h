@@ -0,0 +1,33 @@
+#ifndef WS2812_H
+#define WS2812_H
+
+#include <c_types.h>
+
+/* WS2812 (NeoPixel) output on UART1 (TXD on GPIO2).
+ * The UART sends with 3.2MBaud, 6N1 and inverted TX,
+ * so each UART character encodes two bits of the 800kHz WS2812 protocol.
+ * Note: On ESP02 GPIO2 is also used by PWM channel 1.
+ */
+
+#ifndef WS2812_PIXELS
+/* count of pixels on the strip.
+ * Change it with e.g. make DEFINES="-DWS2812_PIXELS=340"
+ */
+#define WS2812_PIXELS				170
+#endif
+
+/* each Art-Net universe contains 170 RGB pixels (510 slots) */
+#define WS2812_PIXELS_PER_UNIVERSE	170
+#define WS2812_UNIVERSES			((WS2812_PIXELS + WS2812_PIXELS_PER_UNIVERSE - 1) / WS2812_PIXELS_PER_UNIVERSE)
+
+#define WS2812_BAUD_RATE			3200000
+/* one pixel byte needs 4 UART characters of 2.5µs */
+#define WS2812_BYTE_US				10
+/* low time to latch the data (280µs for WS2812B, 50µs for older ones) */
+#define WS2812_LATCH_US				300
+
+void ws2812_init(void);
+void ws2812_setUniverse(const uint8_t universe, const uint8_t* const data, const uint16_t len);
+void ws2812_commit(void);
+
+#endif // WS2812_H
@@ -0,0 +1,134 @@
+/*
+Host test of the WS2812 output (io/ws2812/ws2812.c). The UART1 registers are emulated by the fake
+UART of test/host/hosttest.c, which records each character with its start time.
+
+The sent characters are compared byte for byte with the encoding of the expected GRB frame,
+which is derived here from the WS2812 waveform and the UART framing in CONF0 (start bit, data
+bits LSB first, stop bit, inverted TX): a 0 is high for one UART bit and low for three, a 1 is
+high for three UART bits and low for one. Between the frames the line has to stay low for the
+latch time and within a frame the fifo must not run empty.
+
+Usage: make -C io/ws2812/ws2812test
+*/
+
+#include "hosttest.h"
+#include "ws2812.h"
+
+//inverted TX, not defined in uart_hw.h
+#define TXD_INV BIT(22)
+
+#define FRAME_LEN (WS2812_PIXELS * 3)
+
+//UART character, which puts the line levels (1 high) of one character time on the wire
+static uint8 encodeLine(const int *line) {
+	int bits = fakeDataBits();
+	int inv = (fakeConf0 & TXD_INV) != 0;
+	CHECK(line[0] == inv, "the start bit sets the wrong level");
+	CHECK(line[bits + 1] == !inv, "the stop bit sets the wrong level");
+	uint8 c = 0;
+	for (int i = 0; i < bits; i++) {
+		if (line[1 + i] ^ inv) c |= 1 << i;
+	}
+	return c;
+}
+
+//Expected UART characters of a frame: each WS2812 bit (MSB first) is four UART bits long
+static int encodeFrame(const uint8 *frame, uint8 *chars) {
+	int bitsPerChar = fakeDataBits() + 2;
+	CHECK(bitsPerChar % 4 == 0, "a character doesn't hold whole WS2812 bits");
+	int line[16], lineLen = 0, n = 0;
+	for (int i = 0; i < FRAME_LEN; i++) {
+		for (int b = 7; b >= 0; b--) {
+			int one = (frame[i] >> b) & 1;
+			line[lineLen++] = 1;
+			line[lineLen++] = one;
+			line[lineLen++] = one;
+			line[lineLen++] = 0;
+			if (lineLen == bitsPerChar) {
+				chars[n++] = encodeLine(line);
+				lineLen = 0;
+			}
+		}
+	}
+	return n;
+}
+
+//Check the frame sent from character first on, returns the character after it
+static int checkFrame(int first, const uint8 *frame) {
+	static uint8 chars[FRAME_LEN * 8];
+	int n = encodeFrame(frame, chars);
+	const WireEvent *sent = fakeWire;
+	uint64_t charTicks = fakeCharTicks();
+	CHECK(first + n <= fakeWireLen, "frame with %d of %d characters", fakeWireLen - first, n);
+	if (first > 0) {
+		uint64_t low = sent[first].t - (sent[first - 1].t + charTicks);
+		CHECK(low >= WS2812_LATCH_US * TICKS_US, "latch time of %lluus",
+			(unsigned long long)(low / TICKS_US));
+	}
+	for (int i = 0; i < n; i++) {
+		CHECK(sent[first + i].value == chars[i],
+			"character %d (pixel %d) is 0x%02x instead of 0x%02x",
+			i, i / 12, sent[first + i].value, chars[i]);
+		if (i > 0) {
+			//the line is low while the fifo is empty, which latches the pixels
+			CHECK(sent[first + i].t == sent[first + i - 1].t + charTicks,
+				"gap before character %d", i);
+		}
+	}
+	return first + n;
+}
+
+int main(void) {
+	static uint8 frame[FRAME_LEN];
+	static uint8 universe[WS2812_PIXELS_PER_UNIVERSE * 3];
+
+	ws2812_init();
+	CHECK(fakeBaud == WS2812_BAUD_RATE, "baud rate %u", fakeBaud);
+	CHECK(fakeDataBits() == 6, "%d data bits", fakeDataBits());
+	CHECK((fakeConf0 & UART_PARITY_EN) == 0, "parity enabled");
+	CHECK(((fakeConf0 >> UART_STOP_BIT_NUM_S) & 3) == 1, "not 1 stop bit");
+	CHECK(4 * fakeCharTicks() == WS2812_BYTE_US * TICKS_US,
+		"a pixel byte doesn't take %dus", WS2812_BYTE_US);
+
+	//all pixels off after the init
+	fakeRunUntil(fakeNow + 50000 * TICKS_US);
+	int pos = checkFrame(0, frame);
+	CHECK(pos == fakeWireLen, "more than one frame after the init");
+
+	//all universes, RGB on the wire in GRB order
+	for (int u = 0; u < WS2812_UNIVERSES; u++) {
+		for (int i = 0; i < (int)sizeof(universe); i++) universe[i] = i * 37 + u * 101 + 1;
+		ws2812_setUniverse(u, universe, sizeof(universe));
+		for (int p = 0; p < WS2812_PIXELS_PER_UNIVERSE; p++) {
+			int pixel = u * WS2812_PIXELS_PER_UNIVERSE + p;
+			if (pixel >= WS2812_PIXELS) break;
+			frame[pixel * 3] = universe[p * 3 + 1];
+			frame[pixel * 3 + 1] = universe[p * 3];
+			frame[pixel * 3 + 2] = universe[p * 3 + 2];
+		}
+	}
+	ws2812_commit();
+	fakeRunUntil(fakeNow + 50000 * TICKS_US);
+	pos = checkFrame(pos, frame);
+	CHECK(pos == fakeWireLen, "more than one frame after the commit");
+
+	//a commit during the transmission waits for it and the latch time, a short universe only
+	//updates its pixels and the others are kept
+	universe[0] = 0xff;
+	universe[1] = 0x00;
+	universe[2] = 0x80;
+	ws2812_setUniverse(0, universe, 3);
+	frame[0] = 0x00;
+	frame[1] = 0xff;
+	frame[2] = 0x80;
+	ws2812_commit();
+	fakeRunUntil(fakeNow + 100 * TICKS_US);
+	ws2812_commit();
+	fakeRunUntil(fakeNow + 50000 * TICKS_US);
+	pos = checkFrame(pos, frame);
+	pos = checkFrame(pos, frame);
+	CHECK(pos == fakeWireLen, "more than two frames after two commits");
+
+	printf("ws2812test: %d characters of %d pixels ok\n", fakeWireLen, WS2812_PIXELS);
+	return 0;
+}
@@ -67,11 +67,11 @@ ajaxConsoleReset(HttpdConnData *connData) {
 int ICACHE_FLASH_ATTR
 ajaxConsoleBaud(HttpdConnData *connData) {
   if (connData->conn==NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
-  char buff[512];
-  int len, status = 400;
-  len = httpdFindArg(connData->getArgs, "rate", buff, sizeof(buff));
-  if (len > 0) {
-    int rate = atoi(buff);
+  char buff[32];
+  int status = 400;
+  char *arg = httpdGetArg(connData, "rate", NULL);
+  if (arg != NULL && *arg != 0) {
+    int rate = atoi(arg);
     if (rate >= 9600 && rate <= 1000000) {
       uart0_baud(rate);
       flashConfig.baud_rate = rate;
@@ -90,13 +90,12 @@ ajaxConsoleBaud(HttpdConnData *connData) {
 int ICACHE_FLASH_ATTR
 ajaxConsoleSend(HttpdConnData *connData) {
   if (connData->conn==NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
-  char buff[2048];
   int len, status = 400;
-  
-  // figure out where to start in buffer based on URI param
-  len = httpdFindArg(connData->getArgs, "text", buff, sizeof(buff));
-  if (len > 0) {
-    uart0_tx_buffer(buff, len);
+
+  // the text is decoded in place in the request, so there's no need for a copy
+  char *text = httpdGetArg(connData, "text", &len);
+  if (text != NULL && len > 0) {
+    uart0_tx_buffer(text, len);
     status = 200;
   }
   
@@ -104,6 +103,30 @@ ajaxConsoleSend(HttpdConnData *connData) {
   return HTTPD_CGI_DONE;
 }
 
+// copy the console bytes from the position *pos on into buff (see "start" of ajaxConsole), bytes
+// that have been dropped from the buffer already are skipped. After a reset of the buffer it
+// starts from the beginning again. Returns the length and advances *pos.
+int ICACHE_FLASH_ATTR
+consoleRead(int *pos, char *buff, int len) {
+  int console_len = (console_wr+BUF_MAX-console_rd) % BUF_MAX; // num chars in console_buf
+  int start = *pos - console_pos;
+  if (start < 0 || start > console_len) start = 0;
+  int n = 0;
+  int rd = (console_rd+start) % BUF_MAX;
+  while (n < len && rd != console_wr) {
+    buff[n++] = console_buf[rd];
+    rd = (rd + 1) % BUF_MAX;
+  }
+  *pos = console_pos + start + n;
+  return n;
+}
+
+// Server-Sent Events stream of the console text, see cgiTextStream
+int ICACHE_FLASH_ATTR
+ajaxConsoleStream(HttpdConnData *connData) {
+  return cgiTextStream(connData, consoleRead);
+}
+
 int ICACHE_FLASH_ATTR
 ajaxConsole(HttpdConnData *connData) {
   if (connData->conn==NULL) return HTTPD_CGI_DONE; // Connection aborted. Clean up.
@@ -115,9 +138,9 @@ ajaxConsole(HttpdConnData *connData) {
   jsonHeader(connData, 200);
 
   // figure out where to start in buffer based on URI param
-  len = httpdFindArg(connData->getArgs, "start", buff, sizeof(buff));
-  if (len > 0) {
-    start = atoi(buff);
+  char *arg = httpdGetArg(connData, "start", NULL);
+  if (arg != NULL && *arg != 0) {
+    start = atoi(arg);
     if (start < console_pos) {
       start = 0;
     } else if (start >= console_pos+console_len) {
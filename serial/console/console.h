@@ -9,6 +9,8 @@ int ajaxConsole(HttpdConnData *connData);
 int ajaxConsoleReset(HttpdConnData *connData);
 int ajaxConsoleBaud(HttpdConnData *connData);
 int ajaxConsoleSend(HttpdConnData *connData);
+int ajaxConsoleStream(HttpdConnData *connData);
 int tplConsole(HttpdConnData *connData, char *token, void **arg);
+int consoleRead(int *pos, char *buff, int len);
 
 #endif
@@ -32,8 +32,14 @@ LOCAL uint8_t uart_recvTaskNum;
 // UartDev is defined and initialized in rom code.
 extern UartDevice    UartDev;
 #define MAX_CB 4
+#define UART0_RX_INT_ENA (UART_RXFIFO_FULL_INT_ENA | UART_RXFIFO_TOUT_INT_ENA)
 static UartRecv_cb uart_recv_cb[4];
 
+// UART1 is normally used for debug output only. An output driver can claim it exclusively,
+// then it gets configured with uart1_conf0 and debug output to UART1 is dropped.
+static uint32 uart1_conf0 = CALC_UARTMODE(EIGHT_BITS, NONE_BITS, ONE_STOP_BIT);
+static Uart1TxEmpty_cb uart1_tx_empty_cb;
+
 static void uart0_rx_intr_handler(void *para);
 
 /******************************************************************************
@@ -61,9 +67,8 @@ uart_config(uint8 uart_no)
 
   uart_div_modify(uart_no, UART_CLK_FREQ / UartDev.baut_rate);
 
-  if (uart_no == UART1)  //UART 1 always 8 N 1
-    WRITE_PERI_REG(UART_CONF0(uart_no),
-        CALC_UARTMODE(EIGHT_BITS, NONE_BITS, ONE_STOP_BIT));
+  if (uart_no == UART1)  //UART 1 8 N 1, if not claimed by uart1_claim
+    WRITE_PERI_REG(UART_CONF0(uart_no), uart1_conf0);
   else
     WRITE_PERI_REG(UART_CONF0(uart_no),
         CALC_UARTMODE(UartDev.data_bits, UartDev.parity, UartDev.stop_bits));
@@ -124,6 +129,8 @@ uart_tx_one_char(uint8 uart, uint8 c)
 void ICACHE_FLASH_ATTR
 uart1_write_char(char c)
 {
+  // do not disturb the driver which owns UART1
+  if (uart1_tx_empty_cb != NULL) return;
   //if (c == '\n') uart_tx_one_char(UART1, '\r');
   uart_tx_one_char(UART1, c);
 }
@@ -179,7 +186,13 @@ static uint32 last_frm_err; // time in us when last framing error message was pr
 static void // must not use ICACHE_FLASH_ATTR !
 uart0_rx_intr_handler(void *para)
 {
-  // we assume that uart1 has interrupts disabled (it uses the same interrupt vector)
+  // uart1 only has the tx fifo empty interrupt enabled, if it was claimed by a driver
+  // (it uses the same interrupt vector)
+  if (READ_PERI_REG(UART_INT_ST(UART1)) & UART_TXFIFO_EMPTY_INT_ST) {
+    if (uart1_tx_empty_cb != NULL) uart1_tx_empty_cb();
+    WRITE_PERI_REG(UART_INT_CLR(UART1), UART_TXFIFO_EMPTY_INT_CLR);
+  }
+
   uint8 uart_no = UART0;
   const uint32 one_sec = 1000000; // one second in usecs
 
@@ -204,7 +217,9 @@ uart0_rx_intr_handler(void *para)
   ||  UART_RXFIFO_TOUT_INT_ST == (READ_PERI_REG(UART_INT_ST(uart_no)) & UART_RXFIFO_TOUT_INT_ST))
   {
     //DBG_UART("stat:%02X",*(uint8 *)UART_INT_ENA(uart_no));
-    ETS_UART_INTR_DISABLE();
+    // mask only the rx interrupts until the task has emptied the fifo, uart1 shares the vector
+    // and its tx fifo has to be refilled in time by the output drivers
+    CLEAR_PERI_REG_MASK(UART_INT_ENA(uart_no), UART0_RX_INT_ENA);
     post_usr_task(uart_recvTaskNum, 0);
   }
 }
@@ -233,13 +248,15 @@ uart_recvTask(os_event_t *events)
     }
   }
   WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_FULL_INT_CLR|UART_RXFIFO_TOUT_INT_CLR);
-  ETS_UART_INTR_ENABLE();
+  SET_PERI_REG_MASK(UART_INT_ENA(UART0), UART0_RX_INT_ENA);
 }
 
-// Turn UART interrupts off and poll for nchars or until timeout hits
+// Turn the UART0 rx interrupts off and poll for nchars or until timeout hits
 uint16_t ICACHE_FLASH_ATTR
 uart0_rx_poll(char *buff, uint16_t nchars, uint32_t timeout_us) {
-  ETS_UART_INTR_DISABLE();
+  // a pending uart_recvTask re-enables them itself
+  uint32 rx_ena = READ_PERI_REG(UART_INT_ENA(UART0)) & UART0_RX_INT_ENA;
+  CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART0_RX_INT_ENA);
   uint16_t got = 0;
   uint32_t start = system_get_time(); // time in us
   while (system_get_time()-start < timeout_us) {
@@ -249,7 +266,7 @@ uart0_rx_poll(char *buff, uint16_t nchars, uint32_t timeout_us) {
     }
   }
 done:
-  ETS_UART_INTR_ENABLE();
+  SET_PERI_REG_MASK(UART_INT_ENA(UART0), rx_ena);
   return got;
 }
 
@@ -284,6 +301,30 @@ uart_init(UartBautRate uart0_br, UartBautRate uart1_br)
   uart_recvTaskNum = register_usr_task(uart_recvTask);
 }
 
+/******************************************************************************
+ * FunctionName : uart1_claim
+ * Description  : reconfigure UART1 for the exclusive use by an output driver
+ * Parameters   : baud_rate - e.g. 250000 for DMX512
+ *                conf0 - value of UART_CONF0 (data bits, parity, stop bits)
+ *                tx_empty_threshold - the callback is called when the tx fifo holds less bytes
+ *                cb - tx fifo empty callback, called from the uart interrupt handler.
+ *                     Must not use ICACHE_FLASH_ATTR!
+ * Returns      : NONE
+ * The tx fifo empty interrupt is left disabled, the driver enables it when it has data to send.
+*******************************************************************************/
+void ICACHE_FLASH_ATTR
+uart1_claim(uint32 baud_rate, uint32 conf0, uint8 tx_empty_threshold, Uart1TxEmpty_cb cb)
+{
+  ETS_UART_INTR_DISABLE();
+  uart1_conf0 = conf0;
+  uart1_tx_empty_cb = cb;
+  UartDev.baut_rate = baud_rate;
+  uart_config(UART1);
+  SET_PERI_REG_BITS(UART_CONF1(UART1), UART_TXFIFO_EMPTY_THRHD, tx_empty_threshold,
+      UART_TXFIFO_EMPTY_THRHD_S);
+  ETS_UART_INTR_ENABLE();
+}
+
 void ICACHE_FLASH_ATTR
 uart_add_recv_cb(UartRecv_cb cb) {
   for (int i=0; i<MAX_CB; i++) {
@@ -6,6 +6,9 @@
 // Receive callback function signature
 typedef void (*UartRecv_cb)(char *buf, short len);
 
+// UART1 tx fifo empty callback signature, called from the interrupt handler
+typedef void (*Uart1TxEmpty_cb)(void);
+
 // Initialize UARTs to the provided baud rates (115200 recommended). This also makes the os_printf
 // calls use uart1 for output (for debugging purposes)
 void uart_init(UartBautRate uart0_br, UartBautRate uart1_br);
@@ -18,6 +21,10 @@ STATUS uart_tx_one_char(uint8 uart, uint8 c);
 
 void uart1_write_char(char c);
 
+// Reconfigure UART1 for the exclusive use by an output driver (e.g. DMX512). Afterwards
+// debug output to UART1 is dropped and cb gets called when the tx fifo runs empty.
+void uart1_claim(uint32 baud_rate, uint32 conf0, uint8 tx_empty_threshold, Uart1TxEmpty_cb cb);
+
 // Add a receive callback function, this is called on the uart receive task each time a chunk
 // of bytes are received. A small number of callbacks can be added and they are all called
 // with all new characters.
@@ -0,0 +1,45 @@
+// Host replacement of esp8266.h for the host tests of the io drivers: the UART1 registers, the
+// timers, the delays and the clock are routed to the fakes in hosttest.c
+#ifndef _ESP8266_H_
+#define _ESP8266_H_
+
+#include <stdio.h>
+#include <string.h>
+#include "c_types.h"
+
+#define BIT2 0x4
+#define BIT3 0x8
+#define BIT4 0x10
+#define BIT5 0x20
+
+#include "uart_hw.h"
+
+uint32 fakeRead(uint32 addr);
+void fakeWrite(uint32 addr, uint32 val);
+void fakeIntrEnable(int enable);
+void fakeDelay(uint32 us);
+uint32 system_get_time(void);
+
+#define READ_PERI_REG(addr) fakeRead(addr)
+#define WRITE_PERI_REG(addr, val) fakeWrite(addr, val)
+#define SET_PERI_REG_MASK(addr, mask) fakeWrite(addr, fakeRead(addr) | (mask))
+#define CLEAR_PERI_REG_MASK(addr, mask) fakeWrite(addr, fakeRead(addr) & ~(mask))
+#define ETS_UART_INTR_DISABLE() fakeIntrEnable(0)
+#define ETS_UART_INTR_ENABLE() fakeIntrEnable(1)
+#define os_delay_us(us) fakeDelay(us)
+#define os_memcpy memcpy
+#define os_memset memset
+#define os_printf printf
+
+typedef void ETSTimerFunc(void *arg);
+typedef struct {
+  ETSTimerFunc *fn;
+  void *arg;
+  uint64_t expire;          // ticks of the fake clock, 0 if not armed
+} ETSTimer;
+
+void os_timer_setfn(ETSTimer *t, ETSTimerFunc *fn, void *arg);
+void os_timer_arm(ETSTimer *t, uint32 ms, int repeat);
+void os_timer_disarm(ETSTimer *t);
+
+#endif
@@ -0,0 +1,156 @@
+/*
+Fakes shared by the host tests of the io drivers. The clock runs in ticks of 1/16µs and is
+advanced by os_delay_us and fakeRunUntil. The UART1 registers are emulated by a fake UART with a
+128 byte tx fifo, which shifts the bytes out in real time of the fake clock and records the line:
+break, mark after break and every byte with its start time. The tx fifo empty interrupt calls
+the callback registered by uart1_claim. The single-shot timers fire in fakeRunUntil.
+*/
+
+#include "hosttest.h"
+
+uint64_t fakeNow;
+int fakeFifoCount;
+int fakeStalled;
+uint32 fakeConf0;
+uint32 fakeBaud;
+uint8 fakeTxEmptyThreshold;
+WireEvent fakeWire[FAKE_MAX_EVENTS];
+int fakeWireLen;
+ETSTimer *fakeTimers[4];
+int fakeTimerCount;
+
+static uint8 fifo[FAKE_FIFO_SIZE];
+static int fifoHead;
+static uint64_t shiftEnd;	//end of the byte in the shift register
+static uint32 intEna;
+static int intrEnabled = 1, inIntr;
+static Uart1TxEmpty_cb txEmptyCb;
+
+static void wireLog(int type, uint8 value) {
+	CHECK(fakeWireLen < FAKE_MAX_EVENTS, "too many line events");
+	fakeWire[fakeWireLen].t = fakeNow;
+	fakeWire[fakeWireLen].type = type;
+	fakeWire[fakeWireLen].value = value;
+	fakeWireLen++;
+}
+
+int fakeDataBits(void) {
+	return 5 + ((fakeConf0 >> UART_BIT_NUM_S) & 3);
+}
+
+//Duration of one byte with start bit, data bits and stop bits as configured in CONF0
+uint32 fakeCharTicks(void) {
+	int halfBits = 2 + 2 * fakeDataBits();
+	switch ((fakeConf0 >> UART_STOP_BIT_NUM_S) & 3) {
+	case 2: halfBits += 3; break;
+	case 3: halfBits += 4; break;
+	default: halfBits += 2; break;
+	}
+	return (uint32)(halfBits * TICKS_US * 500000ull / fakeBaud);
+}
+
+static void checkIntr(void) {
+	if (!intrEnabled || inIntr || txEmptyCb == NULL) return;
+	if (!(intEna & UART_TXFIFO_EMPTY_INT_ENA) || fakeFifoCount >= fakeTxEmptyThreshold) return;
+	inIntr = 1;
+	txEmptyCb();
+	inIntr = 0;
+}
+
+//Run the UART until the clock reaches until
+static void uartRun(uint64_t until) {
+	while (fakeNow < until) {
+		if (shiftEnd > fakeNow) {
+			fakeNow = shiftEnd < until ? shiftEnd : until;
+		} else if (fakeFifoCount > 0 && !fakeStalled && !(fakeConf0 & UART_TXD_BRK)) {
+			wireLog(EV_BYTE, fifo[fifoHead]);
+			fifoHead = (fifoHead + 1) % FAKE_FIFO_SIZE;
+			fakeFifoCount--;
+			shiftEnd = fakeNow + fakeCharTicks();
+			checkIntr();
+		} else {
+			fakeNow = until;
+		}
+	}
+}
+
+uint32 fakeRead(uint32 addr) {
+	if (addr == UART_STATUS(UART1)) return (uint32)fakeFifoCount << UART_TXFIFO_CNT_S;
+	if (addr == UART_CONF0(UART1)) return fakeConf0;
+	if (addr == UART_INT_ENA(UART1)) return intEna;
+	CHECK(0, "read of unexpected register 0x%08x", addr);
+	return 0;
+}
+
+void fakeWrite(uint32 addr, uint32 val) {
+	if (addr == UART_FIFO(UART1)) {
+		CHECK(fakeFifoCount < FAKE_FIFO_SIZE, "tx fifo overflow");
+		fifo[(fifoHead + fakeFifoCount) % FAKE_FIFO_SIZE] = val;
+		fakeFifoCount++;
+	} else if (addr == UART_CONF0(UART1)) {
+		if ((val ^ fakeConf0) & UART_TXD_BRK) wireLog((val & UART_TXD_BRK) ? EV_BREAK : EV_MARK, 0);
+		fakeConf0 = val;
+	} else if (addr == UART_INT_ENA(UART1)) {
+		intEna = val;
+		checkIntr();
+	} else if (addr != UART_INT_CLR(UART1)) {
+		CHECK(0, "write of unexpected register 0x%08x", addr);
+	}
+}
+
+void fakeIntrEnable(int enable) {
+	intrEnabled = enable;
+	checkIntr();
+}
+
+void fakeDelay(uint32 us) {
+	uartRun(fakeNow + (uint64_t)us * TICKS_US);
+}
+
+uint32 system_get_time(void) {
+	return fakeNow / TICKS_US;
+}
+
+void uart1_claim(uint32 baud_rate, uint32 conf, uint8 tx_empty_threshold, Uart1TxEmpty_cb cb) {
+	fakeBaud = baud_rate;
+	fakeConf0 = conf;
+	fakeTxEmptyThreshold = tx_empty_threshold;
+	txEmptyCb = cb;
+}
+
+void os_timer_setfn(ETSTimer *t, ETSTimerFunc *fn, void *arg) {
+	t->fn = fn;
+	t->arg = arg;
+	for (int i = 0; i < fakeTimerCount; i++) {
+		if (fakeTimers[i] == t) return;
+	}
+	CHECK(fakeTimerCount < (int)(sizeof(fakeTimers) / sizeof(fakeTimers[0])), "too many timers");
+	fakeTimers[fakeTimerCount++] = t;
+}
+
+void os_timer_arm(ETSTimer *t, uint32 ms, int repeat) {
+	CHECK(!repeat, "only single-shot timers are expected");
+	t->expire = fakeNow + ms * 1000ull * TICKS_US;
+}
+
+void os_timer_disarm(ETSTimer *t) {
+	t->expire = 0;
+}
+
+//Run the UART and the timers until the clock reaches until
+void fakeRunUntil(uint64_t until) {
+	for (;;) {
+		ETSTimer *next = NULL;
+		for (int i = 0; i < fakeTimerCount; i++) {
+			if (fakeTimers[i]->expire != 0 && fakeTimers[i]->expire <= until &&
+					(next == NULL || fakeTimers[i]->expire < next->expire)) {
+				next = fakeTimers[i];
+			}
+		}
+		if (next == NULL) break;
+		uartRun(next->expire);
+		next->expire = 0;
+		next->fn(next->arg);
+	}
+	uartRun(until);
+}
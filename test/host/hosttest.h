@@ -0,0 +1,54 @@
+// Harness of the host tests of the io drivers, see hosttest.c and hosttest.mk
+#ifndef _HOSTTEST_H_
+#define _HOSTTEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp8266.h"
+#include "uart.h"
+
+//Ticks of the fake clock per µs
+#define TICKS_US 16
+
+#define FAKE_FIFO_SIZE 128
+#define FAKE_MAX_EVENTS 40000
+
+#define CHECK(cond, ...) do { \
+		if (!(cond)) { \
+			printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+			exit(1); \
+		} \
+	} while (0)
+
+enum { EV_BREAK, EV_MARK, EV_BYTE };
+
+//What the fake UART1 put on the line
+typedef struct {
+	uint64_t t;			//ticks of the fake clock
+	int type;
+	uint8 value;
+} WireEvent;
+
+extern uint64_t fakeNow;		//ticks
+extern int fakeFifoCount;		//bytes in the tx fifo
+extern int fakeStalled;			//the UART doesn't take bytes from the fifo
+extern uint32 fakeConf0;
+
+//set by uart1_claim
+extern uint32 fakeBaud;
+extern uint8 fakeTxEmptyThreshold;
+
+extern WireEvent fakeWire[FAKE_MAX_EVENTS];
+extern int fakeWireLen;
+
+extern ETSTimer *fakeTimers[4];
+extern int fakeTimerCount;
+
+int fakeDataBits(void);
+uint32 fakeCharTicks(void);
+void fakeRunUntil(uint64_t until);
+
+#endif
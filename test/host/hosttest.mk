@@ -0,0 +1,28 @@
+# Common rules of the host tests of the io drivers. A test directory holds its main.c and a
+# Makefile, which sets ROOT, TARGET, the driver objects OBJS (built from the parent directory)
+# and optionally TEST_CFLAGS before it includes this file. `make` builds and runs the test.
+
+HOSTTEST=$(ROOT)/test/host
+CFLAGS=-std=gnu99 -O2 -Wall -I$(HOSTTEST) -I$(ROOT)/httpd/hosthttpd/sdk -I$(ROOT)/include \
+	-I$(ROOT)/serial -I.. $(TEST_CFLAGS)
+TEST_OBJS=main.o hosttest.o $(OBJS)
+
+test: $(TARGET)
+	./$(TARGET)
+
+$(TARGET): $(TEST_OBJS)
+	$(CC) -o $@ $^
+
+main.o: main.c $(HOSTTEST)/hosttest.h
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+hosttest.o: $(HOSTTEST)/hosttest.c $(HOSTTEST)/hosttest.h
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+%.o: ../%.c
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+clean:
+	rm -f $(TARGET) $(TEST_OBJS)
+
+.PHONY: test clean